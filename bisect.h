@@ -18,6 +18,7 @@ struct rev_list_info {
 	struct rev_info *revs;
 	int flags;
 	int show_timestamp;
+	int show_disk_usage;
 	int hdr_termination;
 	const char *header_prefix;
 };
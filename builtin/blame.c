@@ -29,6 +29,9 @@
 #include "line-log.h"
 #include "dir.h"
 #include "progress.h"
+#include "notes-cache.h"
+#include "sha1-array.h"
+#include "thread-utils.h"
 
 static char blame_usage[] = N_("git blame [<options>] [<rev-opts>] [<rev>] [--] <file>");
 
@@ -53,6 +56,15 @@ static int abbrev = -1;
 static int no_whole_file_rename;
 static int show_progress;
 
+/* With blame.cache, the results of blaming whole files are kept here */
+static int use_blame_cache;
+static struct notes_cache *blame_cache;
+static int num_found_origins;
+static struct strbuf blame_cache_opts = STRBUF_INIT;
+
+/* With more than one thread, diffs are computed ahead of time */
+static int num_threads = 1;
+
 static struct date_mode blame_date_mode = { DATE_ISO8601 };
 static size_t blame_date_width;
 
@@ -126,6 +138,11 @@ struct origin {
 	 * blame list instead of other commits
 	 */
 	char guilty;
+	/* the order in which guilty origins were found, for blame.cache */
+	int found_order;
+	/* diffs against the scapegoats computed by worker threads */
+	struct blame_diff *diffs;
+	char diffs_queued;
 	char path[FLEX_ARRAY];
 };
 
@@ -956,6 +973,253 @@ static int blame_chunk_cb(long start_a, long count_a,
 	return 0;
 }
 
+struct blame_hunk {
+	long start_a, count_a;
+	long start_b, count_b;
+};
+
+/*
+ * The hunks between the blobs of an origin and one of its scapegoats,
+ * computed by a worker thread before pass_blame_to_parent() needs
+ * them.
+ */
+struct blame_diff {
+	/* next among the diffs queued for the same origin */
+	struct blame_diff *next;
+	/* next in the queue of diffs waiting for a thread */
+	struct blame_diff *next_todo;
+	unsigned char parent_sha1[20];
+	unsigned char target_sha1[20];
+	struct blame_hunk *hunk;
+	int nr, alloc;
+	/* these are protected by blame_diff_mutex */
+	char done, ok, cancelled;
+};
+
+#ifndef NO_PTHREADS
+static pthread_t *threads;
+static pthread_mutex_t blame_diff_mutex;
+
+/* Signalled when a diff is queued, or when no more diffs will be. */
+static pthread_cond_t cond_todo;
+
+/* Signalled when a worker thread is done with a diff. */
+static pthread_cond_t cond_done;
+
+static struct blame_diff *todo, **todo_tail = &todo;
+static int all_diffs_queued;
+
+/* The number of diffs queued and not yet used or discarded */
+static int num_queued_diffs;
+
+static void free_blame_diff(struct blame_diff *diff)
+{
+	free(diff->hunk);
+	free(diff);
+}
+
+static int record_hunk(long start_a, long count_a,
+		       long start_b, long count_b, void *data)
+{
+	struct blame_diff *diff = data;
+	struct blame_hunk *h;
+
+	ALLOC_GROW(diff->hunk, diff->nr + 1, diff->alloc);
+	h = &diff->hunk[diff->nr++];
+	h->start_a = start_a;
+	h->count_a = count_a;
+	h->start_b = start_b;
+	h->count_b = count_b;
+	return 0;
+}
+
+static int compute_diff(struct blame_diff *diff)
+{
+	mmfile_t file_p, file_o;
+	enum object_type type;
+	unsigned long size = 0;
+	int ret = -1;
+
+	file_p.ptr = read_sha1_file(diff->parent_sha1, &type, &size);
+	file_p.size = size;
+	file_o.ptr = read_sha1_file(diff->target_sha1, &type, &size);
+	file_o.size = size;
+	if (file_p.ptr && file_o.ptr)
+		ret = diff_hunks(&file_p, &file_o, 0, record_hunk, diff);
+	free(file_p.ptr);
+	free(file_o.ptr);
+	return ret;
+}
+
+static struct blame_diff *get_diff_todo(void)
+{
+	struct blame_diff *diff;
+
+	pthread_mutex_lock(&blame_diff_mutex);
+	for (;;) {
+		while (!todo && !all_diffs_queued)
+			pthread_cond_wait(&cond_todo, &blame_diff_mutex);
+		diff = todo;
+		if (!diff)
+			break;
+		todo = diff->next_todo;
+		if (!todo)
+			todo_tail = &todo;
+		if (!diff->cancelled)
+			break;
+		free_blame_diff(diff);
+	}
+	pthread_mutex_unlock(&blame_diff_mutex);
+	return diff;
+}
+
+static void *run_diffs(void *arg)
+{
+	struct blame_diff *diff;
+
+	while ((diff = get_diff_todo()) != NULL) {
+		int ok = !compute_diff(diff);
+
+		pthread_mutex_lock(&blame_diff_mutex);
+		diff->done = 1;
+		diff->ok = ok;
+		if (diff->cancelled)
+			free_blame_diff(diff);
+		else
+			pthread_cond_broadcast(&cond_done);
+		pthread_mutex_unlock(&blame_diff_mutex);
+	}
+	xdl_free_pool();
+	return NULL;
+}
+
+static void start_threads(void)
+{
+	int i;
+
+	pthread_mutex_init(&blame_diff_mutex, NULL);
+	pthread_cond_init(&cond_todo, NULL);
+	pthread_cond_init(&cond_done, NULL);
+	enable_obj_read_lock();
+
+	threads = xcalloc(num_threads, sizeof(*threads));
+	for (i = 0; i < num_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, run_diffs, NULL);
+		if (err)
+			die(_("blame: failed to create thread: %s"),
+			    strerror(err));
+	}
+}
+
+static void wait_all(void)
+{
+	int i;
+
+	pthread_mutex_lock(&blame_diff_mutex);
+	all_diffs_queued = 1;
+	pthread_cond_broadcast(&cond_todo);
+	pthread_mutex_unlock(&blame_diff_mutex);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	pthread_mutex_destroy(&blame_diff_mutex);
+	pthread_cond_destroy(&cond_todo);
+	pthread_cond_destroy(&cond_done);
+	disable_obj_read_lock();
+}
+
+static void queue_diff(struct origin *target, const unsigned char *parent_sha1)
+{
+	struct blame_diff *diff = xcalloc(1, sizeof(*diff));
+
+	hashcpy(diff->parent_sha1, parent_sha1);
+	hashcpy(diff->target_sha1, target->blob_sha1);
+	diff->next = target->diffs;
+	target->diffs = diff;
+	num_queued_diffs++;
+
+	pthread_mutex_lock(&blame_diff_mutex);
+	*todo_tail = diff;
+	todo_tail = &diff->next_todo;
+	pthread_cond_signal(&cond_todo);
+	pthread_mutex_unlock(&blame_diff_mutex);
+}
+
+/*
+ * We are done with "diff"; free it, or let the thread working on it
+ * do so when it is finished.
+ */
+static void release_diff(struct blame_diff *diff)
+{
+	num_queued_diffs--;
+	pthread_mutex_lock(&blame_diff_mutex);
+	if (diff->done)
+		free_blame_diff(diff);
+	else
+		diff->cancelled = 1;
+	pthread_mutex_unlock(&blame_diff_mutex);
+}
+
+static void discard_queued_diffs(struct origin *o)
+{
+	while (o->diffs) {
+		struct blame_diff *diff = o->diffs;
+		o->diffs = diff->next;
+		release_diff(diff);
+	}
+}
+
+/*
+ * If a worker thread was asked to diff the blobs of "parent" and
+ * "target", wait for it and feed its hunks to blame_chunk_cb(), which
+ * then sees exactly what diff_hunks() would have given it.  Return -1
+ * if the diff has to be done here after all.
+ */
+static int use_queued_diff(struct origin *target, struct origin *parent,
+			   struct blame_chunk_cb_data *d)
+{
+	struct blame_diff **tail, *diff;
+	int i;
+
+	if (strcmp(parent->path, target->path))
+		return -1;
+	for (tail = &target->diffs; (diff = *tail) != NULL; tail = &diff->next)
+		if (!hashcmp(diff->parent_sha1, parent->blob_sha1) &&
+		    !hashcmp(diff->target_sha1, target->blob_sha1))
+			break;
+	if (!diff)
+		return -1;
+	*tail = diff->next;
+
+	pthread_mutex_lock(&blame_diff_mutex);
+	while (!diff->done)
+		pthread_cond_wait(&cond_done, &blame_diff_mutex);
+	pthread_mutex_unlock(&blame_diff_mutex);
+
+	if (!diff->ok) {
+		release_diff(diff);
+		return -1;
+	}
+	num_read_blob += 2;
+	num_get_patch++;
+	for (i = 0; i < diff->nr; i++) {
+		struct blame_hunk *h = &diff->hunk[i];
+		blame_chunk_cb(h->start_a, h->count_a,
+			       h->start_b, h->count_b, d);
+	}
+	release_diff(diff);
+	return 0;
+}
+#else
+static inline int use_queued_diff(struct origin *target, struct origin *parent,
+				  struct blame_chunk_cb_data *d)
+{
+	return -1;
+}
+#endif
+
 /*
  * We are looking at the origin 'target' and aiming to pass blame
  * for the lines it is suspected to its parent.  Run diff to find
@@ -976,14 +1240,16 @@ static void pass_blame_to_parent(struct scoreboard *sb,
 	d.offset = 0;
 	d.dstq = &newdest; d.srcq = &target->suspects;
 
-	fill_origin_blob(&sb->revs->diffopt, parent, &file_p);
-	fill_origin_blob(&sb->revs->diffopt, target, &file_o);
-	num_get_patch++;
+	if (use_queued_diff(target, parent, &d)) {
+		fill_origin_blob(&sb->revs->diffopt, parent, &file_p);
+		fill_origin_blob(&sb->revs->diffopt, target, &file_o);
+		num_get_patch++;
 
-	if (diff_hunks(&file_p, &file_o, 0, blame_chunk_cb, &d))
-		die("unable to generate diff (%s -> %s)",
-		    oid_to_hex(&parent->commit->object.oid),
-		    oid_to_hex(&target->commit->object.oid));
+		if (diff_hunks(&file_p, &file_o, 0, blame_chunk_cb, &d))
+			die("unable to generate diff (%s -> %s)",
+			    oid_to_hex(&parent->commit->object.oid),
+			    oid_to_hex(&target->commit->object.oid));
+	}
 	/* The rest are the same as the parent */
 	blame_chunk(&d.dstq, &d.srcq, INT_MAX, d.offset, INT_MAX, parent);
 	*d.dstq = NULL;
@@ -1768,10 +2034,510 @@ static void found_guilty_entry(struct blame_entry *ent,
 	display_progress(pi->progress, pi->blamed_lines);
 }
 
+/*
+ * With blame.cache, the final blame of a whole file at a commit is
+ * remembered in refs/notes/blame, keyed by a hash of the commit, the
+ * path, the blob and the options that affect the result.  Whenever a
+ * suspect we are about to break down has an entry, all of its lines
+ * can be attributed directly, without walking the history behind it.
+ *
+ * Each line of the cached value describes one blame_entry:
+ *
+ *	<lno> <s_lno> <num_lines> <commit> <previous>\t<path>\t<previous path>\n
+ *
+ * where <previous> is the null SHA-1 (and <previous path> empty) if
+ * the guilty origin has no previous one.
+ */
+#define BLAME_CACHE_VALIDITY "blame-cache-v1"
+
+struct cached_blame {
+	int lno, s_lno, num_lines;
+	int order;
+	struct origin *suspect;
+};
+
+static void blame_cache_key(struct commit *commit, const unsigned char *blob_sha1,
+			    const char *path, unsigned char *key)
+{
+	git_SHA_CTX c;
+	struct strbuf buf = STRBUF_INIT;
+
+	strbuf_addf(&buf, "%s ", oid_to_hex(&commit->object.oid));
+	strbuf_addf(&buf, "%s %s", sha1_to_hex(blob_sha1), path);
+	git_SHA1_Init(&c);
+	git_SHA1_Update(&c, buf.buf, buf.len + 1);
+	git_SHA1_Update(&c, blame_cache_opts.buf, blame_cache_opts.len);
+	git_SHA1_Final(key, &c);
+	strbuf_release(&buf);
+}
+
+static struct origin *cached_origin(struct scoreboard *sb,
+				    const unsigned char *sha1, const char *path)
+{
+	struct commit *commit = lookup_commit(sha1);
+
+	if (!commit || parse_commit(commit))
+		return NULL;
+	return get_origin(sb, commit, path);
+}
+
+static int parse_cached_blame(struct scoreboard *sb, const char **bufp,
+			      const char *end, struct cached_blame *cb)
+{
+	const char *buf = *bufp, *path, *prev_path, *eol;
+	unsigned char sha1[20], prev_sha1[20];
+	char *ep;
+
+	eol = memchr(buf, '\n', end - buf);
+	if (!eol)
+		return -1;
+	cb->lno = strtol(buf, &ep, 10);
+	if (ep == buf || *ep != ' ' || cb->lno < 0)
+		return -1;
+	buf = ep + 1;
+	cb->s_lno = strtol(buf, &ep, 10);
+	if (ep == buf || *ep != ' ' || cb->s_lno < 0)
+		return -1;
+	buf = ep + 1;
+	cb->num_lines = strtol(buf, &ep, 10);
+	if (ep == buf || *ep != ' ' || cb->num_lines < 1)
+		return -1;
+	buf = ep + 1;
+	if (eol - buf < 82 || get_sha1_hex(buf, sha1) || buf[40] != ' ' ||
+	    get_sha1_hex(buf + 41, prev_sha1) || buf[81] != '\t')
+		return -1;
+	path = buf + 82;
+	prev_path = memchr(path, '\t', eol - path);
+	if (!prev_path || prev_path == path)
+		return -1;
+
+	path = xmemdupz(path, prev_path - path);
+	prev_path = xmemdupz(prev_path + 1, eol - prev_path - 1);
+	cb->suspect = cached_origin(sb, sha1, path);
+	if (cb->suspect && !cb->suspect->previous && !is_null_sha1(prev_sha1))
+		cb->suspect->previous = cached_origin(sb, prev_sha1, prev_path);
+	free((char *)path);
+	free((char *)prev_path);
+	if (!cb->suspect)
+		return -1;
+	*bufp = eol + 1;
+	return 0;
+}
+
+/*
+ * Find the entry covering line "lno" of the cached origin; the cached
+ * entries are sorted and cover the whole file.
+ */
+static struct cached_blame *find_cached_blame(struct cached_blame *cb,
+					      int nr, int lno)
+{
+	int lo = 0, hi = nr;
+
+	while (lo < hi) {
+		int mi = lo + (hi - lo) / 2;
+
+		if (lno < cb[mi].lno)
+			hi = mi;
+		else if (lno >= cb[mi].lno + cb[mi].num_lines)
+			lo = mi + 1;
+		else
+			return &cb[mi];
+	}
+	return NULL;
+}
+
+static int compare_cached_blame_lno(const void *p1, const void *p2)
+{
+	const struct cached_blame *c1 = p1, *c2 = p2;
+
+	if (c1->lno == c2->lno)
+		return 0;
+	return c1->lno > c2->lno ? 1 : -1;
+}
+
+/*
+ * The cached entries are recorded in the order their commits were
+ * found to be guilty, and we attribute lines in the same order so
+ * that --incremental output does not change.  Until then, the score
+ * field (which is not otherwise used without -M and -C) holds the
+ * position of the cached entry a blame_entry comes from.
+ */
+static int compare_blame_cached(const void *p1, const void *p2)
+{
+	const struct blame_entry *e1 = p1, *e2 = p2;
+
+	if (e1->score != e2->score)
+		return e1->score > e2->score ? 1 : -1;
+	return e1->lno > e2->lno ? 1 : -1;
+}
+
+static void mark_guilty(struct origin *suspect)
+{
+	suspect->guilty = 1;
+	if (!suspect->found_order)
+		suspect->found_order = ++num_found_origins;
+}
+
+/*
+ * If the blame for "origin" is cached, attribute everything it is
+ * suspected for accordingly and return 0; otherwise return -1.
+ */
+static int use_cached_blame(struct scoreboard *sb, struct origin *origin,
+			    struct progress_info *pi)
+{
+	unsigned char key[20];
+	struct cached_blame *cb = NULL;
+	struct blame_entry *e, *next, *blamed = NULL;
+	const char *buf, *end;
+	char *value;
+	size_t size;
+	int nr = 0, alloc = 0, i, ret = -1;
+
+	blame_cache_key(origin->commit, origin->blob_sha1, origin->path, key);
+	value = notes_cache_get(blame_cache, key, &size);
+	if (!value)
+		return -1;
+
+	/* Check the whole entry before using any of it */
+	end = value + size;
+	for (buf = value; buf < end; nr++) {
+		ALLOC_GROW(cb, nr + 1, alloc);
+		if (parse_cached_blame(sb, &buf, end, &cb[nr]))
+			goto out;
+		cb[nr].order = nr;
+	}
+	qsort(cb, nr, sizeof(*cb), compare_cached_blame_lno);
+	for (i = 0; i < nr; i++)
+		if (cb[i].lno != (i ? cb[i - 1].lno + cb[i - 1].num_lines : 0))
+			goto out;
+	for (e = origin->suspects; e; e = e->next)
+		if (!nr || e->s_lno + e->num_lines >
+			   cb[nr - 1].lno + cb[nr - 1].num_lines)
+			goto out;
+
+	for (e = origin->suspects; e; e = next) {
+		int lno = e->lno, s_lno = e->s_lno, left = e->num_lines;
+
+		next = e->next;
+		while (left) {
+			struct cached_blame *c = find_cached_blame(cb, nr, s_lno);
+			struct blame_entry *ent = xcalloc(1, sizeof(*ent));
+			int skip = s_lno - c->lno;
+
+			ent->lno = lno;
+			ent->s_lno = c->s_lno + skip;
+			ent->num_lines = c->num_lines - skip;
+			if (ent->num_lines > left)
+				ent->num_lines = left;
+			ent->suspect = origin_incref(c->suspect);
+			ent->score = c->order;
+			if (!ent->suspect->commit->parents && !show_root)
+				ent->suspect->commit->object.flags |= UNINTERESTING;
+			ent->next = blamed;
+			blamed = ent;
+
+			lno += ent->num_lines;
+			s_lno += ent->num_lines;
+			left -= ent->num_lines;
+		}
+		origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+
+	blamed = blame_sort(blamed, compare_blame_cached);
+	for (e = blamed; e; e = next) {
+		next = e->next;
+		e->score = 0;
+		mark_guilty(e->suspect);
+		found_guilty_entry(e, pi);
+		e->next = sb->ent;
+		sb->ent = e;
+	}
+	ret = 0;
+
+out:
+	for (i = 0; i < nr; i++)
+		origin_decref(cb[i].suspect);
+	free(cb);
+	free(value);
+	return ret;
+}
+
+static int compare_blame_found(const void *p1, const void *p2)
+{
+	const struct blame_entry *e1 = *(const struct blame_entry **)p1;
+	const struct blame_entry *e2 = *(const struct blame_entry **)p2;
+
+	if (e1->suspect->found_order != e2->suspect->found_order)
+		return e1->suspect->found_order > e2->suspect->found_order ? 1 : -1;
+	return e1->lno > e2->lno ? 1 : -1;
+}
+
+/*
+ * Remember the blame of the whole file at the final commit, which
+ * the caller has sorted and coalesced.  The entries are written in
+ * the order their commits were found, see compare_blame_cached().
+ */
+static void cache_blame(struct scoreboard *sb, unsigned char *key)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_entry *ent, **found = NULL;
+	char *value;
+	size_t size;
+	int nr = 0, alloc = 0, i;
+
+	value = notes_cache_get(blame_cache, key, &size);
+	if (value) {
+		free(value);
+		return;
+	}
+	for (ent = sb->ent; ent; ent = ent->next) {
+		ALLOC_GROW(found, nr + 1, alloc);
+		found[nr++] = ent;
+	}
+	qsort(found, nr, sizeof(*found), compare_blame_found);
+
+	for (i = 0; i < nr; i++) {
+		struct origin *suspect = found[i]->suspect;
+		struct origin *prev = suspect->previous;
+
+		/* paths with these cannot be represented */
+		if (strpbrk(suspect->path, "\t\n") ||
+		    (prev && strpbrk(prev->path, "\t\n")))
+			goto out;
+		strbuf_addf(&buf, "%d %d %d %s ", found[i]->lno,
+			    found[i]->s_lno, found[i]->num_lines,
+			    oid_to_hex(&suspect->commit->object.oid));
+		strbuf_addf(&buf, "%s\t%s\t%s\n",
+			    prev ? oid_to_hex(&prev->commit->object.oid) :
+				   sha1_to_hex(null_sha1),
+			    suspect->path, prev ? prev->path : "");
+	}
+	/*
+	 * Ignore errors, as we might be in a readonly repository; but
+	 * do not let commit_tree() die for want of an identity after
+	 * the blame has already been shown.
+	 */
+	git_author_info(0);
+	git_committer_info(0);
+	if (!author_ident_sufficiently_given() ||
+	    !committer_ident_sufficiently_given())
+		goto out;
+	notes_cache_put(blame_cache, key, buf.buf, buf.len);
+	notes_cache_write(blame_cache);
+out:
+	free(found);
+	strbuf_release(&buf);
+}
+
+/*
+ * The cache can only be used when the blame of a line in a commit
+ * does not depend on where we started digging from: not with -M or
+ * -C, whose scores depend on how the lines were grouped on the way,
+ * and not when the history is cut short by a bottom commit or a date
+ * limit.  Neither can it be used when the shape of the history may
+ * change under it: in a shallow repository, with a graft file or
+ * with replace refs.
+ */
+static int has_replace_ref(const char *refname, const struct object_id *oid,
+			   int flags, void *cb_data)
+{
+	return 1;
+}
+
+static int history_may_change(void)
+{
+	return is_repository_shallow() ||
+		file_exists(get_graft_file()) ||
+		(check_replace_refs && for_each_replace_ref(has_replace_ref, NULL));
+}
+
+static void setup_blame_cache(struct rev_info *revs, const char *path, int opt)
+{
+	struct userdiff_driver *driver = NULL;
+	int i;
+
+	if (!use_blame_cache || reverse || opt || revs->max_age != -1)
+		return;
+	if (history_may_change())
+		return;
+	for (i = 0; i < revs->pending.nr; i++)
+		if (revs->pending.objects[i].item->flags & UNINTERESTING)
+			return;
+	if (DIFF_OPT_TST(&revs->diffopt, ALLOW_TEXTCONV)) {
+		driver = userdiff_find_by_path(path);
+		if (driver)
+			driver = userdiff_get_textconv(driver);
+	}
+	strbuf_addf(&blame_cache_opts,
+		    "xdl %d root %d first-parent %d follow %d textconv %s",
+		    xdl_opts, show_root, revs->first_parent_only,
+		    !no_whole_file_rename, driver ? driver->textconv : "");
+	blame_cache = xmalloc(sizeof(*blame_cache));
+	notes_cache_init(blame_cache, "blame", BLAME_CACHE_VALIDITY);
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
  * to its parents. */
+/*
+ * Whether assign_blame() will try to pass the blame of "commit" on to
+ * its scapegoats, instead of taking it as a boundary.
+ */
+static int passes_blame(struct rev_info *revs, struct commit *commit)
+{
+	return reverse ||
+		(!(commit->object.flags & UNINTERESTING) &&
+		 !(revs->max_age != -1 && commit->date < revs->max_age));
+}
+
+#ifndef NO_PTHREADS
+/* How many diffs we keep the worker threads busy with */
+#define QUEUED_DIFFS_PER_THREAD 4
+
+static int has_textconv(struct scoreboard *sb, struct origin *o)
+{
+	struct userdiff_driver *driver;
+
+	if (!DIFF_OPT_TST(&sb->revs->diffopt, ALLOW_TEXTCONV))
+		return 0;
+	driver = userdiff_find_by_path(o->path);
+	return driver && driver->textconv;
+}
+
+static int has_cached_blame(struct origin *o)
+{
+	unsigned char key[20];
+
+	if (!blame_cache)
+		return 0;
+	blame_cache_key(o->commit, o->blob_sha1, o->path, key);
+	return !!get_note(&blame_cache->tree, key);
+}
+
+/*
+ * Find the tree of a scapegoat without parsing it; see
+ * queue_scapegoat_diffs().
+ */
+static int scapegoat_tree(struct commit *commit, unsigned char *tree_sha1)
+{
+	enum object_type type;
+	unsigned long size;
+	const char *p;
+	char *buf;
+	int ret = -1;
+
+	if (commit->object.parsed) {
+		if (!commit->tree)
+			return -1;
+		hashcpy(tree_sha1, commit->tree->object.oid.hash);
+		return 0;
+	}
+	buf = read_sha1_file(commit->object.oid.hash, &type, &size);
+	if (buf && type == OBJ_COMMIT &&
+	    skip_prefix(buf, "tree ", &p) && !get_sha1_hex(p, tree_sha1))
+		ret = 0;
+	free(buf);
+	return ret;
+}
+
+static void queue_diff_fn(const unsigned char sha1[20], void *data)
+{
+	queue_diff(data, sha1);
+}
+
+/*
+ * Have the worker threads diff the blob of "o" against the blobs at
+ * the same path in its scapegoats, which is what pass_blame() will
+ * most likely ask for.  This must not change the outcome of the
+ * blame, so it parses no commits; that would change how far
+ * mark_parents_uninteresting() gets.  A diff that pass_blame() does
+ * not need after all (e.g. because the path was renamed) is simply
+ * discarded.
+ */
+static void queue_scapegoat_diffs(struct scoreboard *sb, struct origin *o)
+{
+	struct rev_info *revs = sb->revs;
+	struct commit *commit = o->commit;
+	struct sha1_array blobs = SHA1_ARRAY_INIT;
+	struct commit_list *sg;
+
+	o->diffs_queued = 1;
+	if (is_null_oid(&commit->object.oid) || is_null_sha1(o->blob_sha1) ||
+	    !commit->object.parsed || !passes_blame(revs, commit) ||
+	    has_cached_blame(o) || has_textconv(sb, o))
+		return;
+
+	if (reverse)
+		sg = lookup_decoration(&revs->children, &commit->object);
+	else
+		sg = commit->parents;
+	for (; sg; sg = sg->next) {
+		unsigned char tree_sha1[20], sha1[20];
+		unsigned mode;
+
+		if (!scapegoat_tree(sg->item, tree_sha1) &&
+		    !get_tree_entry(tree_sha1, o->path, sha1, &mode) &&
+		    (S_ISREG(mode) || S_ISLNK(mode))) {
+			/* pass_blame() would pass the whole blame */
+			if (!hashcmp(sha1, o->blob_sha1)) {
+				sha1_array_clear(&blobs);
+				return;
+			}
+			sha1_array_append(&blobs, sha1);
+		}
+		if (!reverse && revs->first_parent_only)
+			break;
+	}
+	sha1_array_for_each_unique(&blobs, queue_diff_fn, o);
+	sha1_array_clear(&blobs);
+}
+
+static void queue_commit_diffs(struct scoreboard *sb, struct commit *commit)
+{
+	struct origin *o;
+
+	for (o = commit->util; o; o = o->next) {
+		if (num_queued_diffs >= num_threads * QUEUED_DIFFS_PER_THREAD)
+			return;
+		if (o->suspects && !o->diffs_queued)
+			queue_scapegoat_diffs(sb, o);
+	}
+}
+
+/*
+ * Queue the diffs for "commit", which is about to be processed, and
+ * for the commits that are next in line.  The blame is still assigned
+ * in the same order, so the result is the same as without threads.
+ */
+static void queue_diffs(struct scoreboard *sb, struct commit *commit)
+{
+	int i;
+
+	queue_commit_diffs(sb, commit);
+	for (i = 0; i < sb->commits.nr; i++)
+		queue_commit_diffs(sb, sb->commits.array[i].data);
+}
+#else
+static inline void start_threads(void)
+{
+}
+
+static inline void wait_all(void)
+{
+}
+
+static inline void queue_diffs(struct scoreboard *sb, struct commit *commit)
+{
+}
+
+static inline void discard_queued_diffs(struct origin *o)
+{
+}
+#endif
+
 static void assign_blame(struct scoreboard *sb, int opt)
 {
 	struct rev_info *revs = sb->revs;
@@ -1781,6 +2547,8 @@ static void assign_blame(struct scoreboard *sb, int opt)
 	if (show_progress)
 		pi.progress = start_progress_delay(_("Blaming lines"),
 						   sb->num_lines, 50, 1);
+	if (num_threads > 1)
+		start_threads();
 
 	while (commit) {
 		struct blame_entry *ent;
@@ -1803,9 +2571,15 @@ static void assign_blame(struct scoreboard *sb, int opt)
 		 */
 		origin_incref(suspect);
 		parse_commit(commit);
-		if (reverse ||
-		    (!(commit->object.flags & UNINTERESTING) &&
-		     !(revs->max_age != -1 && commit->date < revs->max_age)))
+		if (blame_cache && !is_null_oid(&commit->object.oid) &&
+		    !use_cached_blame(sb, suspect, &pi)) {
+			discard_queued_diffs(suspect);
+			origin_decref(suspect);
+			continue;
+		}
+		if (num_threads > 1)
+			queue_diffs(sb, commit);
+		if (passes_blame(revs, commit))
 			pass_blame(sb, suspect, opt);
 		else {
 			commit->object.flags |= UNINTERESTING;
@@ -1819,7 +2593,7 @@ static void assign_blame(struct scoreboard *sb, int opt)
 		/* Take responsibility for the remaining entries */
 		ent = suspect->suspects;
 		if (ent) {
-			suspect->guilty = 1;
+			mark_guilty(suspect);
 			for (;;) {
 				struct blame_entry *next = ent->next;
 				found_guilty_entry(ent, &pi);
@@ -1833,12 +2607,15 @@ static void assign_blame(struct scoreboard *sb, int opt)
 				break;
 			}
 		}
+		discard_queued_diffs(suspect);
 		origin_decref(suspect);
 
 		if (DEBUG) /* sanity */
 			sanity_check_refcnt(sb);
 	}
 
+	if (num_threads > 1)
+		wait_all();
 	stop_progress(&pi.progress);
 }
 
@@ -2214,6 +2991,17 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 			*output_option &= ~OUTPUT_SHOW_EMAIL;
 		return 0;
 	}
+	if (!strcmp(var, "blame.cache")) {
+		use_blame_cache = git_config_bool(var, value);
+		return 0;
+	}
+	if (!strcmp(var, "blame.threads")) {
+		num_threads = git_config_int(var, value);
+		if (num_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    num_threads, var);
+		return 0;
+	}
 	if (!strcmp(var, "blame.date")) {
 		if (!value)
 			return config_error_nonbool(var);
@@ -2521,6 +3309,8 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	char *final_commit_name = NULL;
 	enum object_type type;
 	struct commit *final_commit = NULL;
+	unsigned char cache_key[20];
+	int cache_result = 0;
 
 	static struct string_list range_list;
 	static int output_option = 0, opt = 0;
@@ -2533,6 +3323,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		OPT_BOOL(0, "root", &show_root, N_("Do not treat root commits as boundaries (Default: off)")),
 		OPT_BOOL(0, "show-stats", &show_stats, N_("Show work cost statistics")),
 		OPT_BOOL(0, "progress", &show_progress, N_("Force progress reporting")),
+		OPT_INTEGER(0, "threads", &num_threads, N_("use <n> threads to compute diffs")),
 		OPT_BIT(0, "score-debug", &output_option, N_("Show output score for blame entries"), OUTPUT_SHOW_SCORE),
 		OPT_BIT('f', "show-name", &output_option, N_("Show original filename (Default: auto)"), OUTPUT_SHOW_NAME),
 		OPT_BIT('n', "show-number", &output_option, N_("Show original linenumber (Default: off)"), OUTPUT_SHOW_NUMBER),
@@ -2600,6 +3391,17 @@ parse_done:
 	} else if (show_progress < 0)
 		show_progress = isatty(2);
 
+#ifndef NO_PTHREADS
+	if (num_threads < 0)
+		die(_("invalid number of threads specified (%d)"), num_threads);
+	if (!num_threads)
+		num_threads = online_cpus();
+#else
+	if (num_threads != 1)
+		warning(_("no threads support, ignoring --threads"));
+	num_threads = 1;
+#endif
+
 	if (0 < abbrev)
 		/* one more abbrev length is needed for the boundary commit */
 		abbrev++;
@@ -2746,6 +3548,9 @@ parse_done:
 			die("--reverse and --first-parent together require specified latest commit");
 	}
 
+	if (!revs_file)
+		setup_blame_cache(&revs, path, opt);
+
 	/*
 	 * If we have bottom, this will mark the ancestors of the
 	 * bottom commits we would reach while traversing as
@@ -2822,6 +3627,30 @@ parse_done:
 	}
 	sort_and_merge_range_set(&ranges);
 
+	/*
+	 * Only the blame of the whole file is worth remembering.  An
+	 * unmodified file in the working tree has the same blame as in
+	 * HEAD, so remember it for HEAD.
+	 */
+	if (blame_cache && ranges.nr == 1 && !ranges.ranges[0].start &&
+	    ranges.ranges[0].end == lno) {
+		struct commit *commit = sb.final;
+		unsigned char blob_sha1[20];
+		unsigned mode;
+
+		if (!is_null_oid(&commit->object.oid)) {
+			blame_cache_key(commit, o->blob_sha1, path, cache_key);
+			cache_result = 1;
+		} else if (commit->parents && !commit->parents->next &&
+			   !get_tree_entry(commit->parents->item->object.oid.hash,
+					   path, blob_sha1, &mode) &&
+			   !hashcmp(blob_sha1, o->blob_sha1)) {
+			commit = commit->parents->item;
+			blame_cache_key(commit, blob_sha1, path, cache_key);
+			cache_result = 1;
+		}
+	}
+
 	for (range_i = ranges.nr; range_i > 0; --range_i) {
 		const struct range *r = &ranges.ranges[range_i - 1];
 		long bottom = r->start;
@@ -2856,8 +3685,14 @@ parse_done:
 
 	free(final_commit_name);
 
-	if (incremental)
+	if (incremental) {
+		if (cache_result) {
+			sb.ent = blame_sort(sb.ent, compare_blame_final);
+			coalesce(&sb);
+			cache_blame(&sb, cache_key);
+		}
 		return 0;
+	}
 
 	sb.ent = blame_sort(sb.ent, compare_blame_final);
 
@@ -2867,6 +3702,8 @@ parse_done:
 		find_alignment(&sb, &output_option);
 
 	output(&sb, output_option);
+	if (cache_result)
+		cache_blame(&sb, cache_key);
 	free((void *)sb.final_buf);
 	for (ent = sb.ent; ent; ) {
 		struct blame_entry *e = ent->next;
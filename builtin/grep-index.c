@@ -0,0 +1,205 @@
+/*
+ * Builtin "git grep-index"
+ *
+ * Maintain the trigram indexes that "git grep <tree-ish>" uses to skip
+ * blobs that cannot match.
+ */
+#include "cache.h"
+#include "builtin.h"
+#include "parse-options.h"
+#include "commit.h"
+#include "tree.h"
+#include "refs.h"
+#include "sha1-array.h"
+#include "grep-index.h"
+
+static const char * const grep_index_usage[] = {
+	N_("git grep-index build [-v] [<tree-ish>...]"),
+	N_("git grep-index verify [<tree-ish>...]"),
+	N_("git grep-index expire [-n] [-v] [<tree-ish>...]"),
+	NULL
+};
+
+static int show_only;
+static int verbose;
+
+static void get_tree(const char *name, unsigned char *tree_sha1,
+		     struct commit **commit)
+{
+	unsigned char sha1[20];
+	struct tree *tree;
+
+	if (get_sha1(name, sha1))
+		die(_("not a valid object name: %s"), name);
+	tree = parse_tree_indirect(sha1);
+	if (!tree)
+		die(_("not a tree object: %s"), name);
+	hashcpy(tree_sha1, tree->object.oid.hash);
+	if (commit)
+		*commit = lookup_commit_reference_gently(sha1, 1);
+}
+
+/*
+ * The index we start from when building the index of "tree_sha1": the
+ * one of the first parent's tree if there is one, as that shares most
+ * of its blobs, and otherwise the one written most recently.
+ */
+static struct grep_index *base_index(struct commit *commit)
+{
+	struct grep_index *base = NULL;
+
+	if (commit && !parse_commit(commit) && commit->parents &&
+	    !parse_commit(commit->parents->item))
+		base = grep_index_load(commit->parents->item->tree->object.oid.hash);
+	if (!base)
+		base = grep_index_load_latest();
+	return base;
+}
+
+static int build(int ac, const char **av, const char *prefix)
+{
+	struct option options[] = {
+		OPT__VERBOSE(&verbose, N_("report how many filters were computed")),
+		OPT_END()
+	};
+	const char *head[] = { "HEAD", NULL };
+	int i, ret = 0;
+
+	ac = parse_options(ac, av, prefix, options, grep_index_usage, 0);
+	if (!ac) {
+		av = head;
+		ac = 1;
+	}
+	for (i = 0; i < ac; i++) {
+		unsigned char tree_sha1[20];
+		struct grep_index *base;
+		struct commit *commit;
+		int built;
+
+		get_tree(av[i], tree_sha1, &commit);
+		base = base_index(commit);
+		built = grep_index_write(tree_sha1, base);
+		grep_index_free(base);
+		if (built < 0)
+			ret = 1;
+		else if (verbose)
+			fprintf(stderr, _("computed %d filters for tree %s\n"),
+				built, sha1_to_hex(tree_sha1));
+	}
+	return ret;
+}
+
+static int for_each_index(int (*fn)(const unsigned char *, void *), void *data)
+{
+	struct strbuf path = STRBUF_INIT;
+	unsigned char sha1[20];
+	struct dirent *de;
+	DIR *dir;
+	int ret = 0;
+
+	strbuf_addf(&path, "%s/info/grep-index", get_object_directory());
+	dir = opendir(path.buf);
+	strbuf_release(&path);
+	if (!dir)
+		return 0;
+	while ((de = readdir(dir)) != NULL) {
+		if (strlen(de->d_name) != 40 || get_sha1_hex(de->d_name, sha1))
+			continue;
+		ret |= fn(sha1, data);
+	}
+	closedir(dir);
+	return ret;
+}
+
+static int verify_one(const unsigned char *tree_sha1, void *data)
+{
+	return grep_index_verify(tree_sha1) ? 1 : 0;
+}
+
+static int verify(int ac, const char **av, const char *prefix)
+{
+	struct option options[] = {
+		OPT_END()
+	};
+	int i, ret = 0;
+
+	ac = parse_options(ac, av, prefix, options, grep_index_usage, 0);
+	if (!ac)
+		return for_each_index(verify_one, NULL);
+	for (i = 0; i < ac; i++) {
+		unsigned char tree_sha1[20];
+
+		get_tree(av[i], tree_sha1, NULL);
+		ret |= verify_one(tree_sha1, NULL);
+	}
+	return ret;
+}
+
+static int keep_ref_tree(const char *refname, const struct object_id *oid,
+			 int flags, void *data)
+{
+	struct tree *tree = parse_tree_indirect(oid->hash);
+
+	if (tree)
+		sha1_array_append(data, tree->object.oid.hash);
+	return 0;
+}
+
+static int expire_one(const unsigned char *tree_sha1, void *data)
+{
+	const char *path;
+
+	if (sha1_array_lookup(data, tree_sha1) >= 0)
+		return 0;
+	path = grep_index_path(tree_sha1);
+	if (verbose || show_only)
+		printf("Removing %s\n", path);
+	if (!show_only && unlink(path)) {
+		error(_("unable to remove %s: %s"), path, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int expire(int ac, const char **av, const char *prefix)
+{
+	struct option options[] = {
+		OPT__DRY_RUN(&show_only, N_("do not remove, show only")),
+		OPT__VERBOSE(&verbose, N_("report removed indexes")),
+		OPT_END()
+	};
+	struct sha1_array keep = SHA1_ARRAY_INIT;
+	int i, ret;
+
+	ac = parse_options(ac, av, prefix, options, grep_index_usage, 0);
+	if (!ac) {
+		head_ref(keep_ref_tree, &keep);
+		for_each_ref(keep_ref_tree, &keep);
+	}
+	for (i = 0; i < ac; i++) {
+		unsigned char tree_sha1[20];
+
+		get_tree(av[i], tree_sha1, NULL);
+		sha1_array_append(&keep, tree_sha1);
+	}
+	ret = for_each_index(expire_one, &keep);
+	sha1_array_clear(&keep);
+	return ret;
+}
+
+int cmd_grep_index(int ac, const char **av, const char *prefix)
+{
+	struct option options[] = {
+		OPT_END()
+	};
+
+	if (ac < 2)
+		usage_with_options(grep_index_usage, options);
+	if (!strcmp(av[1], "build"))
+		return build(ac - 1, av + 1, prefix);
+	if (!strcmp(av[1], "verify"))
+		return verify(ac - 1, av + 1, prefix);
+	if (!strcmp(av[1], "expire"))
+		return expire(ac - 1, av + 1, prefix);
+	usage_with_options(grep_index_usage, options);
+}
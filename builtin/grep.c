@@ -18,6 +18,7 @@
 #include "quote.h"
 #include "dir.h"
 #include "pathspec.h"
+#include "grep-index.h"
 
 static char const * const grep_usage[] = {
 	N_("git grep [<options>] [-e] <pattern> [<rev>...] [[--] <path>...]"),
@@ -27,6 +28,14 @@ static char const * const grep_usage[] = {
 #define GREP_NUM_THREADS_DEFAULT 8
 static int num_threads;
 
+/*
+ * The trigram index of the tree being searched, if any, and what the
+ * patterns require of a blob for it to possibly match.
+ */
+static int use_grep_index = 1;
+static struct grep_index *grep_index;
+static struct grep_index_query *grep_index_query;
+
 #ifndef NO_PTHREADS
 static pthread_t *threads;
 
@@ -201,6 +210,7 @@ static void start_threads(struct grep_opt *opt)
 	pthread_cond_init(&cond_write, NULL);
 	pthread_cond_init(&cond_result, NULL);
 	grep_use_locks = 1;
+	enable_obj_read_lock();
 
 	for (i = 0; i < ARRAY_SIZE(todo); i++) {
 		strbuf_init(&todo[i].out, 0);
@@ -254,6 +264,7 @@ static int wait_all(void)
 	pthread_cond_destroy(&cond_write);
 	pthread_cond_destroy(&cond_result);
 	grep_use_locks = 0;
+	disable_obj_read_lock();
 
 	return hit;
 }
@@ -278,17 +289,10 @@ static int grep_cmd_config(const char *var, const char *value, void *cb)
 			    num_threads, var);
 	}
 
-	return st;
-}
-
-static void *lock_and_read_sha1_file(const unsigned char *sha1, enum object_type *type, unsigned long *size)
-{
-	void *data;
+	if (!strcmp(var, "grep.trigramindex"))
+		use_grep_index = git_config_bool(var, value);
 
-	grep_read_lock();
-	data = read_sha1_file(sha1, type, size);
-	grep_read_unlock();
-	return data;
+	return st;
 }
 
 static int grep_sha1(struct grep_opt *opt, const unsigned char *sha1,
@@ -438,6 +442,12 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 		strbuf_add(base, entry.path, te_len);
 
 		if (S_ISREG(entry.mode)) {
+			if (grep_index &&
+			    !grep_index_may_match(grep_index, entry.sha1,
+						  grep_index_query)) {
+				strbuf_setlen(base, old_baselen);
+				continue;
+			}
 			hit |= grep_sha1(opt, entry.sha1, base->buf, tn_len,
 					 check_attr ? base->buf + tn_len : NULL);
 		}
@@ -447,7 +457,7 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 			void *data;
 			unsigned long size;
 
-			data = lock_and_read_sha1_file(entry.sha1, &type, &size);
+			data = read_sha1_file(entry.sha1, &type, &size);
 			if (!data)
 				die(_("unable to read tree (%s)"),
 				    sha1_to_hex(entry.sha1));
@@ -475,16 +485,17 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		struct tree_desc tree;
 		void *data;
 		unsigned long size;
+		unsigned char tree_sha1[20];
 		struct strbuf base;
 		int hit, len;
 
-		grep_read_lock();
 		data = read_object_with_reference(obj->oid.hash, tree_type,
-						  &size, NULL);
-		grep_read_unlock();
+						  &size, tree_sha1);
 
 		if (!data)
 			die(_("unable to read tree (%s)"), oid_to_hex(&obj->oid));
+		if (grep_index_query)
+			grep_index = grep_index_load(tree_sha1);
 
 		len = name ? strlen(name) : 0;
 		strbuf_init(&base, PATH_MAX + len + 1);
@@ -495,6 +506,8 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		init_tree_desc(&tree, data, size);
 		hit = grep_tree(opt, pathspec, &tree, &base, base.len,
 				obj->type == OBJ_COMMIT);
+		grep_index_free(grep_index);
+		grep_index = NULL;
 		strbuf_release(&base);
 		free(data);
 		return hit;
@@ -915,7 +928,10 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	} else {
 		if (cached)
 			die(_("both --cached and trees are given."));
+		if (use_grep_index)
+			grep_index_query = grep_index_query_compile(&opt);
 		hit = grep_objects(&opt, &pathspec, &list);
+		grep_index_query_free(grep_index_query);
 	}
 
 	if (num_threads)
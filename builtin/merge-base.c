@@ -5,6 +5,7 @@
 #include "diff.h"
 #include "revision.h"
 #include "parse-options.h"
+#include "string-list.h"
 
 static int show_merge_base(struct commit **rev, int rev_nr, int show_all)
 {
@@ -31,6 +32,7 @@ static const char * const merge_base_usage[] = {
 	N_("git merge-base --independent <commit>..."),
 	N_("git merge-base --is-ancestor <commit> <commit>"),
 	N_("git merge-base --fork-point <ref> [<commit>]"),
+	N_("git merge-base [-a | --all] --stdin"),
 	NULL
 };
 
@@ -106,6 +108,67 @@ static int handle_is_ancestor(int argc, const char **argv)
 		return 1;
 }
 
+static void print_merge_base_line(const struct commit_list *bases, int show_all)
+{
+	const char *sep = "";
+
+	for (; bases; bases = bases->next) {
+		printf("%s%s", sep, oid_to_hex(&bases->item->object.oid));
+		if (!show_all)
+			break;
+		sep = " ";
+	}
+	putchar('\n');
+}
+
+/*
+ * Read "<commit> <commit>..." lines from the standard input and answer
+ * each with one line listing their merge base(s), or an empty line if
+ * there is none.  All lines are answered by the same process, so the
+ * commits parsed for one line are reused by the next, and pairs seen
+ * before are answered from memory.
+ */
+static int handle_stdin(int show_all)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list args = STRING_LIST_INIT_NODUP;
+	struct merge_base_memo memo;
+
+	init_merge_base_memo(&memo);
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		struct commit **rev;
+		int i;
+
+		string_list_split_in_place(&args, buf.buf, ' ', -1);
+		string_list_remove_empty_items(&args, 0);
+		if (args.nr < 2)
+			die("need at least two commits per line: '%s'", buf.buf);
+
+		ALLOC_ARRAY(rev, args.nr);
+		for (i = 0; i < args.nr; i++)
+			rev[i] = get_commit_reference(args.items[i].string);
+
+		if (args.nr == 2) {
+			print_merge_base_line(get_merge_bases_memo(&memo, rev[0], rev[1]),
+					      show_all);
+		} else {
+			struct commit_list *result;
+
+			result = get_merge_bases_many(rev[0], args.nr - 1, rev + 1);
+			print_merge_base_line(result, show_all);
+			free_commit_list(result);
+		}
+		fflush(stdout);
+
+		free(rev);
+		string_list_clear(&args, 0);
+	}
+
+	clear_merge_base_memo(&memo);
+	strbuf_release(&buf);
+	return 0;
+}
+
 struct rev_collect {
 	struct commit **commit;
 	int nr;
@@ -209,6 +272,7 @@ int cmd_merge_base(int argc, const char **argv, const char *prefix)
 	int rev_nr = 0;
 	int show_all = 0;
 	int cmdmode = 0;
+	int from_stdin = 0;
 
 	struct option options[] = {
 		OPT_BOOL('a', "all", &show_all, N_("output all common ancestors")),
@@ -220,12 +284,22 @@ int cmd_merge_base(int argc, const char **argv, const char *prefix)
 			    N_("is the first one ancestor of the other?"), 'a'),
 		OPT_CMDMODE(0, "fork-point", &cmdmode,
 			    N_("find where <commit> forked from reflog of <ref>"), 'f'),
+		OPT_BOOL(0, "stdin", &from_stdin,
+			 N_("read pairs of commits from the standard input")),
 		OPT_END()
 	};
 
 	git_config(git_default_config, NULL);
 	argc = parse_options(argc, argv, prefix, options, merge_base_usage, 0);
 
+	if (from_stdin) {
+		if (cmdmode)
+			die("--stdin cannot be used with other modes");
+		if (argc)
+			usage_with_options(merge_base_usage, options);
+		return handle_stdin(show_all);
+	}
+
 	if (cmdmode == 'a') {
 		if (argc < 2)
 			usage_with_options(merge_base_usage, options);
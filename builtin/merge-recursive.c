@@ -1,7 +1,7 @@
 #include "builtin.h"
 #include "commit.h"
 #include "tag.h"
-#include "merge-recursive.h"
+#include "merge-ort.h"
 #include "xdiff-interface.h"
 
 static const char builtin_merge_recursive_usage[] =
@@ -27,10 +27,13 @@ int cmd_merge_recursive(int argc, const char **argv, const char *prefix)
 	unsigned char h1[20], h2[20];
 	struct merge_options o;
 	struct commit *result;
+	int ort = 0;
 
 	init_merge_options(&o);
 	if (argv[0] && ends_with(argv[0], "-subtree"))
 		o.subtree_shift = "";
+	if (argv[0] && ends_with(argv[0], "-ort"))
+		ort = 1;
 
 	if (argc < 4)
 		usagef(builtin_merge_recursive_usage, argv[0]);
@@ -73,7 +76,10 @@ int cmd_merge_recursive(int argc, const char **argv, const char *prefix)
 	if (o.verbosity >= 3)
 		printf("Merging %s with %s\n", o.branch1, o.branch2);
 
-	failed = merge_recursive_generic(&o, h1, h2, bases_count, bases, &result);
+	if (ort)
+		failed = merge_ort_generic(&o, h1, h2, bases_count, bases);
+	else
+		failed = merge_recursive_generic(&o, h1, h2, bases_count, bases, &result);
 	if (failed < 0)
 		return 128; /* die() error code */
 	return failed;
@@ -4,8 +4,18 @@
 #include "blob.h"
 #include "exec_cmd.h"
 #include "merge-blobs.h"
+#include "merge-ort.h"
+#include "parse-options.h"
+#include "quote.h"
+
+static const char * const merge_tree_usage[] = {
+	N_("git merge-tree <base-tree> <branch1> <branch2>"),
+	N_("git merge-tree --write-tree [--messages] [-z] <branch1> <branch2>"),
+	N_("git merge-tree --write-tree [-z] --stdin"),
+	NULL
+};
 
-static const char merge_tree_usage[] = "git merge-tree <base-tree> <branch1> <branch2>";
+static int line_termination = '\n';
 
 struct merge_list {
 	struct merge_list *next;
@@ -25,7 +35,7 @@ static void add_merge_entry(struct merge_list *entry)
 	merge_result_end = &entry->next;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base);
+static void trivial_merge_trees(struct tree_desc t[3], const char *base);
 
 static const char *explanation(struct merge_list *entry)
 {
@@ -219,7 +229,7 @@ static void unresolved_directory(const struct traverse_info *info,
 	buf2 = fill_tree_descriptor(t+2, ENTRY_SHA1(n + 2));
 #undef ENTRY_SHA1
 
-	merge_trees(t, newbase);
+	trivial_merge_trees(t, newbase);
 
 	free(buf0);
 	free(buf1);
@@ -336,7 +346,7 @@ static int threeway_callback(int n, unsigned long mask, unsigned long dirmask, s
 	return mask;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base)
+static void trivial_merge_trees(struct tree_desc t[3], const char *base)
 {
 	struct traverse_info info;
 
@@ -358,18 +368,151 @@ static void *get_tree_descriptor(struct tree_desc *desc, const char *rev)
 	return buf;
 }
 
+static struct commit *get_commit(const char *rev)
+{
+	struct commit *commit = lookup_commit_reference_by_name(rev);
+
+	if (!commit)
+		die(_("not a valid commit: %s"), rev);
+	return commit;
+}
+
+/*
+ * Merge the two commits with all the bells and whistles of "git merge",
+ * write the result to the object database and report it: the tree,
+ * then the stages of each conflicted path (and where its contents were
+ * moved to if a directory was in the way), then (optionally) the
+ * messages "git merge" would have shown.
+ */
+static int real_merge(const char *branch1, struct commit *h1,
+		      const char *branch2, struct commit *h2,
+		      int show_messages, int show_status)
+{
+	struct merge_options o;
+	struct merge_result result = MERGE_RESULT_INIT;
+	int i, clean;
+
+	init_merge_options(&o);
+	o.branch1 = branch1;
+	o.branch2 = branch2;
+	o.buffer_output = 2;
+
+	clean = merge_ort_recursive(&o, h1, h2, NULL, &result);
+
+	if (show_status)
+		printf("%d%c", clean, line_termination);
+	printf("%s%c", oid_to_hex(&result.tree->object.oid), line_termination);
+	for (i = 0; i < result.conflicts.nr; i++) {
+		const char *path = result.conflicts.items[i].string;
+		struct merge_conflict *c = result.conflicts.items[i].util;
+		int stage;
+
+		for (stage = 1; stage < 4; stage++) {
+			if (!c->stages[stage].mode)
+				continue;
+			printf("%06o %s %d\t", c->stages[stage].mode,
+			       sha1_to_hex(c->stages[stage].sha1), stage);
+			write_name_quoted(path, stdout, line_termination);
+		}
+		if (c->moved_to) {
+			fputs("moved\t", stdout);
+			write_name_quoted(c->moved_to, stdout, line_termination);
+		}
+	}
+	if (show_messages) {
+		putchar(line_termination);
+		fputs(o.obuf.buf, stdout);
+	}
+
+	strbuf_release(&o.obuf);
+	merge_result_release(&result);
+	return clean;
+}
+
+/*
+ * Read "<branch1> <branch2>" lines and merge each pair; the output of
+ * each merge starts with 1 if it was clean and 0 if not, and ends with
+ * an empty record.  A line that cannot be merged gets "error" and a
+ * message instead, and does not stop the following ones.
+ */
+static int merge_stdin(void)
+{
+	struct strbuf line = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	int ret = 0;
+
+	while (strbuf_getline_lf(&line, stdin) != EOF) {
+		struct string_list args = STRING_LIST_INIT_DUP;
+		struct commit *h[2];
+		int i;
+
+		strbuf_reset(&err);
+		if (string_list_split(&args, line.buf, ' ', -1) != 2)
+			strbuf_addf(&err, _("malformed input line: '%s'"),
+				    line.buf);
+		for (i = 0; !err.len && i < 2; i++) {
+			h[i] = lookup_commit_reference_by_name(args.items[i].string);
+			if (!h[i])
+				strbuf_addf(&err, _("not a valid commit: %s"),
+					    args.items[i].string);
+		}
+
+		if (err.len) {
+			printf("error%c%s%c", line_termination, err.buf,
+			       line_termination);
+			ret = 1;
+		} else
+			real_merge(args.items[0].string, h[0],
+				   args.items[1].string, h[1], 0, 1);
+		putchar(line_termination);
+		fflush(stdout);
+		string_list_clear(&args, 0);
+	}
+	strbuf_release(&err);
+	strbuf_release(&line);
+	return ret;
+}
+
 int cmd_merge_tree(int argc, const char **argv, const char *prefix)
 {
 	struct tree_desc t[3];
 	void *buf1, *buf2, *buf3;
+	int write_tree = 0, show_messages = 0, use_stdin = 0;
+	struct option mt_options[] = {
+		OPT_BOOL(0, "write-tree", &write_tree,
+			 N_("do a real merge and write the resulting tree")),
+		OPT_BOOL(0, "messages", &show_messages,
+			 N_("also show the messages of the merge")),
+		OPT_BOOL(0, "stdin", &use_stdin,
+			 N_("read the branches to merge from standard input")),
+		OPT_SET_INT('z', NULL, &line_termination,
+			    N_("separate output records with NUL"), '\0'),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, mt_options,
+			     merge_tree_usage, 0);
+
+	if (write_tree) {
+		if (use_stdin) {
+			if (argc || show_messages)
+				usage_with_options(merge_tree_usage, mt_options);
+			return merge_stdin();
+		}
+		if (argc != 2)
+			usage_with_options(merge_tree_usage, mt_options);
+		return !real_merge(argv[0], get_commit(argv[0]),
+				   argv[1], get_commit(argv[1]),
+				   show_messages, 0);
+	}
 
-	if (argc != 4)
-		usage(merge_tree_usage);
+	if (argc != 3 || show_messages || use_stdin || !line_termination)
+		usage_with_options(merge_tree_usage, mt_options);
 
-	buf1 = get_tree_descriptor(t+0, argv[1]);
-	buf2 = get_tree_descriptor(t+1, argv[2]);
-	buf3 = get_tree_descriptor(t+2, argv[3]);
-	merge_trees(t, "");
+	buf1 = get_tree_descriptor(t+0, argv[0]);
+	buf2 = get_tree_descriptor(t+1, argv[1]);
+	buf3 = get_tree_descriptor(t+2, argv[2]);
+	trivial_merge_trees(t, "");
 	free(buf1);
 	free(buf2);
 	free(buf3);
@@ -24,7 +24,7 @@
 #include "color.h"
 #include "rerere.h"
 #include "help.h"
-#include "merge-recursive.h"
+#include "merge-ort.h"
 #include "resolve-undo.h"
 #include "remote.h"
 #include "fmt-merge-msg.h"
@@ -75,6 +75,7 @@ static struct strategy all_strategy[] = {
 	{ "resolve",    0 },
 	{ "ours",       NO_FAST_FORWARD | NO_TRIVIAL },
 	{ "subtree",    NO_FAST_FORWARD | NO_TRIVIAL },
+	{ "ort",        NO_TRIVIAL },
 };
 
 static const char *pull_twohead, *pull_octopus;
@@ -649,7 +650,8 @@ static int try_merge_strategy(const char *strategy, struct commit_list *common,
 		return error(_("Unable to write index."));
 	rollback_lock_file(&lock);
 
-	if (!strcmp(strategy, "recursive") || !strcmp(strategy, "subtree")) {
+	if (!strcmp(strategy, "recursive") || !strcmp(strategy, "subtree") ||
+	    !strcmp(strategy, "ort")) {
 		int clean, x;
 		struct commit *result;
 		struct commit_list *reversed = NULL;
@@ -680,8 +682,20 @@ static int try_merge_strategy(const char *strategy, struct commit_list *common,
 			commit_list_insert(j->item, &reversed);
 
 		hold_locked_index(&lock, 1);
-		clean = merge_recursive(&o, head,
-				remoteheads->item, reversed, &result);
+		if (!strcmp(strategy, "ort")) {
+			struct merge_result mr = MERGE_RESULT_INIT;
+
+			clean = merge_ort_recursive(&o, head,
+					remoteheads->item, reversed, &mr);
+			if (merge_ort_checkout(&o, head->tree, &mr)) {
+				merge_result_release(&mr);
+				rollback_lock_file(&lock);
+				return 2;
+			}
+			merge_result_release(&mr);
+		} else
+			clean = merge_recursive(&o, head,
+					remoteheads->item, reversed, &result);
 		if (active_cache_changed &&
 		    write_locked_index(&the_index, &lock, COMMIT_LOCK))
 			die (_("unable to write %s"), get_index_file());
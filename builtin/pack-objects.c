@@ -2276,9 +2276,15 @@ static void read_object_list_from_stdin(void)
 
 #define OBJECT_ADDED (1u<<20)
 
+/*
+ * With core.traverseThreads, trees are read on other threads while
+ * these run, and add_object_entry() looks at the packs directly.
+ */
 static void show_commit(struct commit *commit, void *data)
 {
+	obj_read_lock();
 	add_object_entry(commit->object.oid.hash, OBJ_COMMIT, NULL, 0);
+	obj_read_unlock();
 	commit->object.flags |= OBJECT_ADDED;
 
 	if (write_bitmap_index)
@@ -2287,8 +2293,10 @@ static void show_commit(struct commit *commit, void *data)
 
 static void show_object(struct object *obj, const char *name, void *data)
 {
+	obj_read_lock();
 	add_preferred_base_object(name);
 	add_object_entry(obj->oid.hash, obj->type, name, 0);
+	obj_read_unlock();
 	obj->flags |= OBJECT_ADDED;
 }
 
@@ -2489,6 +2497,7 @@ static void get_object_list(int ac, const char **av)
 	int flags = 0;
 
 	init_revisions(&revs, NULL);
+	revs.traverse_threads = core_traverse_threads;
 	save_commit_buffer = 0;
 	setup_revisions(ac, av, &revs, NULL);
 
@@ -222,7 +222,11 @@ int cmd_read_tree(int argc, const char **argv, const char *unused_prefix)
 	if (opts.debug_unpack)
 		opts.fn = debug_merge;
 
-	cache_tree_free(&active_cache_tree);
+	/*
+	 * Keep the cache-tree of the current index: unpack_trees() uses
+	 * it to skip directories that all trees and the index agree on,
+	 * and builds a fresh one for the result.
+	 */
 	for (i = 0; i < nr_trees; i++) {
 		struct tree *tree = trees[i];
 		parse_tree(tree);
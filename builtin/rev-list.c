@@ -43,18 +43,35 @@ static const char rev_list_usage[] =
 "    --abbrev-commit\n"
 "    --left-right\n"
 "    --count\n"
+"    --disk-usage\n"
 "  special purpose:\n"
 "    --bisect\n"
 "    --bisect-vars\n"
 "    --bisect-all"
 ;
 
+static off_t total_disk_usage;
+
+static void add_disk_usage(const struct object_id *oid)
+{
+	unsigned long size;
+	struct object_info oi = {NULL};
+
+	oi.disk_sizep = &size;
+	if (sha1_object_info_extended(oid->hash, &oi, 0) < 0)
+		die("unable to get disk usage of %s", oid_to_hex(oid));
+	total_disk_usage += size;
+}
+
 static void finish_commit(struct commit *commit, void *data);
 static void show_commit(struct commit *commit, void *data)
 {
 	struct rev_list_info *info = data;
 	struct rev_info *revs = info->revs;
 
+	if (info->show_disk_usage)
+		add_disk_usage(&commit->object.oid);
+
 	if (info->flags & REV_LIST_QUIET) {
 		finish_commit(commit, data);
 		return;
@@ -190,8 +207,14 @@ static void show_object(struct object *obj, const char *name, void *cb_data)
 {
 	struct rev_list_info *info = cb_data;
 	finish_object(obj, name, cb_data);
+	if (info->show_disk_usage)
+		add_disk_usage(&obj->oid);
 	if (info->flags & REV_LIST_QUIET)
 		return;
+	if (info->revs->count) {
+		info->revs->count_right++;
+		return;
+	}
 	show_object_with_name(stdout, obj, name);
 }
 
@@ -267,6 +290,63 @@ static int show_object_fast(
 	return 1;
 }
 
+/*
+ * The bitmap walk only knows which objects are reachable; it cannot
+ * honor options that pick a subset of the commits in the range.
+ */
+static int bitmap_walk_is_exact(struct rev_info *revs)
+{
+	return !revs->prune &&
+		!revs->left_right && !revs->cherry_mark &&
+		!revs->first_parent_only &&
+		!revs->skip_count && !revs->no_walk &&
+		revs->max_age == -1 && revs->min_age == -1 &&
+		revs->min_parents == 0 && revs->max_parents == -1 &&
+		!revs->grep_filter.pattern_list && !revs->grep_filter.header_list &&
+		revs->tree_objects == revs->blob_objects;
+}
+
+static int try_bitmap_count(struct rev_info *revs)
+{
+	uint32_t commit_count = 0, tag_count = 0, tree_count = 0, blob_count = 0;
+	int max_count = revs->max_count;
+	uint32_t count;
+
+	/*
+	 * --max-count limits the number of commits, which we can apply
+	 * to the result only when nothing but commits are counted.
+	 */
+	if (max_count >= 0 && revs->tree_objects)
+		return -1;
+
+	if (prepare_bitmap_walk(revs) < 0)
+		return -1;
+
+	count_bitmap_commit_list(&commit_count,
+				 revs->tree_objects ? &tree_count : NULL,
+				 revs->blob_objects ? &blob_count : NULL,
+				 revs->tag_objects ? &tag_count : NULL);
+	count = commit_count + tree_count + blob_count + tag_count;
+	if (max_count >= 0 && count > max_count)
+		count = max_count;
+
+	printf("%d\n", count);
+	return 0;
+}
+
+static int try_bitmap_disk_usage(struct rev_info *revs)
+{
+	if (revs->max_count >= 0)
+		return -1;
+
+	if (prepare_bitmap_walk(revs) < 0)
+		return -1;
+
+	printf("%"PRIuMAX"\n",
+	       (uintmax_t)get_bitmap_disk_usage(revs->tree_objects));
+	return 0;
+}
+
 int cmd_rev_list(int argc, const char **argv, const char *prefix)
 {
 	struct rev_info revs;
@@ -280,6 +360,7 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	git_config(git_default_config, NULL);
 	init_revisions(&revs, prefix);
 	revs.abbrev = DEFAULT_ABBREV;
+	revs.traverse_threads = core_traverse_threads;
 	revs.commit_format = CMIT_FMT_UNSPECIFIED;
 	argc = setup_revisions(argc, argv, &revs, NULL);
 
@@ -317,6 +398,11 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 			bisect_show_vars = 1;
 			continue;
 		}
+		if (!strcmp(arg, "--disk-usage")) {
+			info.show_disk_usage = 1;
+			info.flags |= REV_LIST_QUIET;
+			continue;
+		}
 		if (!strcmp(arg, "--use-bitmap-index")) {
 			use_bitmap_index = 1;
 			continue;
@@ -355,15 +441,22 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	if (bisect_list)
 		revs.limited = 1;
 
-	if (use_bitmap_index && !revs.prune) {
-		if (revs.count && !revs.left_right && !revs.cherry_mark) {
-			uint32_t commit_count;
-			if (!prepare_bitmap_walk(&revs)) {
-				count_bitmap_commit_list(&commit_count, NULL, NULL, NULL);
-				printf("%d\n", commit_count);
+	if (info.show_disk_usage && (revs.count || bisect_list))
+		die(_("--disk-usage cannot be combined with --count or --bisect"));
+	if (revs.count && revs.tree_objects &&
+	    (revs.left_right || revs.cherry_mark))
+		die(_("--objects cannot be combined with --count and "
+		      "--left-right or --cherry-mark"));
+
+	if (use_bitmap_index && bitmap_walk_is_exact(&revs)) {
+		if (info.show_disk_usage) {
+			if (!try_bitmap_disk_usage(&revs))
 				return 0;
-			}
-		} else if (revs.tag_objects && revs.tree_objects && revs.blob_objects) {
+		} else if (revs.count) {
+			if (!try_bitmap_count(&revs))
+				return 0;
+		} else if (revs.tag_objects && revs.tree_objects && revs.blob_objects &&
+			   revs.max_count < 0) {
 			if (!prepare_bitmap_walk(&revs)) {
 				traverse_bitmap_commit_list(&show_object_fast);
 				return 0;
@@ -388,6 +481,9 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 
 	traverse_commit_list(&revs, show_commit, show_object, &info);
 
+	if (info.show_disk_usage)
+		printf("%"PRIuMAX"\n", (uintmax_t)total_disk_usage);
+
 	if (revs.count) {
 		if (revs.left_right && revs.cherry_mark)
 			printf("%d\t%d\t%d\n", revs.count_left, revs.count_right, revs.count_same);
@@ -42,7 +42,7 @@ static int subtree_name_cmp(const char *one, int onelen,
 	return memcmp(one, two, onelen);
 }
 
-static int subtree_pos(struct cache_tree *it, const char *path, int pathlen)
+int cache_tree_subtree_pos(struct cache_tree *it, const char *path, int pathlen)
 {
 	struct cache_tree_sub **down = it->down;
 	int lo, hi;
@@ -69,7 +69,7 @@ static struct cache_tree_sub *find_subtree(struct cache_tree *it,
 					   int create)
 {
 	struct cache_tree_sub *down;
-	int pos = subtree_pos(it, path, pathlen);
+	int pos = cache_tree_subtree_pos(it, path, pathlen);
 	if (0 <= pos)
 		return it->down[pos];
 	if (!create)
@@ -121,7 +121,7 @@ static int do_invalidate_path(struct cache_tree *it, const char *path)
 	it->entry_count = -1;
 	if (!*slash) {
 		int pos;
-		pos = subtree_pos(it, path, namelen);
+		pos = cache_tree_subtree_pos(it, path, namelen);
 		if (0 <= pos) {
 			cache_tree_free(&it->down[pos]->cache_tree);
 			free(it->down[pos]);
@@ -256,6 +256,24 @@ static int update_one(struct cache_tree *it,
 	if (0 <= it->entry_count && has_sha1_file(it->sha1))
 		return it->entry_count;
 
+	/*
+	 * A sparse directory entry for this very directory stands
+	 * for the whole tree it records; there is nothing below it
+	 * in the index to look at.
+	 */
+	if (entries && S_ISSPARSEDIR(cache[0]->ce_mode) &&
+	    ce_namelen(cache[0]) == baselen &&
+	    !memcmp(cache[0]->name, base, baselen)) {
+		for (i = 0; i < it->subtree_nr; i++) {
+			cache_tree_free(&it->down[i]->cache_tree);
+			free(it->down[i]);
+		}
+		it->subtree_nr = 0;
+		hashcpy(it->sha1, cache[0]->sha1);
+		it->entry_count = 1;
+		return 1;
+	}
+
 	/*
 	 * We first scan for subtrees and update them; we start by
 	 * marking existing subtrees -- the ones that are unmarked
@@ -96,6 +96,13 @@ struct object_id {
 #define S_IFGITLINK	0160000
 #define S_ISGITLINK(m)	(((m) & S_IFMT) == S_IFGITLINK)
 
+/*
+ * A sparse directory entry records a whole directory outside the
+ * sparse checkout as the tree object it matches; its name ends
+ * with a slash.
+ */
+#define S_ISSPARSEDIR(m)	((m) == S_IFDIR)
+
 /*
  * Some mode bits are also used internally for computations.
  *
@@ -333,7 +340,8 @@ struct index_state {
 	struct split_index *split_index;
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
-		 initialized : 1;
+		 initialized : 1,
+		 sparse_index : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	unsigned char sha1[20];
@@ -346,6 +354,11 @@ extern struct index_state the_index;
 extern void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 extern void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
 extern void free_name_hash(struct index_state *istate);
+/*
+ * (Re)build the name hashes of "istate" on "nr_threads" threads;
+ * returns the number of threads used.  For tests.
+ */
+extern int test_lazy_init_name_hash(struct index_state *istate, int nr_threads);
 
 
 #ifndef NO_THE_INDEX_COMPATIBILITY_MACROS
@@ -548,6 +561,7 @@ extern int daemonize(void);
 
 /* Initialize and use the cache information */
 struct lock_file;
+extern int verify_index_checksum; /* check the trailer when reading the index */
 extern int read_index(struct index_state *);
 extern int read_index_preload(struct index_state *, const struct pathspec *pathspec);
 extern int do_read_index(struct index_state *istate, const char *path,
@@ -679,7 +693,11 @@ extern char *git_replace_ref_base;
 
 extern int fsync_object_files;
 extern int core_preload_index;
+extern int core_traverse_threads;
+extern int core_untracked_threads;
 extern int core_apply_sparse_checkout;
+extern int core_sparse_checkout_cone;
+extern int command_requires_full_index;
 extern int precomposed_unicode;
 extern int protect_hfs;
 extern int protect_ntfs;
@@ -1031,6 +1049,28 @@ extern int is_ntfs_dotgit(const char *name);
  */
 extern char *xdg_config_home(const char *filename);
 
+/*
+ * Reading objects is not thread-safe.  A caller that wants to read
+ * objects from several threads at once calls enable_obj_read_lock()
+ * first; read_sha1_file(), sha1_object_info() and has_sha1_file()
+ * (and their variants) then serialize on a recursive lock, which code
+ * that looks at pack internals directly can take with obj_read_lock()
+ * and obj_read_unlock(), too.  The lock is dropped while an object is
+ * inflated and while deltas are applied to it, so those run in
+ * parallel.
+ */
+#ifndef NO_PTHREADS
+extern void enable_obj_read_lock(void);
+extern void disable_obj_read_lock(void);
+extern void obj_read_lock(void);
+extern void obj_read_unlock(void);
+#else
+static inline void enable_obj_read_lock(void) {}
+static inline void disable_obj_read_lock(void) {}
+static inline void obj_read_lock(void) {}
+static inline void obj_read_unlock(void) {}
+#endif
+
 /* object replacement */
 #define LOOKUP_REPLACE_OBJECT 1
 #define LOOKUP_UNKNOWN_OBJECT 2
@@ -1004,6 +1004,71 @@ struct commit_list *get_merge_bases(struct commit *one, struct commit *two)
 	return get_merge_bases_many_0(one, 1, &two, 1);
 }
 
+struct merge_base_memo_entry {
+	struct hashmap_entry ent;
+	struct commit *one, *two;
+	struct commit_list *result;
+};
+
+static int merge_base_memo_cmp(const struct merge_base_memo_entry *a,
+			       const struct merge_base_memo_entry *b,
+			       const void *unused)
+{
+	return a->one != b->one || a->two != b->two;
+}
+
+void init_merge_base_memo(struct merge_base_memo *memo)
+{
+	hashmap_init(&memo->map, (hashmap_cmp_fn) merge_base_memo_cmp, 0);
+}
+
+void clear_merge_base_memo(struct merge_base_memo *memo)
+{
+	struct hashmap_iter iter;
+	struct merge_base_memo_entry *e;
+
+	hashmap_iter_init(&memo->map, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free_commit_list(e->result);
+	hashmap_free(&memo->map, 1);
+}
+
+/*
+ * Like get_merge_bases(), but remember the answer in "memo", so that
+ * asking again for the same pair costs a hash lookup instead of another
+ * walk.  Commits parsed for one pair stay parsed for the next; the flags
+ * painted by a walk are cleared before returning, as the painted state
+ * of one pair is not valid for another.
+ *
+ * The pair is remembered in the order given: when merge bases have the
+ * same date, their order depends on which side was painted first, so
+ * (one, two) and (two, one) are separate entries.
+ *
+ * The returned list is owned by the memo and must not be freed.
+ */
+const struct commit_list *get_merge_bases_memo(struct merge_base_memo *memo,
+					       struct commit *one,
+					       struct commit *two)
+{
+	struct merge_base_memo_entry key, *e;
+
+	hashmap_entry_init(&key, sha1hash(one->object.oid.hash) ^
+			   sha1hash(two->object.oid.hash));
+	key.one = one;
+	key.two = two;
+	e = hashmap_get(&memo->map, &key, NULL);
+	if (e)
+		return e->result;
+
+	e = xmalloc(sizeof(*e));
+	hashmap_entry_init(e, key.ent.hash);
+	e->one = one;
+	e->two = two;
+	e->result = get_merge_bases(one, two);
+	hashmap_add(&memo->map, e);
+	return e->result;
+}
+
 /*
  * Is "commit" a descendant of one of the elements on the "with_commit" list?
  */
@@ -1022,6 +1087,177 @@ int is_descendant_of(struct commit *commit, struct commit_list *with_commit)
 	return 0;
 }
 
+/*
+ * Memoized containment: for every commit we have looked at, remember
+ * whether it can reach one of the "want" commits, so that asking the
+ * same question for many candidates walks each commit at most once.
+ */
+enum contains_result {
+	CONTAINS_UNKNOWN = 0,
+	CONTAINS_NO,
+	CONTAINS_YES
+};
+
+define_commit_slab(contains_slab, enum contains_result);
+
+struct contains_cache {
+	struct contains_slab slab;
+};
+
+struct contains_cache *contains_cache_alloc(void)
+{
+	struct contains_cache *cache = xmalloc(sizeof(*cache));
+	init_contains_slab(&cache->slab);
+	return cache;
+}
+
+void contains_cache_free(struct contains_cache *cache)
+{
+	if (!cache)
+		return;
+	clear_contains_slab(&cache->slab);
+	free(cache);
+}
+
+static int in_commit_list(const struct commit_list *want, struct commit *c)
+{
+	for (; want; want = want->next)
+		if (!oidcmp(&want->item->object.oid, &c->object.oid))
+			return 1;
+	return 0;
+}
+
+/*
+ * Test whether the candidate is, or was previously found to contain,
+ * one of the "want" commits.  Do not recurse to find out, though, but
+ * return CONTAINS_UNKNOWN if inconclusive.
+ */
+static enum contains_result contains_test(struct commit *candidate,
+					  const struct commit_list *want,
+					  struct contains_cache *cache)
+{
+	enum contains_result *cached = contains_slab_at(&cache->slab, candidate);
+
+	if (*cached)
+		return *cached;
+
+	if (in_commit_list(want, candidate)) {
+		*cached = CONTAINS_YES;
+		return CONTAINS_YES;
+	}
+
+	if (parse_commit(candidate) < 0) {
+		*cached = CONTAINS_NO;
+		return CONTAINS_NO;
+	}
+
+	return CONTAINS_UNKNOWN;
+}
+
+/*
+ * Mimicking the real stack, this stack lives on the heap, avoiding stack
+ * overflows.
+ *
+ * At each recursion step, the stack items points to the commits whose
+ * ancestors are to be inspected.
+ */
+struct contains_stack {
+	int nr, alloc;
+	struct contains_stack_entry {
+		struct commit *commit;
+		struct commit_list *parents;
+	} *contains_stack;
+};
+
+static void push_to_contains_stack(struct commit *candidate, struct contains_stack *contains_stack)
+{
+	ALLOC_GROW(contains_stack->contains_stack, contains_stack->nr + 1, contains_stack->alloc);
+	contains_stack->contains_stack[contains_stack->nr].commit = candidate;
+	contains_stack->contains_stack[contains_stack->nr++].parents = candidate->parents;
+}
+
+static enum contains_result contains_walk(struct commit *candidate,
+					  const struct commit_list *want,
+					  struct contains_cache *cache,
+					  struct contains_stack *contains_stack)
+{
+	enum contains_result result = contains_test(candidate, want, cache);
+
+	if (result != CONTAINS_UNKNOWN)
+		return result;
+
+	push_to_contains_stack(candidate, contains_stack);
+	while (contains_stack->nr) {
+		struct contains_stack_entry *entry = &contains_stack->contains_stack[contains_stack->nr - 1];
+		struct commit *commit = entry->commit;
+		struct commit_list *parents = entry->parents;
+
+		if (!parents) {
+			*contains_slab_at(&cache->slab, commit) = CONTAINS_NO;
+			contains_stack->nr--;
+		}
+		/*
+		 * If we just popped the stack, parents->item has been marked,
+		 * therefore contains_test will return a meaningful yes/no.
+		 */
+		else switch (contains_test(parents->item, want, cache)) {
+		case CONTAINS_YES:
+			*contains_slab_at(&cache->slab, commit) = CONTAINS_YES;
+			contains_stack->nr--;
+			break;
+		case CONTAINS_NO:
+			entry->parents = parents->next;
+			break;
+		case CONTAINS_UNKNOWN:
+			push_to_contains_stack(parents->item, contains_stack);
+			break;
+		}
+	}
+	return contains_test(candidate, want, cache);
+}
+
+/*
+ * Does "commit" contain (i.e. can it reach) one of the commits on the
+ * "want" list?  Results are memoized in "cache", which must only ever
+ * be used with the same "want" list.
+ */
+int commit_contains(struct commit *commit, const struct commit_list *want,
+		    struct contains_cache *cache)
+{
+	struct contains_stack contains_stack = { 0, 0, NULL };
+	enum contains_result result;
+
+	result = contains_walk(commit, want, cache, &contains_stack);
+	free(contains_stack.contains_stack);
+	return result == CONTAINS_YES;
+}
+
+/*
+ * Batched version of commit_contains(): set result[i] to 1 if tips[i]
+ * contains one of the "want" commits and to 0 otherwise.  All tips
+ * share one memoized walk, so the whole batch visits each commit in
+ * the union of their histories at most once.  "cache" may be NULL.
+ */
+void commit_contains_many(struct commit **tips, int nr,
+			  const struct commit_list *want,
+			  struct contains_cache *cache,
+			  unsigned char *result)
+{
+	struct contains_stack contains_stack = { 0, 0, NULL };
+	struct contains_cache *own = NULL;
+	int i;
+
+	if (!cache)
+		cache = own = contains_cache_alloc();
+
+	for (i = 0; i < nr; i++)
+		result[i] = !want ||
+			contains_walk(tips[i], want, cache, &contains_stack) == CONTAINS_YES;
+
+	free(contains_stack.contains_stack);
+	contains_cache_free(own);
+}
+
 /*
  * Is "commit" an ancestor of one of the "references"?
  */
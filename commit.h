@@ -248,6 +248,19 @@ extern struct commit_list *get_octopus_merge_bases(struct commit_list *in);
 /* To be used only when object flags after this call no longer matter */
 extern struct commit_list *get_merge_bases_many_dirty(struct commit *one, int n, struct commit **twos);
 
+/*
+ * Memoized merge bases of many pairs of commits, for callers that ask
+ * about lots of pairs in one process; see get_merge_bases_memo().
+ */
+struct merge_base_memo {
+	struct hashmap map;
+};
+extern void init_merge_base_memo(struct merge_base_memo *);
+extern void clear_merge_base_memo(struct merge_base_memo *);
+extern const struct commit_list *get_merge_bases_memo(struct merge_base_memo *,
+						      struct commit *one,
+						      struct commit *two);
+
 /* largest positive number a signed 32-bit integer can contain */
 #define INFINITE_DEPTH 0x7fffffff
 
@@ -294,6 +307,20 @@ extern void prune_shallow(int show_only);
 extern struct trace_key trace_shallow;
 
 int is_descendant_of(struct commit *, struct commit_list *);
+
+/*
+ * Memoized "does this commit reach one of the wanted commits?" queries;
+ * see commit_contains() and commit_contains_many() in commit.c.
+ */
+struct contains_cache;
+extern struct contains_cache *contains_cache_alloc(void);
+extern void contains_cache_free(struct contains_cache *);
+extern int commit_contains(struct commit *, const struct commit_list *want,
+			   struct contains_cache *);
+extern void commit_contains_many(struct commit **tips, int nr,
+				 const struct commit_list *want,
+				 struct contains_cache *,
+				 unsigned char *result);
 int in_merge_bases(struct commit *, struct commit *);
 int in_merge_bases_many(struct commit *, int, struct commit **);
 
@@ -0,0 +1,200 @@
+/*
+ * lstat() many paths at once through io_uring, so that a cold or
+ * network file system sees hundreds of requests in flight instead of
+ * one per thread.  This talks to the kernel directly; it needs Linux
+ * 5.6 or later for IORING_OP_STATX, and uring_lstat_init() returns
+ * NULL when that is not available so that the caller can fall back
+ * to plain lstat().
+ */
+#include "../../git-compat-util.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+
+struct uring_lstat {
+	int fd;
+	unsigned depth;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_size = stx->stx_size;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+void uring_lstat_release(struct uring_lstat *u)
+{
+	if (!u)
+		return;
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring)
+		munmap(u->sq_ring, u->sq_ring_size);
+	close(u->fd);
+	free(u);
+}
+
+static void *map_ring(int fd, size_t size, off_t offset)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, offset);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+struct uring_lstat *uring_lstat_init(unsigned depth)
+{
+	struct io_uring_params p;
+	struct uring_lstat *u;
+	struct stat st;
+	const char *probe = ".";
+	int err;
+
+	memset(&p, 0, sizeof(p));
+	u = xcalloc(1, sizeof(*u));
+	u->fd = io_uring_setup(depth, &p);
+	if (u->fd < 0) {
+		free(u);
+		return NULL;
+	}
+	u->depth = p.sq_entries;
+
+	u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring = map_ring(u->fd, u->sq_ring_size, IORING_OFF_SQ_RING);
+	if (!u->sq_ring)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else if (!(u->cq_ring = map_ring(u->fd, u->cq_ring_size,
+					 IORING_OFF_CQ_RING)))
+		goto fail;
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = map_ring(u->fd, u->sqes_size, IORING_OFF_SQES);
+	if (!u->sqes)
+		goto fail;
+
+	u->sq_tail = (unsigned *)((char *)u->sq_ring + p.sq_off.tail);
+	u->sq_mask = (unsigned *)((char *)u->sq_ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)((char *)u->sq_ring + p.sq_off.array);
+	u->cq_head = (unsigned *)((char *)u->cq_ring + p.cq_off.head);
+	u->cq_tail = (unsigned *)((char *)u->cq_ring + p.cq_off.tail);
+	u->cq_mask = (unsigned *)((char *)u->cq_ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p.cq_off.cqes);
+
+	/* Kernels before 5.6 have io_uring, but cannot statx() with it */
+	if (uring_lstat(u, 1, &probe, &st, &err) || err == EINVAL)
+		goto fail;
+	return u;
+
+fail:
+	uring_lstat_release(u);
+	return NULL;
+}
+
+int uring_lstat(struct uring_lstat *u, int nr, const char **path,
+		struct stat *st, int *err)
+{
+	struct statx *stx;
+	int submitted = 0, completed = 0, inflight = 0;
+	unsigned to_submit = 0;
+
+	ALLOC_ARRAY(stx, nr);
+	while (completed < nr) {
+		unsigned tail = *u->sq_tail;
+		unsigned head;
+		int ret;
+
+		while (submitted < nr && inflight < u->depth) {
+			unsigned idx = tail & *u->sq_mask;
+			struct io_uring_sqe *sqe = &u->sqes[idx];
+
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uintptr_t)path[submitted];
+			sqe->len = STATX_BASIC_STATS;
+			sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+			sqe->off = (uintptr_t)&stx[submitted];
+			sqe->user_data = submitted;
+			u->sq_array[idx] = idx;
+			tail++;
+			submitted++;
+			inflight++;
+			to_submit++;
+		}
+		__atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+		ret = io_uring_enter(u->fd, to_submit, 1);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			/*
+			 * The kernel may still write to "stx" for requests
+			 * it has taken; only back out if there are none.
+			 */
+			if (to_submit != inflight)
+				die_errno("io_uring_enter");
+			free(stx);
+			return -1;
+		}
+		to_submit -= ret;
+
+		head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			int i = cqe->user_data;
+
+			if (cqe->res < 0)
+				err[i] = -cqe->res;
+			else {
+				err[i] = 0;
+				statx_to_stat(&stx[i], &st[i]);
+			}
+			head++;
+			completed++;
+			inflight--;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+	free(stx);
+	return 0;
+}
@@ -13,6 +13,7 @@
 #include "hashmap.h"
 #include "string-list.h"
 #include "utf8.h"
+#include "thread-utils.h"
 
 struct config_source {
 	struct config_source *prev;
@@ -882,6 +883,26 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.traversethreads")) {
+		core_traverse_threads = git_config_int(var, value);
+		if (core_traverse_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    core_traverse_threads, var);
+		if (!core_traverse_threads)
+			core_traverse_threads = online_cpus();
+		return 0;
+	}
+
+	if (!strcmp(var, "core.untrackedthreads")) {
+		core_untracked_threads = git_config_int(var, value);
+		if (core_untracked_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    core_untracked_threads, var);
+		if (!core_untracked_threads)
+			core_untracked_threads = online_cpus();
+		return 0;
+	}
+
 	if (!strcmp(var, "core.createobject")) {
 		if (!strcmp(value, "rename"))
 			object_creation_mode = OBJECT_CREATION_USES_RENAMES;
@@ -897,6 +918,11 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.sparsecheckoutcone")) {
+		core_sparse_checkout_cone = git_config_bool(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.precomposeunicode")) {
 		precomposed_unicode = git_config_bool(var, value);
 		return 0;
@@ -12,6 +12,7 @@
 #include "refs.h"
 #include "submodule.h"
 #include "dir.h"
+#include "sparse-index.h"
 
 /*
  * diff-files
@@ -471,6 +472,9 @@ static int diff_cache(struct rev_info *revs,
 	if (!tree)
 		return error("bad tree object %s",
 			     tree_name ? tree_name : sha1_to_hex(tree_sha1));
+	/* unchanged paths can be the source of a copy, too */
+	if (DIFF_OPT_TST(&revs->diffopt, FIND_COPIES_HARDER))
+		ensure_full_index(&the_index);
 	memset(&opts, 0, sizeof(opts));
 	opts.head_idx = 1;
 	opts.index_only = cached;
@@ -2531,11 +2531,29 @@ static void builtin_diffstat(const char *name_a, const char *name_b,
 		memset(&xpp, 0, sizeof(xpp));
 		memset(&xecfg, 0, sizeof(xecfg));
 		xpp.flags = o->xdl_opts;
-		xecfg.ctxlen = o->context;
-		xecfg.interhunkctxlen = o->interhunkcontext;
-		if (xdi_diff_outf(&mf1, &mf2, diffstat_consume, diffstat,
-				  &xpp, &xecfg))
-			die("unable to generate diffstat for %s", one->path);
+
+		/*
+		 * Whether a blank line change is ignored depends on
+		 * the hunk it ends up in, so only then do we need to
+		 * generate the hunks; otherwise counting the changed
+		 * lines is enough.
+		 */
+		if (!(xpp.flags & XDF_IGNORE_BLANK_LINES)) {
+			long removed, added;
+
+			if (xdi_diff_count(&mf1, &mf2, &xpp, &removed, &added))
+				die("unable to generate diffstat for %s",
+				    one->path);
+			data->deleted = removed;
+			data->added = added;
+		} else {
+			xecfg.ctxlen = o->context;
+			xecfg.interhunkctxlen = o->interhunkcontext;
+			if (xdi_diff_outf(&mf1, &mf2, diffstat_consume, diffstat,
+					  &xpp, &xecfg))
+				die("unable to generate diffstat for %s",
+				    one->path);
+		}
 	}
 
 	diff_free_filespec_data(one);
@@ -36,6 +36,17 @@
  */
 #define HASHBASE 107927
 
+/*
+ * Besides the counts, we keep a small "bottom-k" sketch of the set of
+ * chunk hashes: the SKETCH_SIZE smallest of them after scrambling.
+ * Two sketches that have nothing in common within the smallest
+ * SKETCH_SIZE values of their union tell us that the two files are
+ * very unlikely to share any content, without walking the full
+ * tables.  When both files have fewer distinct chunks than that, the
+ * sketches hold the whole sets and the answer is exact.
+ */
+#define SKETCH_SIZE 64
+
 struct spanhash {
 	unsigned int hashval;
 	unsigned int cnt;
@@ -43,6 +54,8 @@ struct spanhash {
 struct spanhash_top {
 	int alloc_log2;
 	int free;
+	int sketch_nr;
+	unsigned int sketch[SKETCH_SIZE];
 	struct spanhash data[FLEX_ARRAY];
 };
 
@@ -121,6 +134,30 @@ static int spanhash_cmp(const void *a_, const void *b_)
 		a->hashval > b->hashval ? 1 : 0;
 }
 
+static inline unsigned int sketch_scramble(unsigned int hashval)
+{
+	/* hashval is below HASHBASE; spread it over the whole range */
+	return hashval * 2654435761u;
+}
+
+static void sketch_add(struct spanhash_top *top, unsigned int val)
+{
+	int i = top->sketch_nr;
+
+	if (i == SKETCH_SIZE) {
+		if (top->sketch[SKETCH_SIZE - 1] <= val)
+			return;
+		i--;
+	} else
+		top->sketch_nr++;
+	/* keep the sketch sorted in ascending order */
+	while (i && val < top->sketch[i - 1]) {
+		top->sketch[i] = top->sketch[i - 1];
+		i--;
+	}
+	top->sketch[i] = val;
+}
+
 static struct spanhash_top *hash_chars(struct diff_filespec *one)
 {
 	int i, n;
@@ -162,9 +199,63 @@ static struct spanhash_top *hash_chars(struct diff_filespec *one)
 		1ul << hash->alloc_log2,
 		sizeof(hash->data[0]),
 		spanhash_cmp);
+
+	hash->sketch_nr = 0;
+	for (i = 0; i < (1 << hash->alloc_log2) && hash->data[i].cnt; i++)
+		sketch_add(hash, sketch_scramble(hash->data[i].hashval));
 	return hash;
 }
 
+static struct spanhash_top *get_count(struct diff_filespec *one,
+				      void **count_p)
+{
+	struct spanhash_top *count = NULL;
+
+	if (count_p)
+		count = *count_p;
+	if (!count) {
+		count = hash_chars(one);
+		if (count_p)
+			*count_p = count;
+	}
+	return count;
+}
+
+int diffcore_may_share_content(struct diff_filespec *src,
+			       struct diff_filespec *dst,
+			       void **src_count_p,
+			       void **dst_count_p)
+{
+	struct spanhash_top *src_count, *dst_count;
+	int i = 0, j = 0, seen = 0, shared = 0;
+
+	src_count = get_count(src, src_count_p);
+	dst_count = get_count(dst, dst_count_p);
+
+	/* Walk the smallest SKETCH_SIZE values of the union */
+	while (seen < SKETCH_SIZE &&
+	       i < src_count->sketch_nr && j < dst_count->sketch_nr) {
+		unsigned int s = src_count->sketch[i];
+		unsigned int d = dst_count->sketch[j];
+
+		if (s == d) {
+			shared++;
+			break;
+		}
+		if (s < d)
+			i++;
+		else
+			j++;
+		seen++;
+	}
+
+	if (!src_count_p)
+		free(src_count);
+	if (!dst_count_p)
+		free(dst_count);
+	return shared;
+}
+
 int diffcore_count_changes(struct diff_filespec *src,
 			   struct diff_filespec *dst,
 			   void **src_count_p,
@@ -177,21 +268,8 @@ int diffcore_count_changes(struct diff_filespec *src,
 	struct spanhash_top *src_count, *dst_count;
 	unsigned long sc, la;
 
-	src_count = dst_count = NULL;
-	if (src_count_p)
-		src_count = *src_count_p;
-	if (!src_count) {
-		src_count = hash_chars(src);
-		if (src_count_p)
-			*src_count_p = src_count;
-	}
-	if (dst_count_p)
-		dst_count = *dst_count_p;
-	if (!dst_count) {
-		dst_count = hash_chars(dst);
-		if (dst_count_p)
-			*dst_count_p = dst_count;
-	}
+	src_count = get_count(src, src_count_p);
+	dst_count = get_count(dst, dst_count_p);
 	sc = la = 0;
 
 	s = src_count->data;
@@ -6,6 +6,7 @@
 #include "diffcore.h"
 #include "hashmap.h"
 #include "progress.h"
+#include "notes-cache.h"
 
 /* Table of rename/copy destinations */
 
@@ -72,26 +73,34 @@ static struct diff_rename_src {
 } *rename_src;
 static int rename_src_nr, rename_src_alloc;
 
-static struct diff_rename_src *register_rename_src(struct diff_filepair *p)
+static int find_rename_src(const char *path)
 {
 	int first, last;
-	struct diff_filespec *one = p->one;
-	unsigned short score = p->score;
 
 	first = 0;
 	last = rename_src_nr;
 	while (last > first) {
 		int next = (last + first) >> 1;
 		struct diff_rename_src *src = &(rename_src[next]);
-		int cmp = strcmp(one->path, src->p->one->path);
+		int cmp = strcmp(path, src->p->one->path);
 		if (!cmp)
-			return src;
+			return next;
 		if (cmp < 0) {
 			last = next;
 			continue;
 		}
 		first = next+1;
 	}
+	return -first - 1;
+}
+
+static struct diff_rename_src *register_rename_src(struct diff_filepair *p)
+{
+	int first = find_rename_src(p->one->path);
+
+	if (first >= 0)
+		return &(rename_src[first]);
+	first = -first - 1;
 
 	/* insert to make it at "first" */
 	ALLOC_GROW(rename_src, rename_src_nr + 1, rename_src_alloc);
@@ -100,7 +109,7 @@ static struct diff_rename_src *register_rename_src(struct diff_filepair *p)
 		memmove(rename_src + first + 1, rename_src + first,
 			(rename_src_nr - first - 1) * sizeof(*rename_src));
 	rename_src[first].p = p;
-	rename_src[first].score = score;
+	rename_src[first].score = p->score;
 	return &(rename_src[first]);
 }
 
@@ -190,6 +199,15 @@ static int estimate_similarity(struct diff_filespec *src,
 	if (!dst->cnt_data && diff_populate_filespec(dst, 0))
 		return 0;
 
+	/*
+	 * Comparing the sketches of the two files is much cheaper
+	 * than counting the changes, and rules out most pairs that
+	 * have nothing to do with each other.
+	 */
+	if (!diffcore_may_share_content(src, dst,
+					&src->cnt_data, &dst->cnt_data))
+		return 0;
+
 	delta_limit = (unsigned long)
 		(base_size * (MAX_SCORE-minimum_score) / MAX_SCORE);
 	if (diffcore_count_changes(src, dst,
@@ -357,6 +375,96 @@ static int find_exact_renames(struct diff_options *options)
 	return renames;
 }
 
+struct basename_match {
+	struct hashmap_entry entry;
+	const char *name;
+	int src, dst; /* -1 if not seen yet, -2 if seen more than once */
+};
+
+static const char *get_basename(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+static int basename_match_cmp(const struct basename_match *a,
+			      const struct basename_match *b,
+			      const char *name)
+{
+	return strcmp(a->name, name ? name : b->name);
+}
+
+static struct basename_match *get_basename_match(struct hashmap *map,
+						 const char *path)
+{
+	const char *name = get_basename(path);
+	unsigned int hash = strhash(name);
+	struct basename_match *m = hashmap_get_from_hash(map, hash, name);
+
+	if (!m) {
+		m = xmalloc(sizeof(*m));
+		hashmap_entry_init(m, hash);
+		m->name = name;
+		m->src = m->dst = -1;
+		hashmap_add(map, m);
+	}
+	return m;
+}
+
+/*
+ * Files are often moved to another directory without being renamed.
+ * Before filling the full similarity matrix, pair up the remaining
+ * sources and destinations whose basename appears exactly once on
+ * each side, and take the pair as a rename if the two are similar
+ * enough.  We ask for a higher score than usual, since we no longer
+ * look at the other candidates.
+ */
+static int find_basename_renames(int minimum_score)
+{
+	struct hashmap names;
+	struct hashmap_iter iter;
+	struct basename_match *m;
+	int i, renames = 0;
+	int basename_score = minimum_score + (MAX_SCORE - minimum_score) / 2;
+
+	hashmap_init(&names, (hashmap_cmp_fn) basename_match_cmp, 0);
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+
+		if (one->rename_used)
+			continue;
+		m = get_basename_match(&names, one->path);
+		m->src = m->src == -1 ? i : -2;
+	}
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].pair)
+			continue;
+		m = get_basename_match(&names, rename_dst[i].two->path);
+		m->dst = m->dst == -1 ? i : -2;
+	}
+
+	hashmap_iter_init(&names, &iter);
+	while ((m = hashmap_iter_next(&iter))) {
+		struct diff_filespec *one, *two;
+		int score;
+
+		if (m->src < 0 || m->dst < 0)
+			continue;
+		one = rename_src[m->src].p->one;
+		two = rename_dst[m->dst].two;
+		score = estimate_similarity(one, two, basename_score);
+		diff_free_filespec_blob(one);
+		diff_free_filespec_blob(two);
+		if (score < basename_score)
+			continue;
+		record_rename_pair(m->dst, m->src, score);
+		renames++;
+	}
+
+	hashmap_free(&names, 1);
+	return renames;
+}
+
 #define NUM_CANDIDATE_PER_DST 4
 static void record_if_better(struct diff_score m[], struct diff_score *o)
 {
@@ -443,6 +551,161 @@ static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, i
 	return count;
 }
 
+/*
+ * With diff.renameCache, the renames found for a given set of
+ * sources and destinations are remembered in refs/notes/renames,
+ * keyed by a hash of everything that goes into finding them, so
+ * that the next merge or log over the same pair of trees does not
+ * have to fill the similarity matrix again.
+ */
+#define RENAME_CACHE_VALIDITY "rename-cache-v1"
+
+static struct notes_cache *get_rename_cache(void)
+{
+	static struct notes_cache *cache;
+	static int initialized;
+	int enabled = 0;
+
+	if (initialized)
+		return cache;
+	initialized = 1;
+	if (!startup_info->have_repository ||
+	    git_config_get_bool("diff.renamecache", &enabled) || !enabled)
+		return NULL;
+	cache = xmalloc(sizeof(*cache));
+	notes_cache_init(cache, "renames", RENAME_CACHE_VALIDITY);
+	return cache;
+}
+
+/*
+ * Returns -1 if some of the files are not known by their object
+ * name (e.g. they come from the working tree), in which case we
+ * cannot cache the result.
+ */
+static int rename_cache_key(struct diff_options *options, int minimum_score,
+			    unsigned char *key)
+{
+	git_SHA_CTX c;
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	git_SHA1_Init(&c);
+	strbuf_addf(&buf, "detect %d score %d limit %d",
+		    options->detect_rename, minimum_score,
+		    options->rename_limit);
+	git_SHA1_Update(&c, buf.buf, buf.len + 1);
+
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filepair *p = rename_src[i].p;
+
+		if (!p->one->sha1_valid)
+			goto fail;
+		strbuf_reset(&buf);
+		strbuf_addf(&buf, "src %06o %s %d %d %d %s",
+			    p->one->mode, sha1_to_hex(p->one->sha1),
+			    rename_src[i].score, p->one->rename_used,
+			    diff_unmodified_pair(p), p->one->path);
+		git_SHA1_Update(&c, buf.buf, buf.len + 1);
+	}
+	for (i = 0; i < rename_dst_nr; i++) {
+		struct diff_filespec *two = rename_dst[i].two;
+
+		if (!two->sha1_valid)
+			goto fail;
+		strbuf_reset(&buf);
+		strbuf_addf(&buf, "dst %06o %s %s",
+			    two->mode, sha1_to_hex(two->sha1), two->path);
+		git_SHA1_Update(&c, buf.buf, buf.len + 1);
+	}
+
+	git_SHA1_Final(key, &c);
+	strbuf_release(&buf);
+	return 0;
+
+fail:
+	strbuf_release(&buf);
+	return -1;
+}
+
+/*
+ * The cached value has one "<dst> <src> <score>" line per rename,
+ * giving indices into rename_dst and rename_src.
+ */
+static int parse_cached_rename(const char **bufp, const char *end,
+			       int *dst, int *src, int *score)
+{
+	const char *buf = *bufp;
+	char *ep;
+
+	*dst = strtol(buf, &ep, 10);
+	if (ep == buf || *ep != ' ' || *dst < 0 || *dst >= rename_dst_nr)
+		return -1;
+	buf = ep + 1;
+	*src = strtol(buf, &ep, 10);
+	if (ep == buf || *ep != ' ' || *src < 0 || *src >= rename_src_nr)
+		return -1;
+	buf = ep + 1;
+	*score = strtol(buf, &ep, 10);
+	if (ep == buf || ep >= end || *ep != '\n' ||
+	    *score < 0 || *score > MAX_SCORE)
+		return -1;
+	*bufp = ep + 1;
+	return 0;
+}
+
+/*
+ * Returns the number of renames recorded from the cache, or -1 if
+ * there is no usable cache entry.
+ */
+static int use_cached_renames(struct notes_cache *cache, unsigned char *key)
+{
+	char *value;
+	const char *buf, *end;
+	size_t size;
+	int dst, src, score, renames = 0;
+
+	value = notes_cache_get(cache, key, &size);
+	if (!value)
+		return -1;
+
+	/* Check the whole entry before using any of it */
+	end = value + size;
+	for (buf = value; buf < end; )
+		if (parse_cached_rename(&buf, end, &dst, &src, &score)) {
+			free(value);
+			return -1;
+		}
+
+	for (buf = value; buf < end; ) {
+		parse_cached_rename(&buf, end, &dst, &src, &score);
+		if (rename_dst[dst].pair)
+			continue;
+		record_rename_pair(dst, src, score);
+		renames++;
+	}
+	free(value);
+	return renames;
+}
+
+static void cache_renames(struct notes_cache *cache, unsigned char *key)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	for (i = 0; i < rename_dst_nr; i++) {
+		struct diff_filepair *dp = rename_dst[i].pair;
+
+		if (!dp)
+			continue;
+		strbuf_addf(&buf, "%d %d %d\n", i,
+			    find_rename_src(dp->one->path), dp->score);
+	}
+	/* ignore errors, as we might be in a readonly repository */
+	notes_cache_put(cache, key, buf.buf, buf.len);
+	notes_cache_write(cache);
+	strbuf_release(&buf);
+}
+
 void diffcore_rename(struct diff_options *options)
 {
 	int detect_rename = options->detect_rename;
@@ -453,6 +716,8 @@ void diffcore_rename(struct diff_options *options)
 	int i, j, rename_count, skip_unmodified = 0;
 	int num_create, dst_cnt;
 	struct progress *progress = NULL;
+	struct notes_cache *cache;
+	unsigned char cache_key[20];
 
 	if (!minimum_score)
 		minimum_score = DEFAULT_RENAME_SCORE;
@@ -502,6 +767,14 @@ void diffcore_rename(struct diff_options *options)
 	if (rename_dst_nr == 0 || rename_src_nr == 0)
 		goto cleanup; /* nothing to do */
 
+	cache = get_rename_cache();
+	if (cache && minimum_score != MAX_SCORE &&
+	    !rename_cache_key(options, minimum_score, cache_key)) {
+		if (use_cached_renames(cache, cache_key) >= 0)
+			goto cleanup;
+	} else
+		cache = NULL;
+
 	/*
 	 * We really want to cull the candidates list early
 	 * with cheap tests in order to avoid doing deltas.
@@ -512,6 +785,14 @@ void diffcore_rename(struct diff_options *options)
 	if (minimum_score == MAX_SCORE)
 		goto cleanup;
 
+	/*
+	 * When looking for copies, a source may be used any number
+	 * of times, so we cannot settle on a pair without looking at
+	 * all the others.
+	 */
+	if (detect_rename != DIFF_DETECT_COPY)
+		rename_count += find_basename_renames(minimum_score);
+
 	/*
 	 * Calculate how many renames are left (but all the source
 	 * files still remain as options for rename/copies!)
@@ -528,6 +809,8 @@ void diffcore_rename(struct diff_options *options)
 	case 2:
 		options->degraded_cc_to_c = 1;
 		skip_unmodified = 1;
+		/* the warning would be lost on a cache hit */
+		cache = NULL;
 		break;
 	default:
 		break;
@@ -558,6 +841,13 @@ void diffcore_rename(struct diff_options *options)
 			if (skip_unmodified &&
 			    diff_unmodified_pair(rename_src[j].p))
 				continue;
+			/*
+			 * Without copy detection, find_renames() would
+			 * not use a source that is already taken.
+			 */
+			if (detect_rename != DIFF_DETECT_COPY &&
+			    one->rename_used)
+				continue;
 
 			this_src.score = estimate_similarity(one, two,
 							     minimum_score);
@@ -585,6 +875,9 @@ void diffcore_rename(struct diff_options *options)
 		rename_count += find_renames(mx, dst_cnt, minimum_score, 1);
 	free(mx);
 
+	if (cache)
+		cache_renames(cache, cache_key);
+
  cleanup:
 	/* At this point, we have found some renames and copies and they
 	 * are recorded in rename_dst.  The original list is still in *q.
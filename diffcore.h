@@ -145,5 +145,9 @@ extern int diffcore_count_changes(struct diff_filespec *src,
 				  unsigned long delta_limit,
 				  unsigned long *src_copied,
 				  unsigned long *literal_added);
+extern int diffcore_may_share_content(struct diff_filespec *src,
+				      struct diff_filespec *dst,
+				      void **src_count_p,
+				      void **dst_count_p);
 
 #endif
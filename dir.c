@@ -15,6 +15,12 @@
 #include "utf8.h"
 #include "varint.h"
 #include "ewah/ewok.h"
+#include "thread-utils.h"
+#include "sparse-index.h"
+
+#ifndef NO_PTHREADS
+#include <pthread.h>
+#endif
 
 struct path_simplify {
 	int len;
@@ -53,6 +59,32 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	int check_only, const struct path_simplify *simplify);
 static int get_dtype(struct dirent *de, const char *path, int len);
 
+/*
+ * When read_directory() runs on several threads, each of them has its
+ * own exclude stack and result lists, but the untracked cache and the
+ * submodule ref cache behind resolve_gitlink_ref() are shared; this
+ * lock protects them.
+ */
+#ifndef NO_PTHREADS
+static pthread_mutex_t dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int dir_threaded;
+
+static inline void dir_lock(void)
+{
+	if (dir_threaded)
+		pthread_mutex_lock(&dir_mutex);
+}
+
+static inline void dir_unlock(void)
+{
+	if (dir_threaded)
+		pthread_mutex_unlock(&dir_mutex);
+}
+#else
+#define dir_lock() (void)0
+#define dir_unlock() (void)0
+#endif
+
 /* helper string functions with support for the ignore_case flag */
 int strcmp_icase(const char *a, const char *b)
 {
@@ -195,6 +227,8 @@ int fill_directory(struct dir_struct *dir, const struct pathspec *pathspec)
 	 */
 	len = common_prefix_len(pathspec);
 
+	ensure_full_index_for_worktree(&the_index);
+
 	/* Read the directory and prune it */
 	read_directory(dir, pathspec->nr ? pathspec->_raw[0] : "", len, pathspec);
 	return len;
@@ -493,6 +527,251 @@ void parse_exclude_pattern(const char **pattern,
 	*patternlen = len;
 }
 
+struct cone_dir {
+	struct hashmap_entry ent;
+	int len;
+	char path[FLEX_ARRAY];
+};
+
+static int cone_dir_cmp(const struct cone_dir *a, const struct cone_dir *b,
+			const char *path)
+{
+	if (a->len != b->len)
+		return 1;
+	if (!path)
+		path = b->path;
+	return ignore_case ? strncasecmp(a->path, path, a->len)
+			   : strncmp(a->path, path, a->len);
+}
+
+static unsigned int cone_dir_hash(const char *path, int len)
+{
+	return ignore_case ? memihash(path, len) : memhash(path, len);
+}
+
+static struct cone_dir *cone_dir_get(struct hashmap *map,
+				     const char *path, int len)
+{
+	struct cone_dir key;
+
+	if (!map->cmpfn)
+		return NULL;
+	hashmap_entry_init(&key, cone_dir_hash(path, len));
+	key.len = len;
+	return hashmap_get(map, &key, path);
+}
+
+static void clear_cone_patterns(struct exclude_list *el)
+{
+	hashmap_free(&el->recursive_hashmap, 1);
+	hashmap_free(&el->parent_hashmap, 1);
+	el->use_cone_patterns = 0;
+	el->full_cone = 0;
+}
+
+/*
+ * Record a pattern of a cone-mode sparse-checkout file.  Such a file
+ * starts with the two patterns that include every top-level file but
+ * no directory, and then only names directories: "/dir/" includes
+ * "dir" with everything below it, and a following negated "/dir/"
+ * pattern ending in a star and a slash narrows that down to the
+ * files directly in "dir".
+ *
+ * Anything else disables cone mode for the list, which is then
+ * matched pattern by pattern as usual.
+ */
+static void add_exclude_to_cone(struct exclude_list *el, struct exclude *x)
+{
+	struct cone_dir *dir;
+	const char *p = x->pattern, *end = x->pattern + x->patternlen;
+	struct strbuf path = STRBUF_INIT;
+	int negative = x->flags & EXC_FLAG_NEGATIVE;
+
+	if (!el->recursive_hashmap.cmpfn) {
+		hashmap_init(&el->recursive_hashmap,
+			     (hashmap_cmp_fn)cone_dir_cmp, 0);
+		hashmap_init(&el->parent_hashmap,
+			     (hashmap_cmp_fn)cone_dir_cmp, 0);
+	}
+
+	if (x->patternlen == 2 && !strncmp(p, "/*", 2)) {
+		if (!negative && !(x->flags & EXC_FLAG_MUSTBEDIR)) {
+			el->full_cone = 1;
+			return;
+		}
+		if (negative && (x->flags & EXC_FLAG_MUSTBEDIR)) {
+			el->full_cone = 0;
+			return;
+		}
+		goto not_cone;
+	}
+
+	if (x->patternlen < 2 || *p != '/')
+		goto not_cone;
+	if (negative) {
+		/* this turns a recursive "dir" into a parent */
+		if (!(x->flags & EXC_FLAG_MUSTBEDIR) ||
+		    x->patternlen < 3 || strncmp(end - 2, "/*", 2))
+			goto not_cone;
+		end -= 2;
+	}
+
+	for (p++; p < end; p++) {
+		if (*p == '\\' && p + 1 < end) {
+			strbuf_addch(&path, *++p);
+			continue;
+		}
+		if (is_glob_special(*p))
+			goto not_cone;
+		strbuf_addch(&path, *p);
+	}
+	if (!path.len)
+		goto not_cone;
+
+	dir = cone_dir_get(&el->recursive_hashmap, path.buf, path.len);
+	if (negative) {
+		if (!dir) {
+			warning(_("unrecognized negative pattern: '%s'"),
+				x->pattern);
+			goto disable;
+		}
+		hashmap_remove(&el->recursive_hashmap, dir, NULL);
+		hashmap_add(&el->parent_hashmap, dir);
+	} else if (!dir) {
+		FLEX_ALLOC_MEM(dir, path, path.buf, path.len);
+		dir->len = path.len;
+		hashmap_entry_init(dir, cone_dir_hash(path.buf, path.len));
+		hashmap_add(&el->recursive_hashmap, dir);
+	}
+	strbuf_release(&path);
+	return;
+
+not_cone:
+	warning(_("unrecognized pattern: '%s'"), x->pattern);
+disable:
+	warning(_("disabling cone pattern matching"));
+	strbuf_release(&path);
+	clear_cone_patterns(el);
+}
+
+struct exclude_bucket {
+	struct hashmap_entry ent;
+	int nr, alloc;
+	int *pos;
+	int len;
+	char key[FLEX_ARRAY];
+};
+
+static int exclude_bucket_cmp(const struct exclude_bucket *a,
+			      const struct exclude_bucket *b,
+			      const char *key)
+{
+	if (a->len != b->len)
+		return 1;
+	return strncmp_icase(a->key, key ? key : b->key, a->len);
+}
+
+static struct exclude_bucket *exclude_bucket_get(struct hashmap *map,
+						 const char *key, int len)
+{
+	struct exclude_bucket k;
+
+	if (!map->cmpfn)
+		return NULL;
+	hashmap_entry_init(&k, cone_dir_hash(key, len));
+	k.len = len;
+	return hashmap_get(map, &k, key);
+}
+
+static void exclude_bucket_add(struct hashmap *map, const char *key, int len,
+			       int pos)
+{
+	struct exclude_bucket *b;
+
+	if (!map->cmpfn)
+		hashmap_init(map, (hashmap_cmp_fn)exclude_bucket_cmp, 0);
+	b = exclude_bucket_get(map, key, len);
+	if (!b) {
+		FLEX_ALLOC_MEM(b, key, key, len);
+		b->len = len;
+		hashmap_entry_init(b, cone_dir_hash(key, len));
+		hashmap_add(map, b);
+	}
+	ALLOC_GROW(b->pos, b->nr + 1, b->alloc);
+	b->pos[b->nr++] = pos;
+}
+
+static void clear_exclude_buckets(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct exclude_bucket *b;
+
+	if (!map->cmpfn)
+		return;
+	hashmap_iter_init(map, &iter);
+	while ((b = hashmap_iter_next(&iter)))
+		free(b->pos);
+	hashmap_free(map, 1);
+}
+
+/* The extension of "*.tar.gz" is ".gz"; "*~" has none */
+static const char *extension_of(const char *name, int len)
+{
+	const char *dot = NULL;
+	int i;
+
+	for (i = len - 1; 0 <= i; i--)
+		if (name[i] == '.') {
+			dot = name + i;
+			break;
+		}
+	return dot;
+}
+
+static void index_exclude(struct exclude_list *el, struct exclude *x, int pos)
+{
+	const char *ext;
+
+	if (x->flags & EXC_FLAG_NODIR) {
+		if (x->nowildcardlen == x->patternlen) {
+			exclude_bucket_add(&el->basename_hash, x->pattern,
+					   x->patternlen, pos);
+			return;
+		}
+		/*
+		 * A basename ending in "literal" has its last dot where
+		 * "literal" has it, if "literal" has one at all.
+		 */
+		if ((x->flags & EXC_FLAG_ENDSWITH) &&
+		    (ext = extension_of(x->pattern + 1, x->patternlen - 1))) {
+			exclude_bucket_add(&el->extension_hash, ext,
+					   x->pattern + x->patternlen - ext, pos);
+			return;
+		}
+	} else if (x->nowildcardlen == x->patternlen) {
+		struct strbuf path = STRBUF_INIT;
+
+		strbuf_add(&path, x->base, x->baselen);
+		if (*x->pattern == '/')
+			strbuf_add(&path, x->pattern + 1, x->patternlen - 1);
+		else
+			strbuf_add(&path, x->pattern, x->patternlen);
+		exclude_bucket_add(&el->path_hash, path.buf, path.len, pos);
+		strbuf_release(&path);
+		return;
+	}
+	ALLOC_GROW(el->wildcard, el->wildcard_nr + 1, el->wildcard_alloc);
+	el->wildcard[el->wildcard_nr++] = pos;
+}
+
+static void clear_exclude_index(struct exclude_list *el)
+{
+	clear_exclude_buckets(&el->basename_hash);
+	clear_exclude_buckets(&el->extension_hash);
+	clear_exclude_buckets(&el->path_hash);
+	free(el->wildcard);
+}
+
 void add_exclude(const char *string, const char *base,
 		 int baselen, struct exclude_list *el, int srcpos)
 {
@@ -517,6 +796,10 @@ void add_exclude(const char *string, const char *base,
 	ALLOC_GROW(el->excludes, el->nr + 1, el->alloc);
 	el->excludes[el->nr++] = x;
 	x->el = el;
+	index_exclude(el, x, el->nr - 1);
+
+	if (el->use_cone_patterns)
+		add_exclude_to_cone(el, x);
 }
 
 static void *read_skip_worktree_file_from_index(const char *path, size_t *size,
@@ -558,6 +841,8 @@ void clear_exclude_list(struct exclude_list *el)
 		free(el->excludes[i]);
 	free(el->excludes);
 	free(el->filebuf);
+	clear_cone_patterns(el);
+	clear_exclude_index(el);
 
 	memset(el, 0, sizeof(*el));
 }
@@ -592,14 +877,12 @@ static void trim_trailing_spaces(char *buf)
  *
  * If "name" has the trailing slash, it'll be excluded in the search.
  */
-static struct untracked_cache_dir *lookup_untracked(struct untracked_cache *uc,
-						    struct untracked_cache_dir *dir,
-						    const char *name, int len)
+static struct untracked_cache_dir *lookup_untracked_1(struct untracked_cache *uc,
+						      struct untracked_cache_dir *dir,
+						      const char *name, int len)
 {
 	int first, last;
 	struct untracked_cache_dir *d;
-	if (!dir)
-		return NULL;
 	if (len && name[len - 1] == '/')
 		len--;
 	first = 0;
@@ -630,6 +913,20 @@ static struct untracked_cache_dir *lookup_untracked(struct untracked_cache *uc,
 	return d;
 }
 
+static struct untracked_cache_dir *lookup_untracked(struct untracked_cache *uc,
+						    struct untracked_cache_dir *dir,
+						    const char *name, int len)
+{
+	struct untracked_cache_dir *d;
+
+	if (!dir)
+		return NULL;
+	dir_lock();
+	d = lookup_untracked_1(uc, dir, name, len);
+	dir_unlock();
+	return d;
+}
+
 static void do_invalidate_gitignore(struct untracked_cache_dir *dir)
 {
 	int i;
@@ -650,11 +947,13 @@ static void invalidate_directory(struct untracked_cache *uc,
 				 struct untracked_cache_dir *dir)
 {
 	int i;
+	dir_lock();
 	uc->dir_invalidated++;
 	dir->valid = 0;
 	dir->untracked_nr = 0;
 	for (i = 0; i < dir->dirs_nr; i++)
 		dir->dirs[i]->recurse = 0;
+	dir_unlock();
 }
 
 /*
@@ -885,50 +1184,124 @@ int match_pathname(const char *pathname, int pathlen,
  * any, determines the fate.  Returns the exclude_list element which
  * matched, or NULL for undecided.
  */
+static int exclude_matches(const char *pathname, int pathlen,
+			   const char *basename, int *dtype,
+			   struct exclude *x)
+{
+	if (x->flags & EXC_FLAG_MUSTBEDIR) {
+		if (*dtype == DT_UNKNOWN)
+			*dtype = get_dtype(NULL, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (x->flags & EXC_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      x->pattern, x->nowildcardlen,
+				      x->patternlen, x->flags);
+
+	assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      x->base, x->baselen ? x->baselen - 1 : 0,
+			      x->pattern, x->nowildcardlen,
+			      x->patternlen, x->flags);
+}
+
+/*
+ * Return the position of the last pattern among the "nr" positions
+ * in "pos" that matches and comes after position "best", or "best".
+ */
+static int last_matching_pos(const char *pathname, int pathlen,
+			     const char *basename, int *dtype,
+			     struct exclude_list *el,
+			     const int *pos, int nr, int best)
+{
+	int i;
+
+	for (i = nr - 1; 0 <= i && best < pos[i]; i--)
+		if (exclude_matches(pathname, pathlen, basename, dtype,
+				    el->excludes[pos[i]]))
+			return pos[i];
+	return best;
+}
+
+static int last_matching_in_bucket(const char *pathname, int pathlen,
+				   const char *basename, int *dtype,
+				   struct exclude_list *el,
+				   struct hashmap *map,
+				   const char *key, int keylen, int best)
+{
+	struct exclude_bucket *b = exclude_bucket_get(map, key, keylen);
+
+	if (!b)
+		return best;
+	return last_matching_pos(pathname, pathlen, basename, dtype, el,
+				 b->pos, b->nr, best);
+}
+
 static struct exclude *last_exclude_matching_from_list(const char *pathname,
 						       int pathlen,
 						       const char *basename,
 						       int *dtype,
 						       struct exclude_list *el)
 {
-	struct exclude *exc = NULL; /* undecided */
-	int i;
+	int basenamelen = pathlen - (basename - pathname);
+	const char *ext;
+	int best = -1; /* undecided */
 
 	if (!el->nr)
 		return NULL;	/* undefined */
 
-	for (i = el->nr - 1; 0 <= i; i--) {
-		struct exclude *x = el->excludes[i];
-		const char *exclude = x->pattern;
-		int prefix = x->nowildcardlen;
-
-		if (x->flags & EXC_FLAG_MUSTBEDIR) {
-			if (*dtype == DT_UNKNOWN)
-				*dtype = get_dtype(NULL, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
+	/*
+	 * The last pattern that matches wins; find the last candidate
+	 * in each index and take the latest of them.
+	 */
+	best = last_matching_pos(pathname, pathlen, basename, dtype, el,
+				 el->wildcard, el->wildcard_nr, best);
+	best = last_matching_in_bucket(pathname, pathlen, basename, dtype, el,
+				       &el->basename_hash,
+				       basename, basenamelen, best);
+	best = last_matching_in_bucket(pathname, pathlen, basename, dtype, el,
+				       &el->path_hash, pathname, pathlen, best);
+	ext = extension_of(basename, basenamelen);
+	if (ext)
+		best = last_matching_in_bucket(pathname, pathlen, basename,
+					       dtype, el, &el->extension_hash,
+					       ext, pathname + pathlen - ext,
+					       best);
+	return best < 0 ? NULL : el->excludes[best];
+}
 
-		if (x->flags & EXC_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, x->patternlen,
-					   x->flags)) {
-				exc = x;
-				break;
-			}
-			continue;
-		}
+/*
+ * Cone-mode matching needs one hash lookup per leading directory of
+ * "pathname" instead of one wildmatch per pattern.
+ */
+static int cone_matches(const char *pathname, int pathlen,
+			struct exclude_list *el)
+{
+	const char *slash = NULL;
+	int i;
 
-		assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   x->base, x->baselen ? x->baselen - 1 : 0,
-				   exclude, prefix, x->patternlen, x->flags)) {
-			exc = x;
+	if (el->full_cone)
+		return 1;
+	if (cone_dir_get(&el->recursive_hashmap, pathname, pathlen))
+		return 2;
+	for (i = pathlen - 1; 0 <= i; i--)
+		if (pathname[i] == '/') {
+			slash = pathname + i;
 			break;
 		}
-	}
-	return exc;
+	if (!slash)
+		return 1; /* everything at the top level */
+	if (cone_dir_get(&el->parent_hashmap, pathname, slash - pathname))
+		return 1;
+	for (i = 0; i < slash - pathname; i++)
+		if (pathname[i] == '/' &&
+		    cone_dir_get(&el->recursive_hashmap, pathname, i))
+			return 2;
+	return cone_dir_get(&el->recursive_hashmap, pathname,
+			    slash - pathname) ? 2 : 0;
 }
 
 /*
@@ -940,6 +1313,9 @@ int is_excluded_from_list(const char *pathname,
 			  struct exclude_list *el)
 {
 	struct exclude *exclude;
+
+	if (el->use_cone_patterns)
+		return cone_matches(pathname, pathlen, el);
 	exclude = last_exclude_matching_from_list(pathname, pathlen, basename, dtype, el);
 	if (exclude)
 		return exclude->flags & EXC_FLAG_NEGATIVE ? 0 : 1;
@@ -1107,10 +1483,13 @@ static void prep_exclude(struct dir_struct *dir, const char *base, int baselen)
 		 * last_exclude_matching(). Be careful about ignore rule
 		 * order, though, if you do that.
 		 */
-		if (untracked &&
-		    hashcmp(sha1_stat.sha1, untracked->exclude_sha1)) {
-			invalidate_gitignore(dir->untracked, untracked);
-			hashcpy(untracked->exclude_sha1, sha1_stat.sha1);
+		if (untracked) {
+			dir_lock();
+			if (hashcmp(sha1_stat.sha1, untracked->exclude_sha1)) {
+				invalidate_gitignore(dir->untracked, untracked);
+				hashcpy(untracked->exclude_sha1, sha1_stat.sha1);
+			}
+			dir_unlock();
 		}
 		dir->exclude_stack = stk;
 		current = stk->baselen;
@@ -1292,7 +1671,12 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 			break;
 		if (!(dir->flags & DIR_NO_GITLINKS)) {
 			unsigned char sha1[20];
-			if (resolve_gitlink_ref(dirname, "HEAD", sha1) == 0)
+			int is_gitlink;
+
+			dir_lock();
+			is_gitlink = !resolve_gitlink_ref(dirname, "HEAD", sha1);
+			dir_unlock();
+			if (is_gitlink)
 				return path_untracked;
 		}
 		return path_recurse;
@@ -1544,9 +1928,11 @@ static void add_untracked(struct untracked_cache_dir *dir, const char *name)
 {
 	if (!dir)
 		return;
+	dir_lock();
 	ALLOC_GROW(dir->untracked, dir->untracked_nr + 1,
 		   dir->untracked_alloc);
 	dir->untracked[dir->untracked_nr++] = xstrdup(name);
+	dir_unlock();
 }
 
 static int valid_cached_dir(struct dir_struct *dir,
@@ -1606,8 +1992,11 @@ static int open_cached_dir(struct cached_dir *cdir,
 	if (valid_cached_dir(dir, untracked, path, check_only))
 		return 0;
 	cdir->fdir = opendir(path->len ? path->buf : ".");
-	if (dir->untracked)
+	if (dir->untracked) {
+		dir_lock();
 		dir->untracked->dir_opened++;
+		dir_unlock();
+	}
 	if (!cdir->fdir)
 		return -1;
 	return 0;
@@ -1649,11 +2038,109 @@ static void close_cached_dir(struct cached_dir *cdir)
 	 * entries. Mark it valid.
 	 */
 	if (cdir->untracked) {
+		dir_lock();
 		cdir->untracked->valid = 1;
 		cdir->untracked->recurse = 1;
+		dir_unlock();
 	}
 }
 
+#ifndef NO_PTHREADS
+/*
+ * A parallel read_directory() starts with the whole walk on one
+ * thread.  Whenever a thread is about to descend into a subdirectory
+ * while another one sits idle, it hands the subdirectory over instead.
+ * Every thread works with its own copy of the dir_struct, so the
+ * per-directory exclude stack and the result lists are private; the
+ * results are merged (and sorted as usual) at the end.
+ */
+struct dir_task {
+	char *path;
+	int len;
+	struct untracked_cache_dir *untracked;
+};
+
+struct dir_walk {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct dir_task *task;
+	int task_nr, task_alloc;
+	int idle, nr_threads;
+	const struct path_simplify *simplify;
+};
+
+static void add_dir_task(struct dir_walk *walk, const char *path, int len,
+			 struct untracked_cache_dir *untracked)
+{
+	struct dir_task *t;
+
+	ALLOC_GROW(walk->task, walk->task_nr + 1, walk->task_alloc);
+	t = &walk->task[walk->task_nr++];
+	t->path = xmemdupz(path, len);
+	t->len = len;
+	t->untracked = untracked;
+}
+
+static int queue_subdir(struct dir_struct *dir, const char *path, int len,
+			struct untracked_cache_dir *untracked)
+{
+	struct dir_walk *walk = dir->walk;
+	int queued = 0;
+
+	if (!walk)
+		return 0;
+	pthread_mutex_lock(&walk->mutex);
+	if (walk->task_nr < walk->idle) {
+		add_dir_task(walk, path, len, untracked);
+		pthread_cond_signal(&walk->cond);
+		queued = 1;
+	}
+	pthread_mutex_unlock(&walk->mutex);
+	return queued;
+}
+
+/*
+ * Wait for a directory to read.  Returns 0 once every thread is idle
+ * and there is nothing left to do.
+ */
+static int next_dir_task(struct dir_walk *walk, struct dir_task *t)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&walk->mutex);
+	walk->idle++;
+	while (!walk->task_nr && walk->idle < walk->nr_threads)
+		pthread_cond_wait(&walk->cond, &walk->mutex);
+	if (walk->task_nr) {
+		*t = walk->task[--walk->task_nr];
+		walk->idle--;
+		ret = 1;
+	} else
+		pthread_cond_broadcast(&walk->cond);
+	pthread_mutex_unlock(&walk->mutex);
+	return ret;
+}
+
+static void *read_directory_thread(void *data)
+{
+	struct dir_struct *dir = data;
+	struct dir_task t;
+
+	while (next_dir_task(dir->walk, &t)) {
+		read_directory_recursive(dir, t.path, t.len, t.untracked, 0,
+					 dir->walk->simplify);
+		free(t.path);
+	}
+	return NULL;
+}
+#else
+static int queue_subdir(struct dir_struct *dir, const char *path, int len,
+			struct untracked_cache_dir *untracked)
+{
+	return 0;
+}
+#endif
+
 /*
  * Read a directory tree. We currently ignore anything but
  * directories, regular files and symlinks. That's because git
@@ -1689,17 +2176,24 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 		if (state > dir_state)
 			dir_state = state;
 
-		/* recurse into subdir if instructed by treat_path */
+		/*
+		 * recurse into subdir if instructed by treat_path; only
+		 * check_only callers look at the state of the subdir,
+		 * so otherwise an idle thread may read it instead
+		 */
 		if (state == path_recurse) {
 			struct untracked_cache_dir *ud;
 			ud = lookup_untracked(dir->untracked, untracked,
 					      path.buf + baselen,
 					      path.len - baselen);
-			subdir_state =
-				read_directory_recursive(dir, path.buf, path.len,
-							 ud, check_only, simplify);
-			if (subdir_state > dir_state)
-				dir_state = subdir_state;
+			if (check_only ||
+			    !queue_subdir(dir, path.buf, path.len, ud)) {
+				subdir_state =
+					read_directory_recursive(dir, path.buf, path.len,
+								 ud, check_only, simplify);
+				if (subdir_state > dir_state)
+					dir_state = subdir_state;
+			}
 		}
 
 		if (check_only) {
@@ -1975,6 +2469,103 @@ static struct untracked_cache_dir *validate_untracked_cache(struct dir_struct *d
 	return root;
 }
 
+static void clear_exclude_list_group(struct dir_struct *dir, int group_type);
+static void clear_exclude_stack(struct dir_struct *dir);
+
+#ifndef NO_PTHREADS
+static void init_worker_dir(struct dir_struct *worker,
+			    const struct dir_struct *dir)
+{
+	*worker = *dir;
+	worker->nr = worker->alloc = 0;
+	worker->entries = NULL;
+	worker->ignored_nr = worker->ignored_alloc = 0;
+	worker->ignored = NULL;
+	memset(&worker->exclude_list_group[EXC_DIRS], 0,
+	       sizeof(worker->exclude_list_group[EXC_DIRS]));
+	worker->exclude_stack = NULL;
+	worker->exclude = NULL;
+	strbuf_init(&worker->basebuf, PATH_MAX);
+}
+
+static void merge_worker_dir(struct dir_struct *dir, struct dir_struct *worker)
+{
+	ALLOC_GROW(dir->entries, dir->nr + worker->nr, dir->alloc);
+	memcpy(dir->entries + dir->nr, worker->entries,
+	       worker->nr * sizeof(*worker->entries));
+	dir->nr += worker->nr;
+	ALLOC_GROW(dir->ignored, dir->ignored_nr + worker->ignored_nr,
+		   dir->ignored_alloc);
+	memcpy(dir->ignored + dir->ignored_nr, worker->ignored,
+	       worker->ignored_nr * sizeof(*worker->ignored));
+	dir->ignored_nr += worker->ignored_nr;
+	free(worker->entries);
+	free(worker->ignored);
+
+	clear_exclude_list_group(worker, EXC_DIRS);
+	clear_exclude_stack(worker);
+}
+
+static void read_directory_parallel(struct dir_struct *dir,
+				    const char *path, int len,
+				    struct untracked_cache_dir *untracked,
+				    const struct path_simplify *simplify)
+{
+	struct dir_walk walk;
+	struct dir_struct *worker;
+	pthread_t *threads;
+	int i, nr = core_untracked_threads - 1;
+
+	memset(&walk, 0, sizeof(walk));
+	pthread_mutex_init(&walk.mutex, NULL);
+	pthread_cond_init(&walk.cond, NULL);
+	walk.nr_threads = nr + 1;
+	walk.simplify = simplify;
+	add_dir_task(&walk, path, len, untracked);
+
+	/* the name hash is built lazily; do it before sharing the index */
+	cache_file_exists("", 0, ignore_case);
+	/* .gitignore files may be read from the index */
+	enable_obj_read_lock();
+	dir_threaded = 1;
+
+	dir->walk = &walk;
+	worker = xcalloc(nr, sizeof(*worker));
+	threads = xcalloc(nr, sizeof(*threads));
+	for (i = 0; i < nr; i++) {
+		int err;
+
+		init_worker_dir(&worker[i], dir);
+		err = pthread_create(&threads[i], NULL,
+				     read_directory_thread, &worker[i]);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	read_directory_thread(dir);
+	for (i = 0; i < nr; i++) {
+		pthread_join(threads[i], NULL);
+		merge_worker_dir(dir, &worker[i]);
+	}
+	dir->walk = NULL;
+
+	dir_threaded = 0;
+	disable_obj_read_lock();
+	free(threads);
+	free(worker);
+	free(walk.task);
+	pthread_cond_destroy(&walk.cond);
+	pthread_mutex_destroy(&walk.mutex);
+}
+#else
+static void read_directory_parallel(struct dir_struct *dir,
+				    const char *path, int len,
+				    struct untracked_cache_dir *untracked,
+				    const struct path_simplify *simplify)
+{
+	read_directory_recursive(dir, path, len, untracked, 0, simplify);
+}
+#endif
+
 int read_directory(struct dir_struct *dir, const char *path, int len, const struct pathspec *pathspec)
 {
 	struct path_simplify *simplify;
@@ -2009,8 +2600,12 @@ int read_directory(struct dir_struct *dir, const char *path, int len, const stru
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, path, len, simplify))
-		read_directory_recursive(dir, path, len, untracked, 0, simplify);
+	if (!len || treat_leading_path(dir, path, len, simplify)) {
+		if (core_untracked_threads > 1)
+			read_directory_parallel(dir, path, len, untracked, simplify);
+		else
+			read_directory_recursive(dir, path, len, untracked, 0, simplify);
+	}
 	free_simplify(simplify);
 	qsort(dir->entries, dir->nr, sizeof(struct dir_entry *), cmp_name);
 	qsort(dir->ignored, dir->ignored_nr, sizeof(struct dir_entry *), cmp_name);
@@ -2243,25 +2838,24 @@ int remove_path(const char *name)
  * Frees memory within dir which was allocated for exclude lists and
  * the exclude_stack.  Does not free dir itself.
  */
-void clear_directory(struct dir_struct *dir)
+static void clear_exclude_list_group(struct dir_struct *dir, int group_type)
 {
-	int i, j;
-	struct exclude_list_group *group;
-	struct exclude_list *el;
-	struct exclude_stack *stk;
+	struct exclude_list_group *group = &dir->exclude_list_group[group_type];
+	int j;
 
-	for (i = EXC_CMDL; i <= EXC_FILE; i++) {
-		group = &dir->exclude_list_group[i];
-		for (j = 0; j < group->nr; j++) {
-			el = &group->el[j];
-			if (i == EXC_DIRS)
-				free((char *)el->src);
-			clear_exclude_list(el);
-		}
-		free(group->el);
+	for (j = 0; j < group->nr; j++) {
+		struct exclude_list *el = &group->el[j];
+		if (group_type == EXC_DIRS)
+			free((char *)el->src);
+		clear_exclude_list(el);
 	}
+	free(group->el);
+}
+
+static void clear_exclude_stack(struct dir_struct *dir)
+{
+	struct exclude_stack *stk = dir->exclude_stack;
 
-	stk = dir->exclude_stack;
 	while (stk) {
 		struct exclude_stack *prev = stk->prev;
 		free(stk);
@@ -2270,6 +2864,15 @@ void clear_directory(struct dir_struct *dir)
 	strbuf_release(&dir->basebuf);
 }
 
+void clear_directory(struct dir_struct *dir)
+{
+	int i;
+
+	for (i = EXC_CMDL; i <= EXC_FILE; i++)
+		clear_exclude_list_group(dir, i);
+	clear_exclude_stack(dir);
+}
+
 struct ondisk_untracked_cache {
 	struct stat_data info_exclude_stat;
 	struct stat_data excludes_file_stat;
@@ -54,6 +54,33 @@ struct exclude_list {
 	const char *src;
 
 	struct exclude **excludes;
+
+	/*
+	 * A sparse-checkout file in "cone" mode only names directories.
+	 * Instead of matching every path against every pattern, the
+	 * directories included with everything below them are kept in
+	 * recursive_hashmap and the directories whose immediate files
+	 * are included in parent_hashmap (see is_excluded_from_list()).
+	 */
+	unsigned use_cone_patterns : 1,
+		 full_cone : 1;
+	struct hashmap recursive_hashmap;
+	struct hashmap parent_hashmap;
+
+	/*
+	 * Patterns without wildcards can only match one basename (or,
+	 * when they contain a slash, one path), and "*.ext" patterns can
+	 * only match basenames with that extension.  Such patterns are
+	 * also indexed by what they can match, so that matching a path
+	 * only tries them when they may apply; every other pattern is
+	 * listed in "wildcard".  All of them hold positions in
+	 * "excludes", in ascending order.
+	 */
+	struct hashmap basename_hash;
+	struct hashmap extension_hash;
+	struct hashmap path_hash;
+	int *wildcard;
+	int wildcard_nr, wildcard_alloc;
 };
 
 /*
@@ -141,6 +168,8 @@ struct untracked_cache {
 	int dir_opened;
 };
 
+struct dir_walk;
+
 struct dir_struct {
 	int nr, alloc;
 	int ignored_nr, ignored_alloc;
@@ -189,6 +218,9 @@ struct dir_struct {
 	struct exclude *exclude;
 	struct strbuf basebuf;
 
+	/* Shared state of a parallel read_directory() */
+	struct dir_walk *walk;
+
 	/* Enable untracked file cache if set */
 	struct untracked_cache *untracked;
 	struct sha1_stat ss_info_exclude;
@@ -217,6 +249,11 @@ extern int within_depth(const char *name, int namelen, int depth, int max_depth)
 extern int fill_directory(struct dir_struct *dir, const struct pathspec *pathspec);
 extern int read_directory(struct dir_struct *, const char *path, int len, const struct pathspec *pathspec);
 
+/*
+ * Returns 1 if "pathname" matches "el", 0 if it matches a negated
+ * pattern and -1 if no pattern decides.  In cone mode, a directory
+ * that is included together with everything below it gives 2.
+ */
 extern int is_excluded_from_list(const char *pathname, int pathlen, const char *basename,
 				 int *dtype, struct exclude_list *el);
 struct dir_entry *dir_add_ignored(struct dir_struct *dir, const char *pathname, int len);
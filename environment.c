@@ -60,6 +60,9 @@ enum object_creation_mode object_creation_mode = OBJECT_CREATION_MODE;
 char *notes_ref_name;
 int grafts_replace_parents = 1;
 int core_apply_sparse_checkout;
+int core_sparse_checkout_cone;
+/* Commands that cope with sparse directory entries clear this */
+int command_requires_full_index = 1;
 int merge_log_config = -1;
 int precomposed_unicode = -1; /* see probe_utf8_pathname_composition() */
 unsigned long pack_size_limit_cfg;
@@ -84,6 +87,12 @@ int auto_comment_line_char;
 /* Parallel index stat data preload? */
 int core_preload_index = 1;
 
+/* Threads reading trees ahead during object traversal (0 = one per CPU) */
+int core_traverse_threads = 1;
+
+/* Threads looking for untracked files (0 = one per CPU) */
+int core_untracked_threads = 1;
+
 /*
  * This is a hack for test programs like test-dump-untracked-cache to
  * ensure that they do not modify the untracked cache when reading it.
@@ -606,6 +606,20 @@ extern int gitsetenv(const char *, const char *, int);
 extern char *gitmkdtemp(char *);
 #endif
 
+#ifdef USE_IO_URING
+/*
+ * lstat() "nr" paths with many requests in flight, storing the result
+ * in st[i] or the errno in err[i].  uring_lstat_init() returns NULL
+ * when the kernel cannot do this, and uring_lstat() returns -1 when
+ * it failed without looking at any path.
+ */
+struct uring_lstat;
+extern struct uring_lstat *uring_lstat_init(unsigned depth);
+extern int uring_lstat(struct uring_lstat *, int nr, const char **path,
+		       struct stat *st, int *err);
+extern void uring_lstat_release(struct uring_lstat *);
+#endif
+
 #ifdef NO_MKSTEMPS
 #define mkstemps gitmkstemps
 extern int gitmkstemps(char *, int);
@@ -0,0 +1,742 @@
+#include "cache.h"
+#include "grep.h"
+#include "grep-index.h"
+#include "tree.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "sha1-array.h"
+#include "pathspec.h"
+
+#define GREP_INDEX_SIGNATURE 0x47494458 /* "GIDX" */
+#define GREP_INDEX_VERSION 1
+#define GREP_INDEX_HEADER_SIZE 12
+
+/*
+ * Each blob gets a filter of a power-of-two size in bytes, with about
+ * ten bits per distinct trigram; with three hash functions that makes
+ * for a false positive rate below 2%.  Large blobs simply saturate
+ * their filter and are then always searched.
+ */
+#define FILTER_BITS_PER_TRIGRAM 10
+#define FILTER_MIN_SIZE 8
+#define FILTER_MAX_SIZE (64 * 1024)
+#define FILTER_HASHES 3
+
+struct grep_index {
+	void *map;
+	size_t mapsz;
+	uint32_t nr;
+	const unsigned char *sha1s;
+	const unsigned char *offsets;
+	const unsigned char *filters;
+	size_t filters_size;
+};
+
+struct trigram_set {
+	uint32_t *trigram;
+	int nr, alloc;
+};
+
+/* A blob may match if it has all trigrams of any one alternative. */
+struct grep_index_query {
+	struct trigram_set *alt;
+	int nr, alloc;
+};
+
+static inline unsigned char fold(unsigned char c)
+{
+	return tolower_trans_tbl[c];
+}
+
+static void filter_bits(uint32_t trigram, uint32_t size,
+			uint32_t bit[FILTER_HASHES])
+{
+	uint32_t mask = size * 8 - 1;
+	uint32_t h = trigram, step;
+	int i;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	step = (h >> 16 | h << 16) | 1;
+	for (i = 0; i < FILTER_HASHES; i++)
+		bit[i] = (h + i * step) & mask;
+}
+
+static int filter_has(const unsigned char *filter, uint32_t size,
+		      uint32_t trigram)
+{
+	uint32_t bit[FILTER_HASHES];
+	int i;
+
+	filter_bits(trigram, size, bit);
+	for (i = 0; i < FILTER_HASHES; i++)
+		if (!(filter[bit[i] >> 3] & (1 << (bit[i] & 7))))
+			return 0;
+	return 1;
+}
+
+const char *grep_index_path(const unsigned char *tree_sha1)
+{
+	static struct strbuf path = STRBUF_INIT;
+
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/info/grep-index/%s",
+		    get_object_directory(), sha1_to_hex(tree_sha1));
+	return path.buf;
+}
+
+static struct grep_index *parse_grep_index(void *map, size_t mapsz,
+					   const char *path)
+{
+	struct grep_index *index;
+	const unsigned char *data = map;
+	size_t tables;
+	uint32_t nr;
+
+	if (mapsz < GREP_INDEX_HEADER_SIZE + 20 ||
+	    get_be32(data) != GREP_INDEX_SIGNATURE) {
+		error("%s: not a grep index", path);
+		return NULL;
+	}
+	if (get_be32(data + 4) != GREP_INDEX_VERSION) {
+		error("%s: unsupported grep index version %"PRIu32,
+		      path, get_be32(data + 4));
+		return NULL;
+	}
+	nr = get_be32(data + 8);
+	tables = st_add3(GREP_INDEX_HEADER_SIZE, st_mult(nr, 20),
+			 st_mult(st_add(nr, 1), 4));
+	if (mapsz < st_add(tables, 20) ||
+	    get_be32(data + tables - 4) != mapsz - tables - 20) {
+		error("%s: grep index is truncated", path);
+		return NULL;
+	}
+
+	index = xcalloc(1, sizeof(*index));
+	index->map = map;
+	index->mapsz = mapsz;
+	index->nr = nr;
+	index->sha1s = data + GREP_INDEX_HEADER_SIZE;
+	index->offsets = index->sha1s + st_mult(nr, 20);
+	index->filters = data + tables;
+	index->filters_size = mapsz - tables - 20;
+	return index;
+}
+
+static struct grep_index *load_grep_index_file(const char *path)
+{
+	struct grep_index *index;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	map = xmmap(NULL, xsize_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	index = parse_grep_index(map, xsize_t(st.st_size), path);
+	if (!index)
+		munmap(map, xsize_t(st.st_size));
+	return index;
+}
+
+struct grep_index *grep_index_load(const unsigned char *tree_sha1)
+{
+	return load_grep_index_file(grep_index_path(tree_sha1));
+}
+
+struct grep_index *grep_index_load_latest(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf latest = STRBUF_INIT;
+	struct grep_index *index = NULL;
+	unsigned long latest_mtime = 0;
+	unsigned char sha1[20];
+	struct dirent *de;
+	size_t dirlen;
+	DIR *dir;
+
+	strbuf_addf(&path, "%s/info/grep-index/", get_object_directory());
+	dirlen = path.len;
+	dir = opendir(path.buf);
+	if (!dir) {
+		strbuf_release(&path);
+		return NULL;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		struct stat st;
+
+		if (strlen(de->d_name) != 40 || get_sha1_hex(de->d_name, sha1))
+			continue;
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (stat(path.buf, &st) || st.st_mtime < latest_mtime)
+			continue;
+		latest_mtime = st.st_mtime;
+		strbuf_reset(&latest);
+		strbuf_addbuf(&latest, &path);
+	}
+	closedir(dir);
+
+	if (latest.len)
+		index = load_grep_index_file(latest.buf);
+	strbuf_release(&latest);
+	strbuf_release(&path);
+	return index;
+}
+
+void grep_index_free(struct grep_index *index)
+{
+	if (!index)
+		return;
+	munmap(index->map, index->mapsz);
+	free(index);
+}
+
+static int index_pos(const struct grep_index *index, const unsigned char *sha1)
+{
+	uint32_t lo = 0, hi = index->nr;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(index->sha1s + st_mult(mi, 20), sha1);
+
+		if (!cmp)
+			return mi;
+		if (cmp < 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return -1;
+}
+
+/*
+ * Find the filter of the blob at "pos", or return NULL if the offsets
+ * the index records for it make no sense.
+ */
+static const unsigned char *index_filter(const struct grep_index *index,
+					 int pos, uint32_t *size)
+{
+	uint32_t start = get_be32(index->offsets + st_mult(pos, 4));
+	uint32_t end = get_be32(index->offsets + st_mult(pos + 1, 4));
+
+	*size = end - start;
+	if (start > end || end > index->filters_size ||
+	    *size < FILTER_MIN_SIZE || *size > FILTER_MAX_SIZE ||
+	    (*size & (*size - 1)))
+		return NULL;
+	return index->filters + start;
+}
+
+int grep_index_may_match(const struct grep_index *index,
+			 const unsigned char *blob_sha1,
+			 const struct grep_index_query *query)
+{
+	const unsigned char *filter;
+	uint32_t size;
+	int pos, i, j;
+
+	pos = index_pos(index, blob_sha1);
+	if (pos < 0)
+		return 1;
+	filter = index_filter(index, pos, &size);
+	if (!filter)
+		return 1;
+
+	for (i = 0; i < query->nr; i++) {
+		const struct trigram_set *set = &query->alt[i];
+
+		for (j = 0; j < set->nr; j++)
+			if (!filter_has(filter, size, set->trigram[j]))
+				break;
+		if (j == set->nr)
+			return 1;
+	}
+	return 0;
+}
+
+static void add_trigrams(struct trigram_set *set, struct strbuf *run)
+{
+	size_t i;
+
+	for (i = 2; i < run->len; i++) {
+		uint32_t trigram = fold(run->buf[i - 2]) << 16 |
+				   fold(run->buf[i - 1]) << 8 |
+				   fold(run->buf[i]);
+		ALLOC_GROW(set->trigram, set->nr + 1, set->alloc);
+		set->trigram[set->nr++] = trigram;
+	}
+	strbuf_reset(run);
+}
+
+/*
+ * Skip the bracket expression starting at pat[i] == '['.  Returns the
+ * position after it, or 0 if we cannot tell where it ends.
+ */
+static size_t skip_bracket(const char *pat, size_t len, size_t i, int pcre)
+{
+	i++;
+	if (i < len && pat[i] == '^')
+		i++;
+	if (i < len && pat[i] == ']')
+		i++;
+	while (i < len && pat[i] != ']') {
+		if (pcre && pat[i] == '\\')
+			i++;
+		else if (pat[i] == '[' && i + 1 < len &&
+			 (pat[i + 1] == ':' || pat[i + 1] == '.' ||
+			  pat[i + 1] == '=')) {
+			char delim = pat[i + 1];
+			i += 2;
+			while (i + 1 < len && !(pat[i] == delim && pat[i + 1] == ']'))
+				i++;
+			i++;
+		}
+		i++;
+	}
+	return i < len ? i + 1 : 0;
+}
+
+/*
+ * Skip the group starting at pat[i], which is "(" (or "\(" for basic
+ * regexps).  Returns the position after the group, or 0 if we cannot
+ * tell where it ends.
+ */
+static size_t skip_group(const char *pat, size_t len, size_t i,
+			 int basic, int pcre)
+{
+	int depth = 0;
+
+	while (i < len) {
+		if (pat[i] == '[') {
+			i = skip_bracket(pat, len, i, pcre);
+			if (!i)
+				return 0;
+			continue;
+		}
+		if (basic) {
+			if (pat[i] == '\\' && i + 1 < len) {
+				if (pat[i + 1] == '(')
+					depth++;
+				else if (pat[i + 1] == ')' && !--depth)
+					return i + 2;
+				i += 2;
+				continue;
+			}
+		} else {
+			if (pat[i] == '\\') {
+				i += 2;
+				continue;
+			}
+			if (pat[i] == '(')
+				depth++;
+			else if (pat[i] == ')' && !--depth)
+				return i + 1;
+		}
+		i++;
+	}
+	return 0;
+}
+
+/*
+ * Collect the trigrams of the literal strings that every match of the
+ * regular expression must contain.  Anything we do not understand ends
+ * the current literal; constructs that could make a literal optional
+ * at the top level (alternation, inline options) make us give up and
+ * return -1, as does anything inside a group.
+ */
+static int regex_trigrams(const char *pat, size_t len, int basic, int pcre,
+			  int icase, struct trigram_set *set)
+{
+	struct strbuf run = STRBUF_INIT;
+	size_t i = 0;
+	int ret = -1;
+
+	while (i < len) {
+		unsigned char c = pat[i];
+
+		if (c == '\\' && i + 1 < len) {
+			unsigned char e = pat[i + 1];
+
+			if (basic && e == '(') {
+				add_trigrams(set, &run);
+				i = skip_group(pat, len, i, basic, pcre);
+				if (!i)
+					goto out;
+				continue;
+			}
+			if (basic && e == '|')
+				goto out;
+			if (basic && (e == '{' || e == '+' || e == '?')) {
+				strbuf_setlen(&run, run.len ? run.len - 1 : 0);
+				add_trigrams(set, &run);
+				if (e == '{') {
+					while (i + 1 < len &&
+					       !(pat[i] == '\\' && pat[i + 1] == '}'))
+						i++;
+				}
+				i += 2;
+				continue;
+			}
+			if (isalnum(e) || e >= 0x80) {
+				const char *ok = pcre ? "wWdDsSbBAZzGhHvVRKntrfe" :
+							"wWsSbB123456789";
+				if (e >= 0x80 || !strchr(ok, e))
+					goto out;
+				add_trigrams(set, &run);
+			} else if (!pcre && strchr("<>`'", e)) {
+				add_trigrams(set, &run);
+			} else if (basic && strchr("){}", e)) {
+				add_trigrams(set, &run);
+			} else {
+				strbuf_addch(&run, e);
+			}
+			i += 2;
+			continue;
+		}
+
+		if (c == '[') {
+			add_trigrams(set, &run);
+			i = skip_bracket(pat, len, i, pcre);
+			if (!i)
+				goto out;
+			continue;
+		}
+		if (c == '*' || (!basic && (c == '?' || c == '+' || c == '{'))) {
+			strbuf_setlen(&run, run.len ? run.len - 1 : 0);
+			add_trigrams(set, &run);
+			if (c == '{') {
+				while (i < len && pat[i] != '}')
+					i++;
+			}
+			i++;
+			continue;
+		}
+		if (!basic && c == '|')
+			goto out;
+		if (!basic && c == '(') {
+			if (pcre && i + 1 < len && pat[i + 1] == '?')
+				goto out;
+			add_trigrams(set, &run);
+			i = skip_group(pat, len, i, basic, pcre);
+			if (!i)
+				goto out;
+			continue;
+		}
+		if (c == '.' || c == '^' || c == '$' || (!basic && c == ')') ||
+		    (icase && c >= 0x80) || c == '\\') {
+			add_trigrams(set, &run);
+			i++;
+			continue;
+		}
+		strbuf_addch(&run, c);
+		i++;
+	}
+	add_trigrams(set, &run);
+	ret = 0;
+out:
+	strbuf_release(&run);
+	return ret;
+}
+
+static void free_trigram_set(struct trigram_set *set)
+{
+	free(set->trigram);
+}
+
+struct grep_index_query *grep_index_query_compile(const struct grep_opt *opt)
+{
+	struct grep_index_query *query;
+	struct grep_pat *p;
+
+	if (opt->extended || opt->invert || opt->allow_textconv ||
+	    !opt->pattern_list)
+		return NULL;
+
+	query = xcalloc(1, sizeof(*query));
+	for (p = opt->pattern_list; p; p = p->next) {
+		struct trigram_set set = { NULL, 0, 0 };
+
+		if (p->token != GREP_PATTERN)
+			goto fail;
+		if (p->fixed) {
+			struct strbuf run = STRBUF_INIT;
+
+			strbuf_add(&run, p->pattern, p->patternlen);
+			add_trigrams(&set, &run);
+			strbuf_release(&run);
+		} else if (regex_trigrams(p->pattern, p->patternlen,
+					  !(opt->regflags & REG_EXTENDED) &&
+					  !opt->pcre1 && !opt->pcre2,
+					  opt->pcre1 || opt->pcre2,
+					  opt->ignore_case ||
+					  (opt->regflags & REG_ICASE),
+					  &set) < 0) {
+			free_trigram_set(&set);
+			goto fail;
+		}
+		if (!set.nr)
+			goto fail;
+
+		ALLOC_GROW(query->alt, query->nr + 1, query->alloc);
+		query->alt[query->nr++] = set;
+	}
+	return query;
+
+fail:
+	grep_index_query_free(query);
+	return NULL;
+}
+
+void grep_index_query_free(struct grep_index_query *query)
+{
+	int i;
+
+	if (!query)
+		return;
+	for (i = 0; i < query->nr; i++)
+		free_trigram_set(&query->alt[i]);
+	free(query->alt);
+	free(query);
+}
+
+/* Scratch space for computing filters. */
+struct filter_builder {
+	unsigned char *seen; /* one bit per possible trigram */
+	uint32_t *trigram;
+	int nr, alloc;
+};
+
+static int build_filter(struct filter_builder *b, const unsigned char *sha1,
+			struct strbuf *out)
+{
+	enum object_type type;
+	unsigned long size, i;
+	unsigned char *buf, *filter;
+	uint32_t trigram = 0, fsize = FILTER_MIN_SIZE;
+	size_t start;
+	int j;
+
+	buf = read_sha1_file(sha1, &type, &size);
+	if (!buf || type != OBJ_BLOB) {
+		free(buf);
+		return error("unable to read blob %s", sha1_to_hex(sha1));
+	}
+
+	if (!b->seen)
+		b->seen = xcalloc(1, (1 << 24) / 8);
+	b->nr = 0;
+	for (i = 0; i < size; i++) {
+		trigram = ((trigram << 8) | fold(buf[i])) & 0xffffff;
+		if (i < 2 || (b->seen[trigram >> 3] & (1 << (trigram & 7))))
+			continue;
+		b->seen[trigram >> 3] |= 1 << (trigram & 7);
+		ALLOC_GROW(b->trigram, b->nr + 1, b->alloc);
+		b->trigram[b->nr++] = trigram;
+	}
+	free(buf);
+
+	while (fsize < FILTER_MAX_SIZE &&
+	       (uint64_t)fsize * 8 < (uint64_t)b->nr * FILTER_BITS_PER_TRIGRAM)
+		fsize *= 2;
+	start = out->len;
+	strbuf_addchars(out, 0, fsize);
+	filter = (unsigned char *)out->buf + start;
+	for (j = 0; j < b->nr; j++) {
+		uint32_t bit[FILTER_HASHES];
+		int k;
+
+		filter_bits(b->trigram[j], fsize, bit);
+		for (k = 0; k < FILTER_HASHES; k++)
+			filter[bit[k] >> 3] |= 1 << (bit[k] & 7);
+		b->seen[b->trigram[j] >> 3] &= ~(1 << (b->trigram[j] & 7));
+	}
+	return 0;
+}
+
+static void clear_filter_builder(struct filter_builder *b)
+{
+	free(b->seen);
+	free(b->trigram);
+}
+
+static int collect_blob(const unsigned char *sha1, struct strbuf *base,
+			const char *pathname, unsigned mode, int stage,
+			void *context)
+{
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+	if (S_ISREG(mode))
+		sha1_array_append(context, sha1);
+	return 0;
+}
+
+static void append_unique(const unsigned char sha1[20], void *data)
+{
+	sha1_array_append(data, sha1);
+}
+
+/* The blobs of the tree that grep looks at, sorted and without duplicates. */
+static int collect_tree_blobs(const unsigned char *tree_sha1,
+			      struct sha1_array *blobs)
+{
+	struct sha1_array all = SHA1_ARRAY_INIT;
+	struct pathspec pathspec;
+	struct tree *tree;
+
+	tree = parse_tree_indirect(tree_sha1);
+	if (!tree)
+		return error("not a tree object: %s", sha1_to_hex(tree_sha1));
+	memset(&pathspec, 0, sizeof(pathspec));
+	if (read_tree_recursive(tree, "", 0, 0, &pathspec, collect_blob, &all)) {
+		sha1_array_clear(&all);
+		return error("unable to read tree %s", sha1_to_hex(tree_sha1));
+	}
+	sha1_array_for_each_unique(&all, append_unique, blobs);
+	sha1_array_clear(&all);
+	return 0;
+}
+
+int grep_index_write(const unsigned char *tree_sha1,
+		     const struct grep_index *base)
+{
+	static struct lock_file lock;
+	struct sha1_array blobs = SHA1_ARRAY_INIT;
+	struct filter_builder builder = { NULL, NULL, 0, 0 };
+	struct strbuf filters = STRBUF_INIT;
+	uint32_t *offset;
+	struct sha1file *f;
+	unsigned char trailer[20];
+	char *path;
+	int i, fd, built = 0;
+
+	if (collect_tree_blobs(tree_sha1, &blobs))
+		return -1;
+
+	ALLOC_ARRAY(offset, blobs.nr + 1);
+	for (i = 0; i < blobs.nr; i++) {
+		int pos = base ? index_pos(base, blobs.sha1[i]) : -1;
+		const unsigned char *filter = NULL;
+		uint32_t size;
+
+		offset[i] = filters.len;
+		if (pos >= 0)
+			filter = index_filter(base, pos, &size);
+		if (filter) {
+			strbuf_add(&filters, filter, size);
+		} else {
+			if (build_filter(&builder, blobs.sha1[i], &filters)) {
+				built = -1;
+				goto out;
+			}
+			built++;
+		}
+		if (filters.len > 0xffffffff) {
+			built = error("grep index for %s would be too large",
+				      sha1_to_hex(tree_sha1));
+			goto out;
+		}
+	}
+	offset[blobs.nr] = filters.len;
+
+	path = xstrdup(grep_index_path(tree_sha1));
+	if (safe_create_leading_directories(path)) {
+		built = error("unable to create directory for %s", path);
+		free(path);
+		goto out;
+	}
+	fd = hold_lock_file_for_update(&lock, path, LOCK_DIE_ON_ERROR);
+	f = sha1fd(fd, get_lock_file_path(&lock));
+	sha1write_be32(f, GREP_INDEX_SIGNATURE);
+	sha1write_be32(f, GREP_INDEX_VERSION);
+	sha1write_be32(f, blobs.nr);
+	for (i = 0; i < blobs.nr; i++)
+		sha1write(f, blobs.sha1[i], 20);
+	for (i = 0; i <= blobs.nr; i++)
+		sha1write_be32(f, offset[i]);
+	sha1write(f, filters.buf, filters.len);
+	sha1close(f, trailer, 0);
+	write_or_die(fd, trailer, 20);
+	if (commit_lock_file(&lock))
+		built = error("unable to write %s: %s", path, strerror(errno));
+	free(path);
+
+out:
+	free(offset);
+	strbuf_release(&filters);
+	clear_filter_builder(&builder);
+	sha1_array_clear(&blobs);
+	return built;
+}
+
+int grep_index_verify(const unsigned char *tree_sha1)
+{
+	const char *path = grep_index_path(tree_sha1);
+	struct sha1_array blobs = SHA1_ARRAY_INIT;
+	struct filter_builder builder = { NULL, NULL, 0, 0 };
+	struct strbuf filter = STRBUF_INIT;
+	struct grep_index *index;
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+	uint32_t i;
+	int ret = -1;
+
+	index = load_grep_index_file(path);
+	if (!index)
+		return error("%s: unable to load grep index", path);
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, index->map, index->mapsz - 20);
+	git_SHA1_Final(sha1, &ctx);
+	if (hashcmp(sha1, (unsigned char *)index->map + index->mapsz - 20)) {
+		error("%s: checksum mismatch", path);
+		goto out;
+	}
+
+	if (collect_tree_blobs(tree_sha1, &blobs))
+		goto out;
+	if (blobs.nr != index->nr) {
+		error("%s: indexes %"PRIu32" blobs, tree has %d",
+		      path, index->nr, blobs.nr);
+		goto out;
+	}
+
+	for (i = 0; i < index->nr; i++) {
+		const unsigned char *stored;
+		uint32_t size;
+
+		if (hashcmp(index->sha1s + st_mult(i, 20), blobs.sha1[i])) {
+			error("%s: blob %s is missing", path,
+			      sha1_to_hex(blobs.sha1[i]));
+			goto out;
+		}
+		stored = index_filter(index, i, &size);
+		strbuf_reset(&filter);
+		if (build_filter(&builder, blobs.sha1[i], &filter))
+			goto out;
+		if (!stored || size != filter.len ||
+		    memcmp(stored, filter.buf, size)) {
+			error("%s: wrong filter for blob %s", path,
+			      sha1_to_hex(blobs.sha1[i]));
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	strbuf_release(&filter);
+	clear_filter_builder(&builder);
+	sha1_array_clear(&blobs);
+	grep_index_free(index);
+	return ret;
+}
@@ -0,0 +1,64 @@
+#ifndef GREP_INDEX_H
+#define GREP_INDEX_H
+
+struct grep_opt;
+struct grep_index;
+struct grep_index_query;
+
+/*
+ * A grep index records, for every blob in a tree, a Bloom filter of
+ * the trigrams (runs of three bytes, with ASCII letters folded to
+ * lower case) that occur in it.  It lives in
+ * $GIT_OBJECT_DIRECTORY/info/grep-index/<tree>, and lets "git grep
+ * <pattern> <tree-ish>" skip blobs that cannot contain a string every
+ * match of the pattern has to contain.  See git-grep-index(1).
+ */
+
+/*
+ * Path of the index file for the given tree.  The result is a static
+ * buffer, as with git_path().
+ */
+const char *grep_index_path(const unsigned char *tree_sha1);
+
+/*
+ * Load the index of the given tree, or return NULL if there is none
+ * or it is unusable.  grep_index_load_latest() loads the most recently
+ * written index of any tree, if any.
+ */
+struct grep_index *grep_index_load(const unsigned char *tree_sha1);
+struct grep_index *grep_index_load_latest(void);
+void grep_index_free(struct grep_index *index);
+
+/*
+ * Work out which trigrams the patterns of "opt" (which must already be
+ * compiled) require.  Returns NULL if nothing is known to be required,
+ * e.g. for "-v" or for a pattern without a literal of three bytes,
+ * in which case the index cannot help.
+ */
+struct grep_index_query *grep_index_query_compile(const struct grep_opt *opt);
+void grep_index_query_free(struct grep_index_query *query);
+
+/*
+ * Return 0 if the blob cannot match the query according to the index,
+ * and 1 if it may, or if the blob is not in the index.
+ */
+int grep_index_may_match(const struct grep_index *index,
+			 const unsigned char *blob_sha1,
+			 const struct grep_index_query *query);
+
+/*
+ * Write the index for the given tree, reusing the filters of blobs
+ * that are also in "base" (which may be NULL).  Returns the number of
+ * filters that had to be computed, or -1 on error.
+ */
+int grep_index_write(const unsigned char *tree_sha1,
+		     const struct grep_index *base);
+
+/*
+ * Check the index file of the given tree against its checksum and the
+ * contents of the tree.  Returns 0 if it is fine, -1 after reporting
+ * an error otherwise.
+ */
+int grep_index_verify(const unsigned char *tree_sha1);
+
+#endif
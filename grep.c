@@ -179,25 +179,32 @@ void grep_set_pattern_type_option(enum grep_pattern_type pattern_type, struct gr
 
 	case GREP_PATTERN_TYPE_BRE:
 		opt->fixed = 0;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_ERE:
 		opt->fixed = 0;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags |= REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_FIXED:
 		opt->fixed = 1;
-		opt->pcre = 0;
+		opt->pcre1 = 0;
+		opt->pcre2 = 0;
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 
 	case GREP_PATTERN_TYPE_PCRE:
 		opt->fixed = 0;
-		opt->pcre = 1;
+#ifdef USE_LIBPCRE2
+		opt->pcre2 = 1;
+#else
+		opt->pcre1 = 1;
+#endif
 		opt->regflags &= ~REG_EXTENDED;
 		break;
 	}
@@ -378,6 +385,121 @@ static void free_pcre_regexp(struct grep_pat *p)
 }
 #endif /* !USE_LIBPCRE */
 
+#ifdef USE_LIBPCRE2
+/*
+ * Largest stack the JIT-compiled matcher may grow; the 32kB pcre2
+ * starts with by default is too small for patterns like "(a|b)*" on
+ * long lines.
+ */
+#define GREP_PCRE2_JIT_STACK_MAX (1024 * 1024)
+
+static void compile_pcre2_pattern(struct grep_pat *p, const struct grep_opt *opt)
+{
+	int error;
+	PCRE2_UCHAR errbuf[256];
+	PCRE2_SIZE erroffset;
+	uint32_t options = PCRE2_MULTILINE;
+
+	if (opt->ignore_case)
+		options |= PCRE2_CASELESS;
+
+	p->pcre2_pattern = pcre2_compile((PCRE2_SPTR)p->pattern,
+					 p->patternlen, options, &error,
+					 &erroffset, NULL);
+	if (!p->pcre2_pattern) {
+		pcre2_get_error_message(error, errbuf, sizeof(errbuf));
+		compile_regexp_failed(p, (const char *)errbuf);
+	}
+
+	p->pcre2_match_data =
+		pcre2_match_data_create_from_pattern(p->pcre2_pattern, NULL);
+	if (!p->pcre2_match_data)
+		die("unable to allocate PCRE2 match data");
+
+	/*
+	 * Every thread compiles its own copy of the patterns (see
+	 * grep_opt_dup()), so the match data, the match context and the
+	 * JIT stack below are never shared between threads and can be
+	 * reused for every line we look at.
+	 */
+	if (pcre2_config(PCRE2_CONFIG_JIT, &p->pcre2_jit_on) < 0)
+		p->pcre2_jit_on = 0;
+	if (p->pcre2_jit_on &&
+	    pcre2_jit_compile(p->pcre2_pattern, PCRE2_JIT_COMPLETE))
+		p->pcre2_jit_on = 0; /* e.g. no executable memory; interpret */
+	if (!p->pcre2_jit_on)
+		return;
+
+	p->pcre2_jit_stack = pcre2_jit_stack_create(1, GREP_PCRE2_JIT_STACK_MAX,
+						    NULL);
+	if (!p->pcre2_jit_stack)
+		die("unable to allocate PCRE2 JIT stack");
+	p->pcre2_match_context = pcre2_match_context_create(NULL);
+	if (!p->pcre2_match_context)
+		die("unable to allocate PCRE2 match context");
+	pcre2_jit_stack_assign(p->pcre2_match_context, NULL, p->pcre2_jit_stack);
+}
+
+static int pcre2match(struct grep_pat *p, const char *line, const char *eol,
+		regmatch_t *match, int eflags)
+{
+	int ret;
+	uint32_t flags = 0;
+
+	if (eflags & REG_NOTBOL)
+		flags |= PCRE2_NOTBOL;
+
+	if (p->pcre2_jit_on)
+		ret = pcre2_jit_match(p->pcre2_pattern, (PCRE2_SPTR)line,
+				      eol - line, 0, flags, p->pcre2_match_data,
+				      p->pcre2_match_context);
+	else
+		ret = pcre2_match(p->pcre2_pattern, (PCRE2_SPTR)line,
+				  eol - line, 0, flags, p->pcre2_match_data,
+				  NULL);
+
+	if (ret < 0 && ret != PCRE2_ERROR_NOMATCH) {
+		PCRE2_UCHAR errbuf[256];
+		pcre2_get_error_message(ret, errbuf, sizeof(errbuf));
+		die("%s failed with error code %d: %s",
+		    p->pcre2_jit_on ? "pcre2_jit_match" : "pcre2_match", ret,
+		    errbuf);
+	}
+	if (ret > 0) {
+		PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(p->pcre2_match_data);
+
+		ret = 0;
+		match->rm_so = (int)ovector[0];
+		match->rm_eo = (int)ovector[1];
+	}
+
+	return ret;
+}
+
+static void free_pcre2_pattern(struct grep_pat *p)
+{
+	pcre2_code_free(p->pcre2_pattern);
+	pcre2_match_data_free(p->pcre2_match_data);
+	pcre2_match_context_free(p->pcre2_match_context);
+	pcre2_jit_stack_free(p->pcre2_jit_stack);
+}
+#else /* !USE_LIBPCRE2 */
+static void compile_pcre2_pattern(struct grep_pat *p, const struct grep_opt *opt)
+{
+	die("cannot use Perl-compatible regexes when not compiled with USE_LIBPCRE2");
+}
+
+static int pcre2match(struct grep_pat *p, const char *line, const char *eol,
+		regmatch_t *match, int eflags)
+{
+	return 1;
+}
+
+static void free_pcre2_pattern(struct grep_pat *p)
+{
+}
+#endif /* !USE_LIBPCRE2 */
+
 static int is_fixed(const char *s, size_t len)
 {
 	size_t i;
@@ -396,6 +518,13 @@ static int is_fixed(const char *s, size_t len)
 	return 1;
 }
 
+static kwset_t alloc_kwset(const struct grep_pat *p, const struct grep_opt *opt)
+{
+	if (opt->regflags & REG_ICASE || p->ignore_case)
+		return kwsalloc(tolower_trans_tbl);
+	return kwsalloc(NULL);
+}
+
 static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 {
 	int err;
@@ -409,16 +538,18 @@ static void compile_regexp(struct grep_pat *p, struct grep_opt *opt)
 		p->fixed = 0;
 
 	if (p->fixed) {
-		if (opt->regflags & REG_ICASE || p->ignore_case)
-			p->kws = kwsalloc(tolower_trans_tbl);
-		else
-			p->kws = kwsalloc(NULL);
+		p->kws = alloc_kwset(p, opt);
 		kwsincr(p->kws, p->pattern, p->patternlen);
 		kwsprep(p->kws);
 		return;
 	}
 
-	if (opt->pcre) {
+	if (opt->pcre2) {
+		compile_pcre2_pattern(p, opt);
+		return;
+	}
+
+	if (opt->pcre1) {
 		compile_pcre_regexp(p, opt);
 		return;
 	}
@@ -695,6 +826,48 @@ static struct grep_expr *grep_splice_or(struct grep_expr *x, struct grep_expr *y
 	return z;
 }
 
+/*
+ * Without --and, --not and friends, a line matches if any pattern does.
+ * Looking for each fixed string separately means scanning every line
+ * once per pattern, which hurts with "-F -f <list>" and thousands of
+ * strings; instead hand all of them to the first one's keyword set,
+ * which finds the leftmost longest of them in a single pass, and mark
+ * the others as merged so they are skipped.
+ */
+static void merge_fixed_patterns(struct grep_opt *opt)
+{
+	struct grep_pat *p, *first = NULL;
+	int nr = 0;
+
+	/* Per-pattern retries for word matches do not combine. */
+	if (opt->word_regexp)
+		return;
+
+	for (p = opt->pattern_list; p; p = p->next) {
+		if (p->token != GREP_PATTERN || !p->fixed)
+			continue;
+		if (!p->patternlen)
+			return; /* matches everywhere anyway */
+		nr++;
+	}
+	if (nr < 2)
+		return;
+
+	for (p = opt->pattern_list; p; p = p->next) {
+		if (p->token != GREP_PATTERN || !p->fixed)
+			continue;
+		kwsfree(p->kws);
+		p->kws = NULL;
+		if (!first) {
+			first = p;
+			first->kws = alloc_kwset(first, opt);
+		} else
+			p->merged = 1;
+		kwsincr(first->kws, p->pattern, p->patternlen);
+	}
+	kwsprep(first->kws);
+}
+
 static void compile_grep_patterns_real(struct grep_opt *opt)
 {
 	struct grep_pat *p;
@@ -715,8 +888,11 @@ static void compile_grep_patterns_real(struct grep_opt *opt)
 
 	if (opt->all_match || header_expr)
 		opt->extended = 1;
-	else if (!opt->extended && !opt->debug)
-		return;
+	else if (!opt->extended) {
+		merge_fixed_patterns(opt);
+		if (!opt->debug)
+			return;
+	}
 
 	p = opt->pattern_list;
 	if (p)
@@ -777,7 +953,9 @@ void free_grep_patterns(struct grep_opt *opt)
 				kwsfree(p->kws);
 			else if (p->pcre_regexp)
 				free_pcre_regexp(p);
-			else
+			else if (p->pcre2_pattern)
+				free_pcre2_pattern(p);
+			else if (!p->merged)
 				regfree(&p->regexp);
 			free(p->pattern);
 			break;
@@ -868,6 +1046,8 @@ static int patmatch(struct grep_pat *p, char *line, char *eol,
 		hit = !fixmatch(p, line, eol, match);
 	else if (p->pcre_regexp)
 		hit = !pcrematch(p, line, eol, match, eflags);
+	else if (p->pcre2_pattern)
+		hit = !pcre2match(p, line, eol, match, eflags);
 	else
 		hit = !regmatch(&p->regexp, line, eol, match, eflags);
 
@@ -1041,6 +1221,8 @@ static int match_line(struct grep_opt *opt, char *bol, char *eol,
 
 	/* we do not call with collect_hits without being extended */
 	for (p = opt->pattern_list; p; p = p->next) {
+		if (p->merged)
+			continue;
 		if (match_one_pattern(p, bol, eol, ctx, &match, 0))
 			return 1;
 	}
@@ -1077,6 +1259,8 @@ static int next_match(struct grep_opt *opt, char *bol, char *eol,
 	pmatch->rm_so = pmatch->rm_eo = -1;
 	if (bol < eol) {
 		for (p = opt->pattern_list; p; p = p->next) {
+			if (p->merged)
+				continue;
 			switch (p->token) {
 			case GREP_PATTERN: /* atom */
 			case GREP_PATTERN_HEAD:
@@ -1184,7 +1368,8 @@ static inline void grep_attr_unlock(void)
 }
 
 /*
- * Same as git_attr_mutex, but protecting the thread-unsafe object db access.
+ * Same as git_attr_mutex, but protecting the thread-unsafe textconv
+ * machinery.  Plain object reads are serialized by sha1_file.c itself.
  */
 pthread_mutex_t grep_read_mutex;
 
@@ -1313,6 +1498,8 @@ static int look_ahead(struct grep_opt *opt,
 		int hit;
 		regmatch_t m;
 
+		if (p->merged)
+			continue;
 		hit = patmatch(p, bol, bol + *left_p, &m, 0);
 		if (!hit || m.rm_so < 0 || m.rm_eo < 0)
 			continue;
@@ -1710,9 +1897,7 @@ static int grep_source_load_sha1(struct grep_source *gs)
 {
 	enum object_type type;
 
-	grep_read_lock();
 	gs->buf = read_sha1_file(gs->identifier, &type, &gs->size);
-	grep_read_unlock();
 
 	if (!gs->buf)
 		return error(_("'%s': unable to read %s"),
@@ -164,20 +164,35 @@ void *hashmap_get_next(const struct hashmap *map, const void *entry)
 	return NULL;
 }
 
-void hashmap_add(struct hashmap *map, void *entry)
+unsigned int hashmap_bucket(const struct hashmap *map, unsigned int hash)
+{
+	return hash & (map->tablesize - 1);
+}
+
+void hashmap_add_nogrow(struct hashmap *map, void *entry)
 {
 	unsigned int b = bucket(map, entry);
 
-	/* add entry */
 	((struct hashmap_entry *) entry)->next = map->table[b];
 	map->table[b] = entry;
+}
 
-	/* fix size and rehash if appropriate */
-	map->size++;
-	if (map->size > map->grow_at)
+void hashmap_adjust_size(struct hashmap *map, unsigned int added)
+{
+	map->size += added;
+	while (map->size > map->grow_at)
 		rehash(map, map->tablesize << HASHMAP_RESIZE_BITS);
 }
 
+void hashmap_add(struct hashmap *map, void *entry)
+{
+	/* add entry */
+	hashmap_add_nogrow(map, entry);
+
+	/* fix size and rehash if appropriate */
+	hashmap_adjust_size(map, 1);
+}
+
 void *hashmap_remove(struct hashmap *map, const void *key, const void *keydata)
 {
 	struct hashmap_entry *old;
@@ -64,6 +64,9 @@ extern void *hashmap_get(const struct hashmap *map, const void *key,
 		const void *keydata);
 extern void *hashmap_get_next(const struct hashmap *map, const void *entry);
 extern void hashmap_add(struct hashmap *map, void *entry);
+extern unsigned int hashmap_bucket(const struct hashmap *map, unsigned int hash);
+extern void hashmap_add_nogrow(struct hashmap *map, void *entry);
+extern void hashmap_adjust_size(struct hashmap *map, unsigned int added);
 extern void *hashmap_put(struct hashmap *map, void *entry);
 extern void *hashmap_remove(struct hashmap *map, const void *key,
 		const void *keydata);
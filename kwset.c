@@ -68,6 +68,26 @@ struct trie
   int maxshift;			/* Max shift of self and descendants. */
 };
 
+/* A keyword as it was given to kwsincr, after translation. */
+struct kwsword
+{
+  struct kwsword *next;
+  size_t len;
+  unsigned char text[FLEX_ARRAY];
+};
+
+/* Use a forward Aho-Corasick automaton instead of the Commentz-Walter
+   search once a set has this many keywords: the shifts the latter
+   relies on shrink towards 1 as keywords are added, while the former
+   looks at each byte of the text exactly once regardless of the size
+   of the set.  GIT_TEST_KWSET_AC_MIN_WORDS overrides this, so that tests
+   and perf scripts can run either matcher on the same set. */
+#define AC_MIN_WORDS 8
+
+/* Upper bound on the number of entries in the automaton's transition
+   table; larger sets fall back to Commentz-Walter. */
+#define AC_MAX_TABLE (1 << 24)
+
 /* Structure returned opaquely to the caller, containing everything. */
 struct kwset
 {
@@ -81,6 +101,12 @@ struct kwset
   char *target;			/* Target string if there's only one. */
   int mind2;			/* Used in Boyer-Moore search for one string. */
   unsigned char const *trans;  /* Character translation table. */
+  struct kwsword *wordlist;	/* Keywords, most recently added first. */
+  int *ac_trans;		/* Aho-Corasick transitions, or NULL. */
+  int *ac_outlen;		/* Length of the longest match per state. */
+  int *ac_outidx;		/* Index of that keyword. */
+  int ac_nclass;		/* Number of byte classes. */
+  unsigned char ac_class[NCHAR];	/* Byte class of each character. */
 };
 
 /* Allocate and initialize a keyword set object, returning an opaque
@@ -112,6 +138,10 @@ kwsalloc (unsigned char const *trans)
   kwset->maxd = -1;
   kwset->target = NULL;
   kwset->trans = trans;
+  kwset->wordlist = NULL;
+  kwset->ac_trans = NULL;
+  kwset->ac_outlen = NULL;
+  kwset->ac_outidx = NULL;
 
   return (kwset_t) kwset;
 }
@@ -133,9 +163,23 @@ kwsincr (kwset_t kws, char const *text, size_t len)
   struct tree *links[DEPTH_SIZE];
   enum { L, R } dirs[DEPTH_SIZE];
   struct tree *t, *r, *l, *rl, *lr;
+  struct kwsword *word;
+  size_t i;
 
   kwset = (struct kwset *) kws;
   trie = kwset->trie;
+
+  /* Remember the keyword in reading order, in case kwsprep decides
+     to build an Aho-Corasick automaton. */
+  word = obstack_alloc(&kwset->obstack, sizeof (struct kwsword) + len);
+  if (!word)
+    return "memory exhausted";
+  word->len = len;
+  for (i = 0; i < len; i++)
+    word->text[i] = kwset->trans ? kwset->trans[U(text[i])] : U(text[i]);
+  word->next = kwset->wordlist;
+  kwset->wordlist = word;
+
   text += len;
 
   /* Descend the trie (built of reversed keywords) character-by-character,
@@ -373,6 +417,111 @@ treenext (struct tree const *tree, struct trie *next[])
   next[tree->label] = tree->trie;
 }
 
+/* Build a forward Aho-Corasick automaton with a full transition table
+   for the keywords of KWSET.  Bytes that appear in no keyword share a
+   single class, which keeps the table small for the usual sets of
+   identifiers.  Leave kwset->ac_trans NULL if the table would be too
+   large. */
+static void
+acprep (struct kwset *kwset)
+{
+  struct kwsword const *word;
+  unsigned char classof[NCHAR];
+  size_t total = 1, k;
+  int nclass = 1, nstates = 1, s, c, i, head, tail;
+  int *trans, *outlen, *outidx, *fail, *queue;
+  unsigned char const *tr = kwset->trans;
+
+  /* Byte classes; class 0 is for bytes in no keyword. */
+  memset(classof, 0, sizeof(classof));
+  for (word = kwset->wordlist; word; word = word->next)
+    {
+      total += word->len;
+      for (k = 0; k < word->len; k++)
+	if (!classof[word->text[k]])
+	  classof[word->text[k]] = nclass++;
+    }
+  if (total > AC_MAX_TABLE / nclass)
+    return;
+
+  trans = xmalloc(st_mult(total * nclass, sizeof(int)));
+  outlen = xcalloc(total, sizeof(int));
+  outidx = xcalloc(total, sizeof(int));
+  for (c = 0; c < nclass; c++)
+    trans[c] = -1;
+
+  /* Insert the keywords into a forward trie; the list is newest first,
+     so walk it backwards through the index to keep the first index of
+     a duplicated keyword. */
+  i = kwset->words;
+  for (word = kwset->wordlist; word; word = word->next)
+    {
+      i--;
+      for (s = 0, k = 0; k < word->len; k++)
+	{
+	  int *slot = &trans[s * nclass + classof[word->text[k]]];
+	  if (*slot < 0)
+	    {
+	      *slot = nstates;
+	      for (c = 0; c < nclass; c++)
+		trans[nstates * nclass + c] = -1;
+	      nstates++;
+	    }
+	  s = *slot;
+	}
+      outlen[s] = word->len;
+      outidx[s] = i;
+    }
+
+  /* Fill in the failure transitions in breadth-first order, so that
+     the row of the failure state of a node is complete before the
+     node's own row is looked at. */
+  fail = xcalloc(nstates, sizeof(int));
+  queue = xmalloc(st_mult(nstates, sizeof(int)));
+  head = tail = 0;
+  for (c = 0; c < nclass; c++)
+    {
+      int t = trans[c];
+      if (t < 0)
+	trans[c] = 0;
+      else
+	{
+	  fail[t] = 0;
+	  queue[tail++] = t;
+	}
+    }
+  while (head < tail)
+    {
+      s = queue[head++];
+      for (c = 0; c < nclass; c++)
+	{
+	  int t = trans[s * nclass + c];
+	  int f = trans[fail[s] * nclass + c];
+	  if (t < 0)
+	    trans[s * nclass + c] = f;
+	  else
+	    {
+	      fail[t] = f;
+	      if (!outlen[t])
+		{
+		  outlen[t] = outlen[f];
+		  outidx[t] = outidx[f];
+		}
+	      queue[tail++] = t;
+	    }
+	}
+    }
+  free(queue);
+  free(fail);
+
+  kwset->ac_trans = xrealloc(trans, st_mult(nstates * nclass, sizeof(int)));
+  kwset->ac_outlen = xrealloc(outlen, st_mult(nstates, sizeof(int)));
+  kwset->ac_outidx = xrealloc(outidx, st_mult(nstates, sizeof(int)));
+  kwset->ac_nclass = nclass;
+  for (c = 0; c < NCHAR; c++)
+    kwset->ac_class[c] = classof[tr ? tr[c] : c];
+}
+
 /* Compute the shift for each trie node, as well as the delta
    table and next cache for the given keyword set. */
 const char *
@@ -487,6 +636,10 @@ kwsprep (kwset_t kws)
   else
     memcpy(kwset->delta, delta, NCHAR);
 
+  if (kwset->words >= git_env_ulong("GIT_TEST_KWSET_AC_MIN_WORDS",
+				    AC_MIN_WORDS) && kwset->mind > 0)
+    acprep(kwset);
+
   return NULL;
 }
 
@@ -732,6 +885,48 @@ cwexec (kwset_t kws, char const *text, size_t len, struct kwsmatch *kwsmatch)
   return mch - text;
 }
 
+/* Aho-Corasick search.  The automaton reports the longest keyword
+   ending at each position; keep scanning past the first report until
+   no keyword starting at or before the leftmost start found so far
+   could still end, so that the result is the leftmost longest match
+   like the other searches return. */
+static size_t
+acexec (kwset_t kws, char const *text, size_t len, struct kwsmatch *kwsmatch)
+{
+  struct kwset const *kwset = (struct kwset *) kws;
+  int const *trans = kwset->ac_trans;
+  int const *outlen = kwset->ac_outlen;
+  unsigned char const *class = kwset->ac_class;
+  int nclass = kwset->ac_nclass;
+  size_t i, limit = len, best = -1, bestlen = 0;
+  int s = 0, bestidx = 0;
+
+  for (i = 0; i < limit; i++)
+    {
+      s = trans[s * nclass + class[U(text[i])]];
+      if (outlen[s])
+	{
+	  size_t start = i + 1 - outlen[s];
+	  if (best == (size_t) -1 || start <= best)
+	    {
+	      best = start;
+	      bestlen = outlen[s];
+	      bestidx = kwset->ac_outidx[s];
+	      if (best + kwset->maxd < limit)
+		limit = best + kwset->maxd;
+	    }
+	}
+    }
+
+  if (best != (size_t) -1 && kwsmatch)
+    {
+      kwsmatch->index = bestidx;
+      kwsmatch->offset[0] = best;
+      kwsmatch->size[0] = bestlen;
+    }
+  return best;
+}
+
 /* Search through the given text for a match of any member of the
    given keyword set.  Return a pointer to the first character of
    the matching substring, or NULL if no match is found.  If FOUNDLEN
@@ -755,6 +950,8 @@ kwsexec (kwset_t kws, char const *text, size_t size,
 	}
       return ret;
     }
+  else if (kwset->ac_trans)
+    return acexec(kws, text, size, kwsmatch);
   else
     return cwexec(kws, text, size, kwsmatch);
 }
@@ -766,6 +963,9 @@ kwsfree (kwset_t kws)
   struct kwset *kwset;
 
   kwset = (struct kwset *) kws;
+  free(kwset->ac_trans);
+  free(kwset->ac_outlen);
+  free(kwset->ac_outidx);
   obstack_free(&kwset->obstack, NULL);
   free(kws);
 }
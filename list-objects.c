@@ -7,6 +7,334 @@
 #include "tree-walk.h"
 #include "revision.h"
 #include "list-objects.h"
+#include "thread-utils.h"
+
+#ifndef NO_PTHREADS
+/*
+ * Reading trees ahead on worker threads.
+ *
+ * The main thread still walks the trees in the usual order and makes
+ * all the callbacks itself, so what the callers see does not change.
+ * Whenever it opens a tree, it hands the subtrees it is about to visit
+ * to the workers, which read and inflate them in the meantime; by the
+ * time the main thread gets to such a subtree, its buffer is usually
+ * waiting for it.  The "entries" map doubles as the set of trees that
+ * have already been handed out, so no tree is read twice.
+ */
+enum prefetch_state {
+	PREFETCH_QUEUED,
+	PREFETCH_READING,
+	PREFETCH_DONE,
+	PREFETCH_CLAIMED
+};
+
+struct prefetch_entry {
+	struct hashmap_entry ent;
+	struct prefetch_entry *next; /* on the work stack */
+	unsigned char sha1[20];
+	enum prefetch_state state;
+	void *buffer;
+	unsigned long size;
+};
+
+/* how many trees each worker may have in flight or waiting to be used */
+#define PREFETCH_PER_THREAD 64
+
+static struct tree_prefetch {
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_work;
+	pthread_cond_t cond_done;
+	struct hashmap entries;
+	struct prefetch_entry *stack;
+	int outstanding;
+	int shutdown;
+	struct tree **todo;
+	int todo_nr, todo_alloc;
+} *prefetch;
+
+static int prefetch_entry_cmp(const struct prefetch_entry *a,
+			      const struct prefetch_entry *b,
+			      const void *unused)
+{
+	return hashcmp(a->sha1, b->sha1);
+}
+
+static void *prefetch_worker(void *data)
+{
+	struct tree_prefetch *pf = data;
+
+	pthread_mutex_lock(&pf->mutex);
+	for (;;) {
+		struct prefetch_entry *e;
+		enum object_type type;
+		unsigned long size;
+		void *buffer;
+
+		while (!pf->stack && !pf->shutdown)
+			pthread_cond_wait(&pf->cond_work, &pf->mutex);
+		if (pf->shutdown)
+			break;
+
+		e = pf->stack;
+		pf->stack = e->next;
+		if (e->state == PREFETCH_CLAIMED) {
+			free(e);
+			continue;
+		}
+		e->state = PREFETCH_READING;
+		pthread_mutex_unlock(&pf->mutex);
+
+		buffer = read_sha1_file(e->sha1, &type, &size);
+		if (buffer && type != OBJ_TREE) {
+			free(buffer);
+			buffer = NULL;
+		}
+
+		pthread_mutex_lock(&pf->mutex);
+		e->buffer = buffer;
+		e->size = size;
+		e->state = PREFETCH_DONE;
+		pthread_cond_broadcast(&pf->cond_done);
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	return NULL;
+}
+
+static void start_prefetch(int nr_threads)
+{
+	struct tree_prefetch *pf = xcalloc(1, sizeof(*pf));
+	int i;
+
+	pthread_mutex_init(&pf->mutex, NULL);
+	pthread_cond_init(&pf->cond_work, NULL);
+	pthread_cond_init(&pf->cond_done, NULL);
+	hashmap_init(&pf->entries, (hashmap_cmp_fn) prefetch_entry_cmp, 0);
+	enable_obj_read_lock();
+
+	pf->threads = xcalloc(nr_threads, sizeof(*pf->threads));
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&pf->threads[i], NULL, prefetch_worker, pf)) {
+			warning("unable to create tree reading thread");
+			break;
+		}
+	}
+	pf->nr_threads = i;
+	prefetch = pf;
+}
+
+static void stop_prefetch(void)
+{
+	struct tree_prefetch *pf = prefetch;
+	struct hashmap_iter iter;
+	struct prefetch_entry *e;
+	int i;
+
+	if (!pf)
+		return;
+	prefetch = NULL;
+
+	pthread_mutex_lock(&pf->mutex);
+	pf->shutdown = 1;
+	pthread_cond_broadcast(&pf->cond_work);
+	pthread_mutex_unlock(&pf->mutex);
+	for (i = 0; i < pf->nr_threads; i++)
+		pthread_join(pf->threads[i], NULL);
+
+	/* queued entries are still in the map; claimed ones are not */
+	while ((e = pf->stack)) {
+		pf->stack = e->next;
+		if (e->state == PREFETCH_CLAIMED)
+			free(e);
+	}
+	hashmap_iter_init(&pf->entries, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free(e->buffer);
+	hashmap_free(&pf->entries, 1);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&pf->cond_done);
+	pthread_cond_destroy(&pf->cond_work);
+	pthread_mutex_destroy(&pf->mutex);
+	free(pf->todo);
+	free(pf->threads);
+	free(pf);
+}
+
+static void prefetch_add_todo(struct tree_prefetch *pf, struct tree *tree)
+{
+	if (!tree || tree->object.parsed ||
+	    (tree->object.flags & (UNINTERESTING | SEEN)))
+		return;
+	ALLOC_GROW(pf->todo, pf->todo_nr + 1, pf->todo_alloc);
+	pf->todo[pf->todo_nr++] = tree;
+}
+
+/*
+ * Hand the trees collected by prefetch_add_todo() to the workers.  They
+ * are pushed in reverse, so that the first one is read first.
+ */
+static void prefetch_flush_todo(struct tree_prefetch *pf)
+{
+	int i, limit = pf->nr_threads * PREFETCH_PER_THREAD;
+
+	pthread_mutex_lock(&pf->mutex);
+	if (pf->todo_nr > limit - pf->outstanding)
+		pf->todo_nr = pf->outstanding < limit ? limit - pf->outstanding : 0;
+	for (i = pf->todo_nr - 1; i >= 0; i--) {
+		struct prefetch_entry *e = xcalloc(1, sizeof(*e));
+
+		hashcpy(e->sha1, pf->todo[i]->object.oid.hash);
+		hashmap_entry_init(e, sha1hash(e->sha1));
+		if (hashmap_get(&pf->entries, e, NULL)) {
+			free(e);
+			continue;
+		}
+		e->state = PREFETCH_QUEUED;
+		hashmap_add(&pf->entries, e);
+		e->next = pf->stack;
+		pf->stack = e;
+		pf->outstanding++;
+	}
+	if (pf->todo_nr > 0)
+		pthread_cond_broadcast(&pf->cond_work);
+	pthread_mutex_unlock(&pf->mutex);
+	pf->todo_nr = 0;
+}
+
+static void prefetch_subtrees(struct tree *tree)
+{
+	struct tree_prefetch *pf = prefetch;
+	struct tree_desc desc;
+	struct name_entry entry;
+
+	if (!pf || !pf->nr_threads)
+		return;
+
+	init_tree_desc(&desc, tree->buffer, tree->size);
+	while (tree_entry(&desc, &entry))
+		if (S_ISDIR(entry.mode))
+			prefetch_add_todo(pf, lookup_tree(entry.sha1));
+	prefetch_flush_todo(pf);
+}
+
+/*
+ * Take the entry for "tree" out of the map, waiting for a worker that
+ * is reading it.  Return it if it has been read; one that has not been
+ * started yet is left for the worker to free.
+ */
+static struct prefetch_entry *claim_prefetched(struct tree_prefetch *pf,
+					       struct tree *tree)
+{
+	struct prefetch_entry key, *e;
+
+	hashcpy(key.sha1, tree->object.oid.hash);
+	hashmap_entry_init(&key, sha1hash(key.sha1));
+
+	pthread_mutex_lock(&pf->mutex);
+	e = hashmap_get(&pf->entries, &key, NULL);
+	if (e) {
+		while (e->state == PREFETCH_READING)
+			pthread_cond_wait(&pf->cond_done, &pf->mutex);
+		hashmap_remove(&pf->entries, e, NULL);
+		pf->outstanding--;
+		if (e->state == PREFETCH_QUEUED) {
+			/* not started yet; the worker frees it */
+			e->state = PREFETCH_CLAIMED;
+			e = NULL;
+		}
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	return e;
+}
+
+/*
+ * Like parse_tree_gently(), but use the buffer a worker has read for
+ * us, if there is one.
+ */
+static int parse_tree_prefetched(struct tree *tree, int quiet_on_missing)
+{
+	struct tree_prefetch *pf = prefetch;
+	struct prefetch_entry *e;
+	void *buffer;
+	unsigned long size;
+
+	if (!pf)
+		return parse_tree_gently(tree, quiet_on_missing);
+
+	e = claim_prefetched(pf, tree);
+	if (tree->object.parsed) {
+		/*
+		 * Parsed some other way after it was handed out; drop the
+		 * worker's copy so that it does not count against the
+		 * trees in flight forever.
+		 */
+		if (e) {
+			free(e->buffer);
+			free(e);
+		}
+		return 0;
+	}
+	if (!e)
+		return parse_tree_gently(tree, quiet_on_missing);
+
+	buffer = e->buffer;
+	size = e->size;
+	free(e);
+	if (!buffer)
+		/* let the usual code path report the problem */
+		return parse_tree_gently(tree, quiet_on_missing);
+	return parse_tree_buffer(tree, buffer, size);
+}
+
+/* how many of the pending root trees to hand to the workers at once */
+#define PREFETCH_PENDING_BATCH 16
+
+/*
+ * Hand the next few pending trees, starting at "from", to the workers
+ * and return the index at which to do so again.
+ */
+static int prefetch_pending_trees(struct rev_info *revs, int from)
+{
+	struct tree_prefetch *pf = prefetch;
+	int i, end = from + PREFETCH_PENDING_BATCH;
+
+	if (!pf || !pf->nr_threads)
+		return revs->pending.nr;
+	if (end > revs->pending.nr)
+		end = revs->pending.nr;
+	for (i = from; i < end; i++) {
+		struct object *obj = revs->pending.objects[i].item;
+		if (obj->type == OBJ_TREE)
+			prefetch_add_todo(pf, (struct tree *)obj);
+	}
+	prefetch_flush_todo(pf);
+	return end;
+}
+#else
+static void start_prefetch(int nr_threads)
+{
+}
+
+static void stop_prefetch(void)
+{
+}
+
+static void prefetch_subtrees(struct tree *tree)
+{
+}
+
+static int parse_tree_prefetched(struct tree *tree, int quiet_on_missing)
+{
+	return parse_tree_gently(tree, quiet_on_missing);
+}
+
+static int prefetch_pending_trees(struct rev_info *revs, int from)
+{
+	return revs->pending.nr;
+}
+#endif
 
 static void process_blob(struct rev_info *revs,
 			 struct blob *blob,
@@ -84,7 +412,7 @@ static void process_tree(struct rev_info *revs,
 		die("bad tree object");
 	if (obj->flags & (UNINTERESTING | SEEN))
 		return;
-	if (parse_tree_gently(tree, revs->ignore_missing_links) < 0) {
+	if (parse_tree_prefetched(tree, revs->ignore_missing_links) < 0) {
 		if (revs->ignore_missing_links)
 			return;
 		die("bad tree object %s", oid_to_hex(&obj->oid));
@@ -96,6 +424,7 @@ static void process_tree(struct rev_info *revs,
 	if (base->len)
 		strbuf_addch(base, '/');
 
+	prefetch_subtrees(tree);
 	init_tree_desc(&desc, tree->buffer, tree->size);
 
 	while (tree_entry(&desc, &entry)) {
@@ -188,7 +517,7 @@ void traverse_commit_list(struct rev_info *revs,
 			  show_object_fn show_object,
 			  void *data)
 {
-	int i;
+	int i, next_prefetch = 0;
 	struct commit *commit;
 	struct strbuf base;
 
@@ -202,11 +531,22 @@ void traverse_commit_list(struct rev_info *revs,
 			add_pending_tree(revs, commit->tree);
 		show_commit(commit, data);
 	}
+
+	/*
+	 * Reading ahead is only safe when every subtree that is handed to
+	 * the workers is going to be visited, i.e. without a pathspec.
+	 */
+	if (revs->traverse_threads > 1 && revs->tree_objects &&
+	    !revs->diffopt.pathspec.nr)
+		start_prefetch(revs->traverse_threads);
+
 	for (i = 0; i < revs->pending.nr; i++) {
 		struct object_array_entry *pending = revs->pending.objects + i;
 		struct object *obj = pending->item;
 		const char *name = pending->name;
 		const char *path = pending->path;
+		if (i == next_prefetch)
+			next_prefetch = prefetch_pending_trees(revs, i);
 		if (obj->flags & (UNINTERESTING | SEEN))
 			continue;
 		if (obj->type == OBJ_TAG) {
@@ -229,6 +569,7 @@ void traverse_commit_list(struct rev_info *revs,
 		die("unknown pending object %s (%s)",
 		    oid_to_hex(&obj->oid), name);
 	}
+	stop_prefetch();
 	object_array_clear(&revs->pending);
 	strbuf_release(&base);
 }
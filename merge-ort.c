@@ -0,0 +1,1101 @@
+/*
+ * A three-way merge of trees that is done entirely in memory.
+ *
+ * Unlike merge-recursive.c, which reads all three trees into the index
+ * and updates the index and the working tree as it resolves each
+ * path, this only looks at the paths that changed on either side (as
+ * found by diffing the trees), writes the merged blobs and trees to
+ * the object database, and leaves it to merge_ort_checkout() to bring
+ * the index and the working tree up to date in a single pass.
+ */
+#include "cache.h"
+#include "lockfile.h"
+#include "commit.h"
+#include "blob.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "unpack-trees.h"
+#include "xdiff-interface.h"
+#include "ll-merge.h"
+#include "submodule.h"
+#include "tag.h"
+#include "merge-ort.h"
+
+struct version {
+	unsigned mode; /* 0 if the path does not exist */
+	unsigned char sha1[20];
+};
+
+/*
+ * A path that was changed on at least one side.  stages[1] is the
+ * common ancestor's version, stages[2] ours and stages[3] theirs,
+ * like the stages of an unmerged index entry.
+ */
+struct merge_entry {
+	struct version stages[4];
+	struct version result;
+	/* what "head" has at the path, even if it moved stages[2] away */
+	struct version ours;
+	unsigned changed; /* (1 << stage) if changed on that side */
+	/* set when the entry is the destination of a rename */
+	const char *renamed_from;
+	int rename_stage;
+	/* set when the same path was renamed differently on the other side */
+	const char *other_rename;
+	char *moved_to;
+	unsigned conflict:1;
+};
+
+/* the paths changed on either side, with a struct merge_entry as util */
+struct merge_state {
+	struct merge_options *o;
+	struct tree *head, *merge;
+	struct string_list entries;
+	struct string_list renames[4];
+	struct merge_result *result;
+};
+
+static int show(struct merge_options *o, int v)
+{
+	return (!o->call_depth && o->verbosity >= v) || o->verbosity >= 5;
+}
+
+static void flush_output(struct merge_options *o)
+{
+	if (o->obuf.len) {
+		fputs(o->obuf.buf, stdout);
+		strbuf_reset(&o->obuf);
+	}
+}
+
+__attribute__((format (printf, 3, 4)))
+static void output(struct merge_options *o, int v, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show(o, v))
+		return;
+
+	strbuf_addchars(&o->obuf, ' ', o->call_depth * 2);
+
+	va_start(ap, fmt);
+	strbuf_vaddf(&o->obuf, fmt, ap);
+	va_end(ap);
+
+	strbuf_addch(&o->obuf, '\n');
+	if (!o->buffer_output)
+		flush_output(o);
+}
+
+static int same_version(const struct version *a, const struct version *b)
+{
+	if (!a->mode || !b->mode)
+		return a->mode == b->mode;
+	return a->mode == b->mode && !hashcmp(a->sha1, b->sha1);
+}
+
+static void set_version(struct version *v, const struct diff_filespec *spec)
+{
+	if (DIFF_FILE_VALID(spec)) {
+		v->mode = spec->mode;
+		hashcpy(v->sha1, spec->sha1);
+	} else {
+		v->mode = 0;
+		hashclr(v->sha1);
+	}
+}
+
+static struct merge_entry *get_entry(struct merge_state *ms, const char *path)
+{
+	struct string_list_item *item = string_list_insert(&ms->entries, path);
+
+	if (!item->util)
+		item->util = xcalloc(1, sizeof(struct merge_entry));
+	return item->util;
+}
+
+static struct merge_entry *find_entry(struct merge_state *ms, const char *path)
+{
+	struct string_list_item *item = string_list_lookup(&ms->entries, path);
+	return item ? item->util : NULL;
+}
+
+/* Record the paths that changed between "common" and "side" */
+static void collect_changes(struct merge_state *ms, struct tree *common,
+			    struct tree *side, int stage)
+{
+	struct diff_options opts;
+	int i;
+
+	diff_setup(&opts);
+	DIFF_OPT_SET(&opts, RECURSIVE);
+	opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&opts);
+	diff_tree_sha1(common->object.oid.hash, side->object.oid.hash, "", &opts);
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *p = diff_queued_diff.queue[i];
+		struct merge_entry *e = get_entry(ms, p->one->path);
+
+		set_version(&e->stages[1], p->one);
+		set_version(&e->stages[stage], p->two);
+		e->changed |= 1 << stage;
+	}
+	diff_flush(&opts);
+}
+
+static struct diff_filespec *filespec_from_version(const char *path,
+						   const struct version *v)
+{
+	struct diff_filespec *spec = alloc_filespec(path);
+
+	if (v->mode)
+		fill_filespec(spec, v->sha1, 1, v->mode);
+	return spec;
+}
+
+/*
+ * Find the renames on the side "stage".  A rename only matters if the
+ * other side changed the path it was renamed from; otherwise taking
+ * the deletion and the addition from this side gives the same result.
+ * Nothing is done if there is no such deletion.  Otherwise all the
+ * deletions and additions of this side are given to rename detection,
+ * so that each addition is paired with its best source, and only the
+ * renames from a path the other side changed are kept.
+ */
+static void detect_renames(struct merge_state *ms, int stage)
+{
+	struct merge_options *o = ms->o;
+	int other = stage ^ 1;
+	struct diff_options opts;
+	int i, sources = 0;
+
+	for (i = 0; i < ms->entries.nr; i++) {
+		struct merge_entry *e = ms->entries.items[i].util;
+		if ((e->changed & (1 << stage)) && (e->changed & (1 << other)) &&
+		    e->stages[1].mode && !e->stages[stage].mode)
+			sources++;
+	}
+	if (!sources)
+		return;
+
+	diff_setup(&opts);
+	DIFF_OPT_SET(&opts, RECURSIVE);
+	DIFF_OPT_CLR(&opts, RENAME_EMPTY);
+	opts.detect_rename = DIFF_DETECT_RENAME;
+	opts.rename_limit = o->merge_rename_limit >= 0 ? o->merge_rename_limit :
+			    o->diff_rename_limit >= 0 ? o->diff_rename_limit :
+			    1000;
+	opts.rename_score = o->rename_score;
+	opts.show_rename_progress = o->show_rename_progress;
+	opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&opts);
+
+	for (i = 0; i < ms->entries.nr; i++) {
+		const char *path = ms->entries.items[i].string;
+		struct merge_entry *e = ms->entries.items[i].util;
+		struct version none = { 0 };
+
+		if (!(e->changed & (1 << stage)))
+			continue;
+		if (e->stages[1].mode && !e->stages[stage].mode) {
+			diff_queue(&diff_queued_diff,
+				   filespec_from_version(path, &e->stages[1]),
+				   filespec_from_version(path, &none));
+		} else if (!e->stages[1].mode && e->stages[stage].mode) {
+			diff_queue(&diff_queued_diff,
+				   filespec_from_version(path, &none),
+				   filespec_from_version(path, &e->stages[stage]));
+		}
+	}
+	diffcore_std(&opts);
+	if (opts.needed_rename_limit > o->needed_rename_limit)
+		o->needed_rename_limit = opts.needed_rename_limit;
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *p = diff_queued_diff.queue[i];
+		struct merge_entry *e;
+
+		if (p->status != 'R')
+			continue;
+		e = find_entry(ms, p->one->path);
+		if (e->changed & (1 << other))
+			string_list_insert(&ms->renames[stage], p->one->path)->util =
+				xstrdup(p->two->path);
+	}
+	diff_flush(&opts);
+}
+
+/*
+ * Move what the other side did to the source of each rename on the
+ * side "stage" over to its destination, so that resolving the
+ * destination merges the changes of both sides.
+ */
+static void apply_renames(struct merge_state *ms, int stage)
+{
+	int other = stage ^ 1;
+	int i;
+
+	for (i = 0; i < ms->renames[stage].nr; i++) {
+		const char *src = ms->renames[stage].items[i].string;
+		const char *dst = ms->renames[stage].items[i].util;
+		struct string_list_item *item;
+		struct merge_entry *a = find_entry(ms, src);
+		struct merge_entry *b = find_entry(ms, dst);
+
+		if (!a || !b)
+			die("BUG: rename of untracked path %s", src);
+		item = string_list_lookup(&ms->renames[other], src);
+		if (item && !strcmp(item->util, dst)) {
+			/* renamed the same way on both sides */
+			if (stage == 2) {
+				b->stages[1] = a->stages[1];
+				b->renamed_from = src;
+				b->rename_stage = stage;
+			}
+			continue;
+		}
+		if (b->stages[other].mode)
+			/*
+			 * The other side has something else at the
+			 * destination; leave it to the add/add and
+			 * modify/delete handling to keep both.
+			 */
+			continue;
+		b->stages[1] = a->stages[1];
+		b->renamed_from = src;
+		b->rename_stage = stage;
+		if (item) {
+			/* renamed differently on the other side */
+			b->other_rename = item->util;
+			continue;
+		}
+		b->stages[other] = a->stages[other];
+		a->stages[other].mode = 0;
+		hashclr(a->stages[other].sha1);
+	}
+}
+
+static void add_conflict(struct merge_state *ms, const char *path,
+			 struct merge_entry *e)
+{
+	struct merge_conflict *c = xcalloc(1, sizeof(*c));
+	int i;
+
+	for (i = 1; i < 4; i++) {
+		c->stages[i].mode = e->stages[i].mode;
+		hashcpy(c->stages[i].sha1, e->stages[i].sha1);
+	}
+	if (e->moved_to)
+		c->moved_to = xstrdup(e->moved_to);
+	string_list_insert(&ms->result->conflicts, path)->util = c;
+	e->conflict = 1;
+	ms->result->clean = 0;
+}
+
+/* The path each side has the contents of "e" at, for conflict markers */
+static const char *side_path(const char *path, struct merge_entry *e, int stage)
+{
+	if (e->renamed_from && e->rename_stage != stage && !e->other_rename)
+		return e->renamed_from;
+	return path;
+}
+
+static int merge_blobs(struct merge_state *ms, const char *path,
+		       struct merge_entry *e, unsigned char *result_sha1)
+{
+	struct merge_options *o = ms->o;
+	const char *path1 = side_path(path, e, 2);
+	const char *path2 = side_path(path, e, 3);
+	mmfile_t orig, src1, src2;
+	mmbuffer_t result_buf;
+	struct ll_merge_options ll_opts = {0};
+	char *base_name, *name1, *name2;
+	int merge_status;
+
+	ll_opts.renormalize = o->renormalize;
+	ll_opts.xdl_opts = o->xdl_opts;
+
+	if (o->call_depth) {
+		ll_opts.virtual_ancestor = 1;
+		ll_opts.variant = 0;
+	} else {
+		switch (o->recursive_variant) {
+		case MERGE_RECURSIVE_OURS:
+			ll_opts.variant = XDL_MERGE_FAVOR_OURS;
+			break;
+		case MERGE_RECURSIVE_THEIRS:
+			ll_opts.variant = XDL_MERGE_FAVOR_THEIRS;
+			break;
+		default:
+			ll_opts.variant = 0;
+			break;
+		}
+	}
+
+	if (strcmp(path1, path2)) {
+		base_name = o->ancestor == NULL ? NULL :
+			xstrfmt("%s:%s", o->ancestor, e->renamed_from);
+		name1 = xstrfmt("%s:%s", o->branch1, path1);
+		name2 = xstrfmt("%s:%s", o->branch2, path2);
+	} else {
+		base_name = o->ancestor == NULL ? NULL : xstrdup(o->ancestor);
+		name1 = xstrdup(o->branch1);
+		name2 = xstrdup(o->branch2);
+	}
+
+	read_mmblob(&orig, e->stages[1].mode ? e->stages[1].sha1 : null_sha1);
+	read_mmblob(&src1, e->stages[2].sha1);
+	read_mmblob(&src2, e->stages[3].sha1);
+
+	merge_status = ll_merge(&result_buf, path, &orig, base_name,
+				&src1, name1, &src2, name2, &ll_opts);
+	if (merge_status < 0 || !result_buf.ptr)
+		die(_("Failed to execute internal merge"));
+	if (write_sha1_file(result_buf.ptr, result_buf.size,
+			    blob_type, result_sha1))
+		die(_("Unable to add %s to database"), path);
+
+	free(result_buf.ptr);
+	free(base_name);
+	free(name1);
+	free(name2);
+	free(orig.ptr);
+	free(src1.ptr);
+	free(src2.ptr);
+	return merge_status;
+}
+
+/*
+ * Both sides changed the path and both still have it: merge the
+ * contents and the modes, like merge_file_1() in merge-recursive.c.
+ */
+static int merge_content(struct merge_state *ms, const char *path,
+			 struct merge_entry *e)
+{
+	struct merge_options *o = ms->o;
+	struct version *one = &e->stages[1];
+	struct version *a = &e->stages[2];
+	struct version *b = &e->stages[3];
+	struct version *res = &e->result;
+	const char *reason = one->mode ? _("content") : _("add/add");
+	int clean = 1;
+
+	if ((S_IFMT & a->mode) != (S_IFMT & b->mode)) {
+		*res = S_ISREG(a->mode) ? *a : *b;
+		clean = 0;
+	} else {
+		if (a->mode == b->mode || a->mode == one->mode)
+			res->mode = b->mode;
+		else {
+			res->mode = a->mode;
+			if (b->mode != one->mode)
+				clean = 0;
+		}
+
+		if (!hashcmp(a->sha1, b->sha1) ||
+		    (one->mode && !hashcmp(a->sha1, one->sha1)))
+			hashcpy(res->sha1, b->sha1);
+		else if (one->mode && !hashcmp(b->sha1, one->sha1))
+			hashcpy(res->sha1, a->sha1);
+		else if (S_ISREG(a->mode)) {
+			output(o, 2, _("Auto-merging %s"), path);
+			if (merge_blobs(ms, path, e, res->sha1))
+				clean = 0;
+		} else if (S_ISGITLINK(a->mode)) {
+			reason = _("submodule");
+			if (!merge_submodule(res->sha1, path,
+					     one->mode ? one->sha1 : null_sha1,
+					     a->sha1, b->sha1, !o->call_depth))
+				clean = 0;
+		} else if (S_ISLNK(a->mode)) {
+			hashcpy(res->sha1, a->sha1);
+			clean = 0;
+		} else
+			die(_("unsupported object type in the tree"));
+	}
+
+	if (!clean)
+		output(o, 1, _("CONFLICT (%s): Merge conflict in %s"),
+		       reason, path);
+	return clean;
+}
+
+/* One side deleted (or renamed away) what the other side changed */
+static void handle_change_delete(struct merge_state *ms, const char *path,
+				 struct merge_entry *e)
+{
+	struct merge_options *o = ms->o;
+	int kept = e->stages[2].mode ? 2 : 3;
+	const char *kept_branch = kept == 2 ? o->branch1 : o->branch2;
+	const char *other_branch = kept == 2 ? o->branch2 : o->branch1;
+
+	if (e->other_rename)
+		output(o, 1, _("CONFLICT (rename/rename): "
+		       "Rename \"%s\"->\"%s\" in branch \"%s\" "
+		       "rename \"%s\"->\"%s\" in \"%s\"%s"),
+		       e->renamed_from, path, kept_branch,
+		       e->renamed_from, e->other_rename, other_branch,
+		       o->call_depth ? _(" (left unresolved)") : "");
+	else if (e->renamed_from)
+		output(o, 1, _("CONFLICT (rename/delete): %s deleted in %s "
+		       "and renamed to %s in %s. Version %s of %s left in tree."),
+		       e->renamed_from, other_branch, path, kept_branch,
+		       kept_branch, path);
+	else
+		output(o, 1, _("CONFLICT (%s/delete): %s deleted in %s "
+		       "and %s in %s. Version %s of %s left in tree."),
+		       _("modify"), path, other_branch, _("modified"),
+		       kept_branch, kept_branch, path);
+
+	/*
+	 * We cannot arbitrarily accept either side as correct for a
+	 * virtual merge base; reuse the original version.
+	 */
+	if (o->call_depth)
+		e->result = e->stages[1];
+	else
+		e->result = e->stages[kept];
+}
+
+static void process_entry(struct merge_state *ms, const char *path,
+			  struct merge_entry *e)
+{
+	struct merge_options *o = ms->o;
+	struct version *one = &e->stages[1];
+	struct version *a = &e->stages[2];
+	struct version *b = &e->stages[3];
+
+	if (e->other_rename) {
+		/*
+		 * Record it like merge-recursive does: the original at
+		 * the source path, and each side at its destination.
+		 */
+		struct version base = e->stages[1];
+		struct merge_entry *src = find_entry(ms, e->renamed_from);
+
+		if (e->rename_stage == 2)
+			handle_change_delete(ms, path, e);
+		else
+			e->result = o->call_depth ? base : e->stages[3];
+		e->stages[1].mode = 0;
+		add_conflict(ms, path, e);
+		e->stages[1] = base;
+		if (!string_list_has_string(&ms->result->conflicts,
+					    e->renamed_from)) {
+			struct version none = { 0 };
+
+			src->stages[1] = base;
+			src->stages[2] = src->stages[3] = none;
+			add_conflict(ms, e->renamed_from, src);
+		}
+	} else if (e->renamed_from && (!a->mode || !b->mode)) {
+		/*
+		 * Renamed on one side, deleted on the other; like
+		 * merge-recursive, only record the renamed version.
+		 */
+		struct version base = e->stages[1];
+
+		handle_change_delete(ms, path, e);
+		e->stages[1].mode = 0;
+		add_conflict(ms, path, e);
+		e->stages[1] = base;
+	} else if (same_version(a, b))
+		e->result = *a;
+	else if (same_version(one, a))
+		e->result = *b;
+	else if (same_version(one, b))
+		e->result = *a;
+	else if (!a->mode || !b->mode) {
+		handle_change_delete(ms, path, e);
+		add_conflict(ms, path, e);
+	} else if (!merge_content(ms, path, e))
+		add_conflict(ms, path, e);
+}
+
+static int path_in_trees(struct merge_state *ms, const char *path)
+{
+	unsigned char sha1[20];
+	unsigned mode;
+
+	return !get_tree_entry(ms->head->object.oid.hash, path, sha1, &mode) ||
+	       !get_tree_entry(ms->merge->object.oid.hash, path, sha1, &mode);
+}
+
+/* add a string to a strbuf, but converting "/" to "_" */
+static void add_flattened_path(struct strbuf *out, const char *s)
+{
+	size_t i = out->len;
+	strbuf_addstr(out, s);
+	for (; i < out->len; i++)
+		if (out->buf[i] == '/')
+			out->buf[i] = '_';
+}
+
+static char *unique_path(struct merge_state *ms, const char *path,
+			 const char *branch)
+{
+	struct strbuf newpath = STRBUF_INIT;
+	int suffix = 0;
+	size_t base_len;
+
+	strbuf_addf(&newpath, "%s~", path);
+	add_flattened_path(&newpath, branch);
+
+	base_len = newpath.len;
+	while (string_list_has_string(&ms->entries, newpath.buf) ||
+	       path_in_trees(ms, newpath.buf)) {
+		strbuf_setlen(&newpath, base_len);
+		strbuf_addf(&newpath, "_%d", suffix++);
+	}
+	return strbuf_detach(&newpath, NULL);
+}
+
+/* Does the result have anything below the directory "path"? */
+static int dir_in_result(struct merge_state *ms, const char *path)
+{
+	struct strbuf dir = STRBUF_INIT;
+	int pos, found = 0;
+
+	/*
+	 * Anything the result has there cannot be in the same place in
+	 * both trees (the side that has the file does not have it), so
+	 * it is among the changed paths.
+	 */
+	strbuf_addf(&dir, "%s/", path);
+	pos = string_list_find_insert_index(&ms->entries, dir.buf, 1);
+	for (; !found && pos < ms->entries.nr; pos++) {
+		struct merge_entry *e = ms->entries.items[pos].util;
+		if (!starts_with(ms->entries.items[pos].string, dir.buf))
+			break;
+		found = e->result.mode && !e->moved_to;
+	}
+	strbuf_release(&dir);
+	return found;
+}
+
+static int is_dir_in(struct tree *tree, const char *path)
+{
+	unsigned char sha1[20];
+	unsigned mode;
+
+	return !get_tree_entry(tree->object.oid.hash, path, sha1, &mode) &&
+		S_ISDIR(mode);
+}
+
+/*
+ * A file that ended up where the result has a directory is moved out
+ * of the way, to "<path>~<branch>".
+ */
+static void resolve_df_conflicts(struct merge_state *ms)
+{
+	struct merge_options *o = ms->o;
+	int i;
+
+	for (i = ms->entries.nr - 1; i >= 0; i--) {
+		const char *path = ms->entries.items[i].string;
+		struct merge_entry *e = ms->entries.items[i].util;
+		int from_head;
+
+		if (!e->result.mode || !dir_in_result(ms, path))
+			continue;
+		/* name it after the side that does not have the directory */
+		from_head = is_dir_in(ms->merge, path) ||
+			    (!is_dir_in(ms->head, path) &&
+			     same_version(&e->result, &e->stages[2]));
+		e->moved_to = unique_path(ms, path,
+					  from_head ? o->branch1 : o->branch2);
+		output(o, 1, _("CONFLICT (%s): There is a directory with name %s in %s. "
+		       "Adding %s as %s"),
+		       from_head ? _("file/directory") : _("directory/file"),
+		       path, from_head ? o->branch2 : o->branch1,
+		       path, e->moved_to);
+		if (e->conflict)
+			((struct merge_conflict *)
+			 string_list_lookup(&ms->result->conflicts, path)->util)->moved_to =
+				xstrdup(e->moved_to);
+		else
+			add_conflict(ms, path, e);
+	}
+}
+
+struct tree_edit {
+	const char *path;
+	struct version v;
+};
+
+static int compare_tree_edits(const void *a_, const void *b_)
+{
+	const struct tree_edit *a = a_, *b = b_;
+	return strcmp(a->path, b->path);
+}
+
+struct tree_item {
+	const char *name;
+	int len;
+	unsigned mode;
+	unsigned char sha1[20];
+};
+
+static int compare_tree_items(const void *a_, const void *b_)
+{
+	const struct tree_item *a = a_, *b = b_;
+	return base_name_compare(a->name, a->len, a->mode,
+				 b->name, b->len, b->mode);
+}
+
+static struct tree_item *find_item(struct tree_item *item, int nr,
+				   const char *name, int len, int dir)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (item[i].len == len && !memcmp(item[i].name, name, len) &&
+		    !S_ISDIR(item[i].mode) == !dir)
+			return &item[i];
+	return NULL;
+}
+
+/*
+ * Write the tree "tree_sha1" (or an empty one if NULL) with the given
+ * edits applied below the first "prefix_len" bytes of their paths.
+ * Subtrees without edits are reused as they are.  Returns 0 if the
+ * result would be empty, and writes nothing in that case.
+ */
+static int write_edited_tree(const unsigned char *tree_sha1,
+			     struct tree_edit *edit, int nr, int prefix_len,
+			     unsigned char *result)
+{
+	struct tree_item *item = NULL;
+	int item_nr = 0, item_alloc = 0;
+	struct strbuf buf = STRBUF_INIT;
+	void *tree_buf = NULL;
+	int i, j;
+
+	if (tree_sha1) {
+		struct tree_desc desc;
+		struct name_entry entry;
+
+		tree_buf = fill_tree_descriptor(&desc, tree_sha1);
+		while (tree_entry(&desc, &entry)) {
+			ALLOC_GROW(item, item_nr + 1, item_alloc);
+			item[item_nr].name = entry.path;
+			item[item_nr].len = tree_entry_len(&entry);
+			item[item_nr].mode = entry.mode;
+			hashcpy(item[item_nr].sha1, entry.sha1);
+			item_nr++;
+		}
+	}
+
+	for (i = 0; i < nr; i = j) {
+		const char *name = edit[i].path + prefix_len;
+		const char *slash = strchr(name, '/');
+		int len = slash ? slash - name : strlen(name);
+		struct tree_item *it = find_item(item, item_nr, name, len, !!slash);
+		struct version v = edit[i].v;
+
+		if (slash) {
+			unsigned char sha1[20];
+
+			for (j = i + 1; j < nr; j++)
+				if (strncmp(edit[j].path + prefix_len, name, len + 1))
+					break;
+			v.mode = 0;
+			if (write_edited_tree(it ? it->sha1 : NULL, edit + i,
+					      j - i, prefix_len + len + 1, sha1)) {
+				v.mode = S_IFDIR;
+				hashcpy(v.sha1, sha1);
+			}
+		} else
+			j = i + 1;
+
+		if (!v.mode) {
+			if (it)
+				*it = item[--item_nr];
+		} else if (it) {
+			it->mode = v.mode;
+			hashcpy(it->sha1, v.sha1);
+		} else {
+			ALLOC_GROW(item, item_nr + 1, item_alloc);
+			item[item_nr].name = name;
+			item[item_nr].len = len;
+			item[item_nr].mode = v.mode;
+			hashcpy(item[item_nr].sha1, v.sha1);
+			item_nr++;
+		}
+	}
+
+	qsort(item, item_nr, sizeof(*item), compare_tree_items);
+	for (i = 0; i < item_nr; i++) {
+		strbuf_addf(&buf, "%o %.*s%c", item[i].mode,
+			    item[i].len, item[i].name, '\0');
+		strbuf_add(&buf, item[i].sha1, 20);
+	}
+	if (item_nr &&
+	    write_sha1_file(buf.buf, buf.len, tree_type, result))
+		die(_("unable to write tree object"));
+
+	strbuf_release(&buf);
+	free(item);
+	free(tree_buf);
+	return item_nr;
+}
+
+/* Write the result: our tree with everything that differs replaced */
+static struct tree *write_result_tree(struct merge_state *ms)
+{
+	struct tree_edit *edit = NULL;
+	int nr = 0, alloc = 0, i;
+	unsigned char sha1[20];
+
+	for (i = 0; i < ms->entries.nr; i++) {
+		const char *path = ms->entries.items[i].string;
+		struct merge_entry *e = ms->entries.items[i].util;
+
+		if (e->moved_to) {
+			ALLOC_GROW(edit, nr + 2, alloc);
+			edit[nr].path = path;
+			edit[nr++].v.mode = 0;
+			edit[nr].path = e->moved_to;
+			edit[nr++].v = e->result;
+		} else if (!same_version(&e->result, &e->ours)) {
+			ALLOC_GROW(edit, nr + 1, alloc);
+			edit[nr].path = path;
+			edit[nr++].v = e->result;
+		}
+	}
+	if (!nr) {
+		free(edit);
+		return ms->head;
+	}
+	qsort(edit, nr, sizeof(*edit), compare_tree_edits);
+	if (!write_edited_tree(ms->head->object.oid.hash, edit, nr, 0, sha1) &&
+	    write_sha1_file("", 0, tree_type, sha1))
+		die(_("unable to write tree object"));
+	free(edit);
+	return lookup_tree(sha1);
+}
+
+int merge_ort_nonrecursive(struct merge_options *o,
+			   struct tree *head,
+			   struct tree *merge,
+			   struct tree *common,
+			   struct merge_result *result)
+{
+	struct merge_state ms;
+	int i;
+
+	if (o->subtree_shift) {
+		merge = shift_tree_object(head, merge, o->subtree_shift);
+		common = shift_tree_object(head, common, o->subtree_shift);
+	}
+
+	result->clean = 1;
+	if (!oidcmp(&common->object.oid, &merge->object.oid)) {
+		output(o, 0, _("Already up-to-date!"));
+		result->tree = head;
+		return 1;
+	}
+	if (!oidcmp(&common->object.oid, &head->object.oid)) {
+		result->tree = merge;
+		return 1;
+	}
+
+	memset(&ms, 0, sizeof(ms));
+	ms.o = o;
+	ms.head = head;
+	ms.merge = merge;
+	ms.result = result;
+	string_list_init(&ms.entries, 1);
+	for (i = 0; i < ARRAY_SIZE(ms.renames); i++)
+		string_list_init(&ms.renames[i], 1);
+
+	collect_changes(&ms, common, head, 2);
+	collect_changes(&ms, common, merge, 3);
+	for (i = 0; i < ms.entries.nr; i++) {
+		struct merge_entry *e = ms.entries.items[i].util;
+		if (!(e->changed & (1 << 2)))
+			e->stages[2] = e->stages[1];
+		if (!(e->changed & (1 << 3)))
+			e->stages[3] = e->stages[1];
+		e->ours = e->stages[2];
+	}
+
+	if (o->detect_rename) {
+		detect_renames(&ms, 2);
+		detect_renames(&ms, 3);
+		apply_renames(&ms, 2);
+		apply_renames(&ms, 3);
+	}
+
+	for (i = 0; i < ms.entries.nr; i++)
+		process_entry(&ms, ms.entries.items[i].string,
+			      ms.entries.items[i].util);
+	resolve_df_conflicts(&ms);
+	result->tree = write_result_tree(&ms);
+
+	for (i = 0; i < ms.entries.nr; i++)
+		free(((struct merge_entry *)ms.entries.items[i].util)->moved_to);
+	string_list_clear(&ms.entries, 1);
+	for (i = 0; i < ARRAY_SIZE(ms.renames); i++)
+		string_list_clear(&ms.renames[i], 1);
+	return result->clean;
+}
+
+static struct commit_list *reverse_commit_list(struct commit_list *list)
+{
+	struct commit_list *next = NULL, *current, *backup;
+	for (current = list; current; current = backup) {
+		backup = current->next;
+		current->next = next;
+		next = current;
+	}
+	return next;
+}
+
+int merge_ort_recursive(struct merge_options *o,
+			struct commit *h1,
+			struct commit *h2,
+			struct commit_list *ca,
+			struct merge_result *result)
+{
+	struct commit_list *iter;
+	struct commit *merged_common_ancestors;
+	int clean;
+
+	if (!ca) {
+		ca = get_merge_bases(h1, h2);
+		ca = reverse_commit_list(ca);
+	}
+
+	if (show(o, 5)) {
+		unsigned cnt = commit_list_count(ca);
+
+		output(o, 5, Q_("found %u common ancestor:",
+				"found %u common ancestors:", cnt), cnt);
+		for (iter = ca; iter; iter = iter->next)
+			output(o, 5, "%s", oid_to_hex(&iter->item->object.oid));
+	}
+
+	merged_common_ancestors = pop_commit(&ca);
+	if (merged_common_ancestors == NULL) {
+		/* if there is no common ancestor, use an empty tree */
+		struct tree *tree;
+
+		tree = lookup_tree(EMPTY_TREE_SHA1_BIN);
+		merged_common_ancestors = make_virtual_commit(tree, "ancestor");
+	}
+
+	for (iter = ca; iter; iter = iter->next) {
+		struct merge_result inner = MERGE_RESULT_INIT;
+		const char *saved_b1, *saved_b2;
+		struct commit *merged;
+
+		o->call_depth++;
+		/*
+		 * When the merge fails, the result contains files
+		 * with conflict markers; that is what the merge base
+		 * of the outer merge gets.
+		 */
+		saved_b1 = o->branch1;
+		saved_b2 = o->branch2;
+		o->branch1 = "Temporary merge branch 1";
+		o->branch2 = "Temporary merge branch 2";
+		merge_ort_recursive(o, merged_common_ancestors, iter->item,
+				    NULL, &inner);
+		o->branch1 = saved_b1;
+		o->branch2 = saved_b2;
+		o->call_depth--;
+
+		merged = make_virtual_commit(inner.tree, "merged tree");
+		commit_list_insert(merged_common_ancestors, &merged->parents);
+		commit_list_insert(iter->item, &merged->parents->next);
+		merged_common_ancestors = merged;
+		merge_result_release(&inner);
+	}
+
+	o->ancestor = "merged common ancestors";
+	clean = merge_ort_nonrecursive(o, h1->tree, h2->tree,
+				       merged_common_ancestors->tree, result);
+
+	if (!o->call_depth && o->buffer_output < 2)
+		flush_output(o);
+	if (show(o, 2))
+		diff_warn_rename_limit("merge.renamelimit",
+				       o->needed_rename_limit, 0);
+	return clean;
+}
+
+static int add_stage(const struct merge_conflict *c, const char *path,
+		     int stage)
+{
+	struct cache_entry *ce;
+
+	if (!c->stages[stage].mode)
+		return 0;
+	ce = make_cache_entry(c->stages[stage].mode, c->stages[stage].sha1,
+			      path, stage, 0);
+	if (!ce)
+		return error(_("addinfo_cache failed for path '%s'"), path);
+	return add_cache_entry(ce, ADD_CACHE_OK_TO_ADD | ADD_CACHE_SKIP_DFCHECK);
+}
+
+static int staged_is_result(struct diff_filespec *staged,
+			    struct merge_result *result)
+{
+	unsigned char sha1[20];
+	unsigned mode;
+
+	if (string_list_has_string(&result->conflicts, staged->path))
+		return 0;
+	if (get_tree_entry(result->tree->object.oid.hash, staged->path,
+			   sha1, &mode))
+		return !DIFF_FILE_VALID(staged);
+	return DIFF_FILE_VALID(staged) && staged->mode == mode &&
+		!hashcmp(staged->sha1, sha1);
+}
+
+/*
+ * The result is checked out with a two-way merge from "head", which
+ * would carry staged changes over into it; like the three-way merge
+ * of merge-recursive, refuse to merge when there are any, except
+ * where what is staged is already the clean result.
+ */
+static int check_index_matches(struct tree *head, struct merge_result *result,
+			       struct unpack_trees_options *opts)
+{
+	struct diff_options diff_opts;
+	struct strbuf sb = STRBUF_INIT;
+	int i, ret = 0;
+
+	diff_setup(&diff_opts);
+	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&diff_opts);
+	do_diff_cache(head->object.oid.hash, &diff_opts);
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filespec *staged = diff_queued_diff.queue[i]->two;
+		if (!staged_is_result(staged, result))
+			strbuf_addf(&sb, "\t%s\n", staged->path);
+	}
+	diff_flush(&diff_opts);
+	if (sb.len) {
+		ret = error(opts->msgs[ERROR_WOULD_OVERWRITE], sb.buf);
+		fprintf(stderr, "Aborting\n");
+	}
+	strbuf_release(&sb);
+	return ret;
+}
+
+int merge_ort_checkout(struct merge_options *o, struct tree *head,
+		       struct merge_result *result)
+{
+	struct unpack_trees_options opts;
+	struct tree_desc t[2];
+	int i;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.head_idx = 1;
+	opts.src_index = &the_index;
+	opts.dst_index = &the_index;
+	opts.update = 1;
+	opts.merge = 1;
+	opts.fn = twoway_merge;
+	setup_unpack_trees_porcelain(&opts, "merge");
+	if (check_index_matches(head, result, &opts))
+		return -1;
+
+	parse_tree(head);
+	init_tree_desc(t + 0, head->buffer, head->size);
+	parse_tree(result->tree);
+	init_tree_desc(t + 1, result->tree->buffer, result->tree->size);
+	if (unpack_trees(2, t, &opts))
+		return -1;
+
+	/*
+	 * The conflicted contents are in the working tree now; what
+	 * remains is to record the sides of each conflict.  A file that
+	 * had to be moved out of the way of a directory stays in the
+	 * working tree only, like "git merge-recursive" leaves it.
+	 */
+	for (i = 0; i < result->conflicts.nr; i++) {
+		const char *path = result->conflicts.items[i].string;
+		const struct merge_conflict *c = result->conflicts.items[i].util;
+
+		if (c->moved_to)
+			remove_file_from_cache(c->moved_to);
+		remove_file_from_cache(path);
+		if (add_stage(c, path, 1) || add_stage(c, path, 2) ||
+		    add_stage(c, path, 3))
+			return -1;
+	}
+	return 0;
+}
+
+static struct commit *get_ref(const unsigned char *sha1, const char *name)
+{
+	struct object *object;
+
+	object = deref_tag(parse_object(sha1), name, strlen(name));
+	if (!object)
+		return NULL;
+	if (object->type == OBJ_TREE)
+		return make_virtual_commit((struct tree*)object, name);
+	if (object->type != OBJ_COMMIT)
+		return NULL;
+	if (parse_commit((struct commit *)object))
+		return NULL;
+	return (struct commit *)object;
+}
+
+int merge_ort_generic(struct merge_options *o,
+		      const unsigned char *head,
+		      const unsigned char *merge,
+		      int num_base_list,
+		      const unsigned char **base_list)
+{
+	struct merge_result result = MERGE_RESULT_INIT;
+	struct lock_file *lock = xcalloc(1, sizeof(struct lock_file));
+	struct commit *head_commit = get_ref(head, o->branch1);
+	struct commit *next_commit = get_ref(merge, o->branch2);
+	struct commit_list *ca = NULL;
+	int clean;
+
+	if (!head_commit || !next_commit)
+		return error(_("Could not parse object '%s'"),
+			     sha1_to_hex(head_commit ? merge : head));
+	if (base_list) {
+		int i;
+		for (i = 0; i < num_base_list; ++i) {
+			struct commit *base;
+			if (!(base = get_ref(base_list[i], sha1_to_hex(base_list[i]))))
+				return error(_("Could not parse object '%s'"),
+					sha1_to_hex(base_list[i]));
+			commit_list_insert(base, &ca);
+		}
+	}
+
+	hold_locked_index(lock, 1);
+	read_cache();
+	clean = merge_ort_recursive(o, head_commit, next_commit, ca, &result);
+	if (merge_ort_checkout(o, head_commit->tree, &result)) {
+		rollback_lock_file(lock);
+		merge_result_release(&result);
+		return -1;
+	}
+	merge_result_release(&result);
+	if (write_locked_index(&the_index, lock, COMMIT_LOCK))
+		return error(_("Unable to write index."));
+
+	return clean ? 0 : 1;
+}
+
+void merge_result_release(struct merge_result *result)
+{
+	int i;
+
+	for (i = 0; i < result->conflicts.nr; i++) {
+		struct merge_conflict *c = result->conflicts.items[i].util;
+		free(c->moved_to);
+	}
+	string_list_clear(&result->conflicts, 1);
+}
@@ -0,0 +1,70 @@
+#ifndef MERGE_ORT_H
+#define MERGE_ORT_H
+
+#include "merge-recursive.h"
+
+/*
+ * A path that could not be merged cleanly.  The stages are what the
+ * index records for it: 1 is the common ancestor, 2 is "ours" and 3
+ * is "theirs", with a mode of 0 where the path does not exist.  The
+ * merged contents (with conflict markers, if any) are at the path in
+ * the result tree, or at "moved_to" if a directory was in the way.
+ */
+struct merge_conflict {
+	struct {
+		unsigned mode;
+		unsigned char sha1[20];
+	} stages[4];
+	char *moved_to;
+};
+
+struct merge_result {
+	/* the merged tree, already written to the object database */
+	struct tree *tree;
+	int clean;
+	/* conflicted paths, sorted, with a struct merge_conflict as util */
+	struct string_list conflicts;
+};
+#define MERGE_RESULT_INIT { NULL, 1, STRING_LIST_INIT_DUP }
+
+/*
+ * Merge "merge" into "head", with "common" as their common ancestor,
+ * without looking at or touching the index or the working tree.  The
+ * merged blobs and trees are written to the object database; only the
+ * paths that changed on both sides are looked at, and renames are only
+ * looked for where the other side changed the source path.
+ *
+ * Returns 1 if the merge was clean, 0 if there were conflicts.
+ */
+int merge_ort_nonrecursive(struct merge_options *o,
+			   struct tree *head,
+			   struct tree *merge,
+			   struct tree *common,
+			   struct merge_result *result);
+
+/* merge_ort_nonrecursive() but with recursive ancestor consolidation */
+int merge_ort_recursive(struct merge_options *o,
+			struct commit *h1,
+			struct commit *h2,
+			struct commit_list *ancestors,
+			struct merge_result *result);
+
+/*
+ * Update the index and the working tree from "head" to the result of
+ * a merge in one go, and record the conflicts in the index.  Returns
+ * -1 (with the index unchanged) if that would overwrite local changes.
+ * The caller writes the index.
+ */
+int merge_ort_checkout(struct merge_options *o, struct tree *head,
+		       struct merge_result *result);
+
+/* "git merge-ort" is fed objects, like "git merge-recursive" */
+int merge_ort_generic(struct merge_options *o,
+		      const unsigned char *head,
+		      const unsigned char *merge,
+		      int num_ca,
+		      const unsigned char **ca);
+
+void merge_result_release(struct merge_result *result);
+
+#endif
@@ -23,8 +23,8 @@
 #include "dir.h"
 #include "submodule.h"
 
-static struct tree *shift_tree_object(struct tree *one, struct tree *two,
-				      const char *subtree_shift)
+struct tree *shift_tree_object(struct tree *one, struct tree *two,
+			       const char *subtree_shift)
 {
 	struct object_id shifted;
 
@@ -39,7 +39,7 @@ static struct tree *shift_tree_object(struct tree *one, struct tree *two,
 	return lookup_tree(shifted.hash);
 }
 
-static struct commit *make_virtual_commit(struct tree *tree, const char *comment)
+struct commit *make_virtual_commit(struct tree *tree, const char *comment)
 {
 	struct commit *commit = alloc_commit_node();
 	struct merge_remote_desc *desc = xmalloc(sizeof(*desc));
@@ -1969,7 +1969,8 @@ int merge_recursive(struct merge_options *o,
 		commit_list_insert(h1, &(*result)->parents);
 		commit_list_insert(h2, &(*result)->parents->next);
 	}
-	flush_output(o);
+	if (o->buffer_output < 2)
+		flush_output(o);
 	if (show(o, 2))
 		diff_warn_rename_limit("merge.renamelimit",
 				       o->needed_rename_limit, 0);
@@ -13,7 +13,7 @@ struct merge_options {
 		MERGE_RECURSIVE_THEIRS
 	} recursive_variant;
 	const char *subtree_shift;
-	unsigned buffer_output : 1;
+	unsigned buffer_output : 2; /* 1: flush at the end; 2: leave it to the caller */
 	unsigned renormalize : 1;
 	long xdl_opts;
 	int verbosity;
@@ -55,6 +55,11 @@ int merge_recursive_generic(struct merge_options *o,
 			    const unsigned char **ca,
 			    struct commit **result);
 
+/* also used by merge-ort.c */
+struct commit *make_virtual_commit(struct tree *tree, const char *comment);
+struct tree *shift_tree_object(struct tree *one, struct tree *two,
+			       const char *subtree_shift);
+
 void init_merge_options(struct merge_options *o);
 struct tree *write_tree_from_memory(struct merge_options *o);
 
@@ -7,6 +7,11 @@
  */
 #define NO_THE_INDEX_COMPATIBILITY_MACROS
 #include "cache.h"
+#include "thread-utils.h"
+
+#ifndef NO_PTHREADS
+#include <pthread.h>
+#endif
 
 struct dir_entry {
 	struct hashmap_entry ent;
@@ -112,20 +117,274 @@ static int cache_entry_cmp(const struct cache_entry *ce1,
 	return remove ? !(ce1 == ce2) : 0;
 }
 
-static void lazy_init_name_hash(struct index_state *istate)
+#ifndef NO_PTHREADS
+/*
+ * With a large index, fill the hashes on several threads, each of
+ * them working on a range of the (sorted) index that starts at a
+ * directory boundary.  The tables are sized up front and do not grow
+ * while the threads run, and the buckets are protected by a set of
+ * locks chosen by bucket number, so that two threads only wait for
+ * each other when they touch the same few buckets.
+ */
+#define LAZY_THREAD_COST (2000)
+#define LAZY_MAX_THREADS (32)
+#define LAZY_LOCKS (64)
+
+static pthread_mutex_t name_locks[LAZY_LOCKS];
+static pthread_mutex_t dir_locks[LAZY_LOCKS];
+
+struct lazy_thread {
+	pthread_t pthread;
+	struct index_state *istate;
+	int begin, end;
+	unsigned int names_added, dirs_added;
+
+	/* the directory of the previous entry, which usually is ours */
+	struct dir_entry *last_dir;
+};
+
+static pthread_mutex_t *bucket_lock(pthread_mutex_t *locks,
+				    struct hashmap *map, unsigned int hash)
+{
+	return &locks[hashmap_bucket(map, hash) % LAZY_LOCKS];
+}
+
+static struct dir_entry *hash_dir_entry_threaded(struct lazy_thread *t,
+						 struct cache_entry *ce,
+						 int namelen)
+{
+	struct index_state *istate = t->istate;
+	struct dir_entry *dir, *parent;
+	pthread_mutex_t *lock;
+	unsigned int hash;
+
+	/* get length of parent directory */
+	while (namelen > 0 && !is_dir_sep(ce->name[namelen - 1]))
+		namelen--;
+	if (namelen <= 0)
+		return NULL;
+	namelen--;
+
+	hash = memihash(ce->name, namelen);
+	lock = bucket_lock(dir_locks, &istate->dir_hash, hash);
+	pthread_mutex_lock(lock);
+	dir = find_dir_entry(istate, ce->name, namelen);
+	pthread_mutex_unlock(lock);
+	if (dir)
+		return dir;
+
+	/*
+	 * Another thread may find the new entry as soon as it is in the
+	 * table, so look up its parent before adding it.
+	 */
+	parent = hash_dir_entry_threaded(t, ce, namelen);
+
+	pthread_mutex_lock(lock);
+	dir = find_dir_entry(istate, ce->name, namelen);
+	if (!dir) {
+		FLEX_ALLOC_MEM(dir, name, ce->name, namelen);
+		hashmap_entry_init(dir, hash);
+		dir->namelen = namelen;
+		dir->parent = parent;
+		hashmap_add_nogrow(&istate->dir_hash, dir);
+		t->dirs_added++;
+	}
+	pthread_mutex_unlock(lock);
+	return dir;
+}
+
+static void add_dir_entry_threaded(struct lazy_thread *t,
+				   struct cache_entry *ce)
+{
+	struct dir_entry *dir = t->last_dir;
+	int len = ce_namelen(ce);
+
+	while (len > 0 && !is_dir_sep(ce->name[len - 1]))
+		len--;
+	if (!len)
+		dir = NULL;
+	else if (!dir || dir->namelen != len - 1 ||
+		 strncasecmp(dir->name, ce->name, len - 1))
+		dir = hash_dir_entry_threaded(t, ce, len);
+	t->last_dir = dir;
+
+	/* Add reference to the directory entry (and parents if 0). */
+	while (dir) {
+		pthread_mutex_t *lock = bucket_lock(dir_locks, &t->istate->dir_hash,
+						    dir->ent.hash);
+		int first;
+
+		pthread_mutex_lock(lock);
+		first = !dir->nr++;
+		pthread_mutex_unlock(lock);
+		if (!first)
+			break;
+		dir = dir->parent;
+	}
+}
+
+static void *lazy_name_thread(void *data)
+{
+	struct lazy_thread *t = data;
+	struct hashmap *map = &t->istate->name_hash;
+	int nr;
+
+	for (nr = t->begin; nr < t->end; nr++) {
+		struct cache_entry *ce = t->istate->cache[nr];
+		unsigned int hash = memihash(ce->name, ce_namelen(ce));
+		pthread_mutex_t *lock = bucket_lock(name_locks, map, hash);
+
+		ce->ce_flags |= CE_HASHED;
+		hashmap_entry_init(ce, hash);
+		pthread_mutex_lock(lock);
+		hashmap_add_nogrow(map, ce);
+		pthread_mutex_unlock(lock);
+		t->names_added++;
+
+		if (ignore_case)
+			add_dir_entry_threaded(t, ce);
+	}
+	return NULL;
+}
+
+static int same_dir(const struct cache_entry *a, const struct cache_entry *b)
+{
+	int len = ce_namelen(a);
+
+	while (len > 0 && !is_dir_sep(a->name[len - 1]))
+		len--;
+	return len < ce_namelen(b) && !strncmp(a->name, b->name, len) &&
+		!strchr(b->name + len, '/');
+}
+
+static int lazy_nr_threads(struct index_state *istate)
+{
+	int nr = istate->cache_nr / LAZY_THREAD_COST;
+	int cpus = online_cpus();
+
+	if (nr > cpus)
+		nr = cpus;
+	if (nr > LAZY_MAX_THREADS)
+		nr = LAZY_MAX_THREADS;
+	return nr;
+}
+
+/*
+ * Count the directories of the index.  As it is sorted, each entry
+ * only adds the leading directories it does not share with the entry
+ * before it.  Directories that differ only in case are counted more
+ * than once, which is fine for sizing dir_hash.
+ */
+static unsigned int count_dirs(struct index_state *istate)
+{
+	unsigned int nr = 0;
+	const char *prev = "";
+	int i, j;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		const char *name = istate->cache[i]->name;
+		int common = 0;
+
+		for (j = 0; name[j] && name[j] == prev[j]; j++)
+			if (name[j] == '/')
+				common = j + 1;
+		for (j = common; name[j]; j++)
+			if (name[j] == '/')
+				nr++;
+		prev = name;
+	}
+	return nr;
+}
+
+static void threaded_lazy_init_name_hash(struct index_state *istate,
+					 int nr_threads)
+{
+	struct lazy_thread *t = xcalloc(nr_threads, sizeof(*t));
+	int i, begin = 0;
+
+	/* the threads cannot grow the table, so make room for every directory */
+	hashmap_init(&istate->dir_hash, (hashmap_cmp_fn) dir_entry_cmp,
+		     ignore_case ? count_dirs(istate) : 0);
+	for (i = 0; i < LAZY_LOCKS; i++) {
+		pthread_mutex_init(&name_locks[i], NULL);
+		pthread_mutex_init(&dir_locks[i], NULL);
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		int end = (int)((uint64_t)istate->cache_nr * (i + 1) / nr_threads);
+
+		/* do not split a directory between two threads */
+		while (0 < end && end < istate->cache_nr &&
+		       same_dir(istate->cache[end - 1], istate->cache[end]))
+			end++;
+		if (end < begin)
+			end = begin;
+		t[i].istate = istate;
+		t[i].begin = begin;
+		t[i].end = end;
+		begin = end;
+		if (pthread_create(&t[i].pthread, NULL, lazy_name_thread, &t[i]))
+			die("unable to create lazy_name_thread");
+	}
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_join(t[i].pthread, NULL))
+			die("unable to join lazy_name_thread");
+		hashmap_adjust_size(&istate->name_hash, t[i].names_added);
+		hashmap_adjust_size(&istate->dir_hash, t[i].dirs_added);
+	}
+
+	for (i = 0; i < LAZY_LOCKS; i++) {
+		pthread_mutex_destroy(&name_locks[i]);
+		pthread_mutex_destroy(&dir_locks[i]);
+	}
+	free(t);
+}
+#else
+static int lazy_nr_threads(struct index_state *istate)
+{
+	return 1;
+}
+
+static void threaded_lazy_init_name_hash(struct index_state *istate,
+					 int nr_threads)
+{
+	die("BUG: threaded_lazy_init_name_hash without pthreads");
+}
+#endif
+
+static void init_name_hash(struct index_state *istate, int nr_threads)
 {
 	int nr;
 
-	if (istate->name_hash_initialized)
-		return;
 	hashmap_init(&istate->name_hash, (hashmap_cmp_fn) cache_entry_cmp,
 			istate->cache_nr);
-	hashmap_init(&istate->dir_hash, (hashmap_cmp_fn) dir_entry_cmp, 0);
-	for (nr = 0; nr < istate->cache_nr; nr++)
-		hash_index_entry(istate, istate->cache[nr]);
+	if (nr_threads > 1)
+		threaded_lazy_init_name_hash(istate, nr_threads);
+	else {
+		hashmap_init(&istate->dir_hash, (hashmap_cmp_fn) dir_entry_cmp, 0);
+		for (nr = 0; nr < istate->cache_nr; nr++)
+			hash_index_entry(istate, istate->cache[nr]);
+	}
 	istate->name_hash_initialized = 1;
 }
 
+static void lazy_init_name_hash(struct index_state *istate)
+{
+	if (istate->name_hash_initialized)
+		return;
+	init_name_hash(istate, lazy_nr_threads(istate));
+}
+
+int test_lazy_init_name_hash(struct index_state *istate, int nr_threads)
+{
+	free_name_hash(istate);
+#ifdef NO_PTHREADS
+	nr_threads = 1;
+#endif
+	init_name_hash(istate, nr_threads);
+	return nr_threads;
+}
+
 void add_name_hash(struct index_state *istate, struct cache_entry *ce)
 {
 	if (istate->name_hash_initialized)
@@ -884,6 +884,71 @@ void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees,
 		*tags = count_object_type(bitmap_git.result, OBJ_TAG);
 }
 
+/*
+ * Return the number of bytes that the objects in the result of the last
+ * bitmap walk occupy on disk.  Only commits are accounted for unless
+ * "all_objects" is set.  Packed sizes come straight from the pack's
+ * reverse index, so no object needs to be looked up by name, except
+ * those in the extended index which live outside the bitmapped pack.
+ */
+off_t get_bitmap_disk_usage(int all_objects)
+{
+	struct bitmap *result = bitmap_git.result;
+	struct packed_git *pack = bitmap_git.pack;
+	struct eindex *eindex = &bitmap_git.ext_index;
+	struct ewah_iterator it;
+	eword_t filter = ~(eword_t)0;
+	off_t total = 0;
+	size_t i;
+
+	assert(result);
+
+	if (!all_objects)
+		ewah_iterator_init(&it, bitmap_git.commits);
+
+	for (i = 0; i < result->word_alloc; i++) {
+		eword_t word = result->words[i];
+		uint32_t offset;
+
+		if (!all_objects && !ewah_iterator_next(&filter, &it))
+			filter = 0;
+		word &= filter;
+
+		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
+			size_t pos;
+
+			if ((word >> offset) == 0)
+				break;
+
+			offset += ewah_bit_ctz64(word >> offset);
+			pos = i * BITS_IN_EWORD + offset;
+			if (pos >= pack->num_objects)
+				break;
+
+			total += pack->revindex[pos + 1].offset -
+				 pack->revindex[pos].offset;
+		}
+	}
+
+	for (i = 0; i < eindex->count; i++) {
+		struct object *obj = eindex->objects[i];
+		struct object_info oi = {NULL};
+		unsigned long size;
+
+		if (!all_objects && obj->type != OBJ_COMMIT)
+			continue;
+		if (!bitmap_get(result, pack->num_objects + i))
+			continue;
+
+		oi.disk_sizep = &size;
+		if (sha1_object_info_extended(obj->oid.hash, &oi, 0) < 0)
+			die("unable to get disk usage of %s", oid_to_hex(&obj->oid));
+		total += size;
+	}
+
+	return total;
+}
+
 struct bitmap_test_data {
 	struct bitmap *base;
 	struct progress *prg;
@@ -36,6 +36,7 @@ typedef int (*show_reachable_fn)(
 
 int prepare_bitmap_git(void);
 void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees, uint32_t *blobs, uint32_t *tags);
+off_t get_bitmap_disk_usage(int all_objects);
 void traverse_bitmap_commit_list(show_reachable_fn show_reachable);
 void test_bitmap_walk(struct rev_info *revs);
 int prepare_bitmap_walk(struct rev_info *revs);
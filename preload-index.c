@@ -5,16 +5,6 @@
 #include "pathspec.h"
 #include "dir.h"
 
-#ifdef NO_PTHREADS
-static void preload_index(struct index_state *index,
-			  const struct pathspec *pathspec)
-{
-	; /* nothing */
-}
-#else
-
-#include <pthread.h>
-
 /*
  * Mostly randomly chosen maximum thread counts: we
  * cap the parallelism to 20 threads, and we want
@@ -24,6 +14,93 @@ static void preload_index(struct index_state *index,
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
+static int want_preload(struct cache_entry *ce,
+			const struct pathspec *pathspec,
+			struct cache_def *cache)
+{
+	if (ce_stage(ce))
+		return 0;
+	if (S_ISGITLINK(ce->ce_mode))
+		return 0;
+	if (ce_uptodate(ce))
+		return 0;
+	if (pathspec && !ce_path_match(ce, pathspec, NULL))
+		return 0;
+	if (threaded_has_symlink_leading_path(cache, ce->name, ce_namelen(ce)))
+		return 0;
+	return 1;
+}
+
+#ifdef USE_IO_URING
+/*
+ * Instead of a few threads doing one lstat() after another, keep up
+ * to URING_DEPTH of them in flight, looking at URING_BATCH entries at
+ * a time.
+ */
+#define URING_DEPTH (256)
+#define URING_BATCH (1024)
+
+static int preload_index_uring(struct index_state *index,
+			       const struct pathspec *pathspec)
+{
+	struct uring_lstat *u = uring_lstat_init(URING_DEPTH);
+	struct cache_def cache = CACHE_DEF_INIT;
+	struct cache_entry **ce;
+	const char **path;
+	struct stat *st;
+	int *err;
+	int i = 0, j, nr;
+
+	if (!u)
+		return -1;
+	ALLOC_ARRAY(ce, URING_BATCH);
+	ALLOC_ARRAY(path, URING_BATCH);
+	ALLOC_ARRAY(st, URING_BATCH);
+	ALLOC_ARRAY(err, URING_BATCH);
+	while (i < index->cache_nr) {
+		for (nr = 0; i < index->cache_nr && nr < URING_BATCH; i++) {
+			if (!want_preload(index->cache[i], pathspec, &cache))
+				continue;
+			ce[nr] = index->cache[i];
+			path[nr++] = index->cache[i]->name;
+		}
+		/* what is not marked up-to-date here is refreshed as usual */
+		if (uring_lstat(u, nr, path, st, err))
+			break;
+		for (j = 0; j < nr; j++)
+			if (!err[j] &&
+			    !ie_match_stat(index, ce[j], &st[j],
+					   CE_MATCH_RACY_IS_DIRTY))
+				ce_mark_uptodate(ce[j]);
+	}
+	free(ce);
+	free(path);
+	free(st);
+	free(err);
+	cache_def_clear(&cache);
+	uring_lstat_release(u);
+	return 0;
+}
+#else
+static int preload_index_uring(struct index_state *index,
+			       const struct pathspec *pathspec)
+{
+	return -1;
+}
+#endif
+
+#ifdef NO_PTHREADS
+static void preload_index(struct index_state *index,
+			  const struct pathspec *pathspec)
+{
+	if (!core_preload_index || index->cache_nr < 2 * THREAD_COST)
+		return;
+	preload_index_uring(index, pathspec);
+}
+#else
+
+#include <pthread.h>
+
 struct thread_data {
 	pthread_t pthread;
 	struct index_state *index;
@@ -47,15 +124,7 @@ static void *preload_thread(void *_data)
 		struct cache_entry *ce = *cep++;
 		struct stat st;
 
-		if (ce_stage(ce))
-			continue;
-		if (S_ISGITLINK(ce->ce_mode))
-			continue;
-		if (ce_uptodate(ce))
-			continue;
-		if (!ce_path_match(ce, &p->pathspec, NULL))
-			continue;
-		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
+		if (!want_preload(ce, &p->pathspec, &cache))
 			continue;
 		if (lstat(ce->name, &st))
 			continue;
@@ -79,6 +148,8 @@ static void preload_index(struct index_state *index,
 	threads = index->cache_nr / THREAD_COST;
 	if (threads < 2)
 		return;
+	if (!preload_index_uring(index, pathspec))
+		return;
 	if (threads > MAX_PARALLEL)
 		threads = MAX_PARALLEL;
 	offset = 0;
@@ -17,6 +17,7 @@
 #include "strbuf.h"
 #include "varint.h"
 #include "split-index.h"
+#include "sparse-index.h"
 #include "utf8.h"
 
 static struct cache_entry *refresh_cache_entry(struct cache_entry *ce,
@@ -40,6 +41,7 @@ static struct cache_entry *refresh_cache_entry(struct cache_entry *ce,
 #define CACHE_EXT_RESOLVE_UNDO 0x52455543 /* "REUC" */
 #define CACHE_EXT_LINK 0x6c696e6b	  /* "link" */
 #define CACHE_EXT_UNTRACKED 0x554E5452	  /* "UNTR" */
+#define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -1345,6 +1347,14 @@ struct ondisk_cache_entry_extended {
 			    ondisk_cache_entry_extended_size(ce_namelen(ce)) : \
 			    ondisk_cache_entry_size(ce_namelen(ce)))
 
+/*
+ * Hashing the whole index on every read is expensive for large
+ * indexes, and a corrupt index is usually caught by the sanity
+ * checks done while parsing it anyway; only "git fsck" asks for
+ * the trailing checksum to be verified.
+ */
+int verify_index_checksum;
+
 static int verify_hdr(struct cache_header *hdr, unsigned long size)
 {
 	git_SHA_CTX c;
@@ -1356,6 +1366,15 @@ static int verify_hdr(struct cache_header *hdr, unsigned long size)
 	hdr_version = ntohl(hdr->hdr_version);
 	if (hdr_version < INDEX_FORMAT_LB || INDEX_FORMAT_UB < hdr_version)
 		return error("bad index version %d", hdr_version);
+
+	/*
+	 * A null trailer means the index was written without a
+	 * checksum (index.skipHash); there is nothing to verify.
+	 */
+	if (!verify_index_checksum ||
+	    is_null_sha1((unsigned char *)hdr + size - 20))
+		return 0;
+
 	git_SHA1_Init(&c);
 	git_SHA1_Update(&c, hdr, size - 20);
 	git_SHA1_Final(sha1, &c);
@@ -1381,6 +1400,9 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_UNTRACKED:
 		istate->untracked = read_untracked_extension(data, sz);
 		break;
+	case CACHE_EXT_SPARSE_DIRECTORIES:
+		istate->sparse_index = 1;
+		break;
 	default:
 		if (*ext < 'A' || 'Z' < *ext)
 			return error("index uses %.4s extension, which we do not understand",
@@ -1539,6 +1561,8 @@ static void post_read_index_from(struct index_state *istate)
 {
 	check_ce_order(istate);
 	tweak_untracked_cache(istate);
+	if (istate->sparse_index && command_requires_full_index)
+		ensure_full_index(istate);
 }
 
 /* remember to discard_cache() before reading a different cache! */
@@ -1695,6 +1719,7 @@ int discard_index(struct index_state *istate)
 	free_name_hash(istate);
 	cache_tree_free(&(istate->cache_tree));
 	istate->initialized = 0;
+	istate->sparse_index = 0;
 	free(istate->cache);
 	istate->cache = NULL;
 	istate->cache_alloc = 0;
@@ -1714,15 +1739,20 @@ int unmerged_index(const struct index_state *istate)
 	return 0;
 }
 
-#define WRITE_BUFFER_SIZE 8192
+#define WRITE_BUFFER_SIZE (128 * 1024)
 static unsigned char write_buffer[WRITE_BUFFER_SIZE];
 static unsigned long write_buffer_len;
 
+/*
+ * The write helpers below take a NULL context when the index is
+ * written without a checksum; see index.skipHash.
+ */
 static int ce_write_flush(git_SHA_CTX *context, int fd)
 {
 	unsigned int buffered = write_buffer_len;
 	if (buffered) {
-		git_SHA1_Update(context, write_buffer, buffered);
+		if (context)
+			git_SHA1_Update(context, write_buffer, buffered);
 		if (write_in_full(fd, write_buffer, buffered) != buffered)
 			return -1;
 		write_buffer_len = 0;
@@ -1767,7 +1797,8 @@ static int ce_flush(git_SHA_CTX *context, int fd, unsigned char *sha1)
 
 	if (left) {
 		write_buffer_len = 0;
-		git_SHA1_Update(context, write_buffer, left);
+		if (context)
+			git_SHA1_Update(context, write_buffer, left);
 	}
 
 	/* Flush first if not enough space for SHA1 signature */
@@ -1777,8 +1808,11 @@ static int ce_flush(git_SHA_CTX *context, int fd, unsigned char *sha1)
 		left = 0;
 	}
 
-	/* Append the SHA1 signature at the end */
-	git_SHA1_Final(write_buffer + left, context);
+	/* Append the SHA1 signature (or all zeroes) at the end */
+	if (context)
+		git_SHA1_Final(write_buffer + left, context);
+	else
+		hashclr(write_buffer + left);
 	hashcpy(sha1, write_buffer + left);
 	left += 20;
 	return (write_in_full(fd, write_buffer, left) != left) ? -1 : 0;
@@ -1951,6 +1985,15 @@ static int verify_index_from(const struct index_state *istate, const char *path)
 	if (hashcmp(istate->sha1, sha1))
 		goto out;
 
+	/*
+	 * An index written without a checksum cannot be told apart by
+	 * its trailer; fall back to its timestamp.
+	 */
+	if (is_null_sha1(sha1) &&
+	    (istate->timestamp.sec != (unsigned int)st.st_mtime ||
+	     istate->timestamp.nsec != ST_MTIME_NSEC(st)))
+		goto out;
+
 	close(fd);
 	return 1;
 
@@ -1988,10 +2031,18 @@ void update_index_if_able(struct index_state *istate, struct lock_file *lockfile
 		rollback_lock_file(lockfile);
 }
 
+static int want_skip_hash(void)
+{
+	int skip_hash = 0;
+
+	git_config_get_bool("index.skiphash", &skip_hash);
+	return skip_hash;
+}
+
 static int do_write_index(struct index_state *istate, int newfd,
 			  int strip_extensions)
 {
-	git_SHA_CTX c;
+	git_SHA_CTX c, *context = &c;
 	struct cache_header hdr;
 	int i, err, removed, extended, hdr_version;
 	struct cache_entry **cache = istate->cache;
@@ -2013,7 +2064,7 @@ static int do_write_index(struct index_state *istate, int newfd,
 
 	if (!istate->version) {
 		istate->version = get_index_format_default();
-		if (getenv("GIT_TEST_SPLIT_INDEX"))
+		if (getenv("GIT_TEST_SPLIT_INDEX") && !want_sparse_index(istate))
 			init_split_index(istate);
 	}
 
@@ -2027,8 +2078,15 @@ static int do_write_index(struct index_state *istate, int newfd,
 	hdr.hdr_version = htonl(hdr_version);
 	hdr.hdr_entries = htonl(entries - removed);
 
-	git_SHA1_Init(&c);
-	if (ce_write(&c, newfd, &hdr, sizeof(hdr)) < 0)
+	/*
+	 * A shared index is named after its checksum, so it always
+	 * gets one.
+	 */
+	if (!strip_extensions && want_skip_hash())
+		context = NULL;
+	else
+		git_SHA1_Init(&c);
+	if (ce_write(context, newfd, &hdr, sizeof(hdr)) < 0)
 		return -1;
 
 	previous_name = (hdr_version == 4) ? &previous_name_buf : NULL;
@@ -2049,7 +2107,7 @@ static int do_write_index(struct index_state *istate, int newfd,
 			else
 				return error(msg, ce->name);
 		}
-		if (ce_write_entry(&c, newfd, ce, previous_name) < 0)
+		if (ce_write_entry(context, newfd, ce, previous_name) < 0)
 			return -1;
 	}
 	strbuf_release(&previous_name_buf);
@@ -2059,9 +2117,9 @@ static int do_write_index(struct index_state *istate, int newfd,
 		struct strbuf sb = STRBUF_INIT;
 
 		err = write_link_extension(&sb, istate) < 0 ||
-			write_index_ext_header(&c, newfd, CACHE_EXT_LINK,
+			write_index_ext_header(context, newfd, CACHE_EXT_LINK,
 					       sb.len) < 0 ||
-			ce_write(&c, newfd, sb.buf, sb.len) < 0;
+			ce_write(context, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
@@ -2070,8 +2128,8 @@ static int do_write_index(struct index_state *istate, int newfd,
 		struct strbuf sb = STRBUF_INIT;
 
 		cache_tree_write(&sb, istate->cache_tree);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_TREE, sb.len) < 0
-			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		err = write_index_ext_header(context, newfd, CACHE_EXT_TREE, sb.len) < 0
+			|| ce_write(context, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
@@ -2080,26 +2138,32 @@ static int do_write_index(struct index_state *istate, int newfd,
 		struct strbuf sb = STRBUF_INIT;
 
 		resolve_undo_write(&sb, istate->resolve_undo);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_RESOLVE_UNDO,
+		err = write_index_ext_header(context, newfd, CACHE_EXT_RESOLVE_UNDO,
 					     sb.len) < 0
-			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+			|| ce_write(context, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
 	}
+	if (!strip_extensions && istate->sparse_index) {
+		err = write_index_ext_header(context, newfd,
+					     CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0;
+		if (err)
+			return -1;
+	}
 	if (!strip_extensions && istate->untracked) {
 		struct strbuf sb = STRBUF_INIT;
 
 		write_untracked_extension(&sb, istate->untracked);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_UNTRACKED,
+		err = write_index_ext_header(context, newfd, CACHE_EXT_UNTRACKED,
 					     sb.len) < 0 ||
-			ce_write(&c, newfd, sb.buf, sb.len) < 0;
+			ce_write(context, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
 	}
 
-	if (ce_flush(&c, newfd, istate->sha1) || fstat(newfd, &st))
+	if (ce_flush(context, newfd, istate->sha1) || fstat(newfd, &st))
 		return -1;
 	istate->timestamp.sec = (unsigned int)st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
@@ -2122,7 +2186,16 @@ static int commit_locked_index(struct lock_file *lk)
 static int do_write_locked_index(struct index_state *istate, struct lock_file *lock,
 				 unsigned flags)
 {
-	int ret = do_write_index(istate, get_lock_file_fd(lock), 0);
+	struct index_state sparse;
+	int ret;
+
+	if (istate->sparse_index && !want_sparse_index(istate))
+		ensure_full_index(istate);
+	if (make_sparse_copy(istate, &sparse)) {
+		ret = do_write_index(&sparse, get_lock_file_fd(lock), 0);
+		discard_sparse_copy(istate, &sparse);
+	} else
+		ret = do_write_index(istate, get_lock_file_fd(lock), 0);
 	if (ret)
 		return ret;
 	assert((flags & (COMMIT_LOCK | CLOSE_LOCK)) !=
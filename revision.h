@@ -114,6 +114,12 @@ struct rev_info {
 			first_parent_only:1,
 			line_level_traverse:1;
 
+	/*
+	 * Number of threads reading trees ahead of traverse_commit_list();
+	 * 0 or 1 reads them on the calling thread only.
+	 */
+	int traverse_threads;
+
 	/* Diff flags */
 	unsigned int	diff:1,
 			full_diff:1,
@@ -12,7 +12,7 @@
 #include "diff.h"
 #include "revision.h"
 #include "rerere.h"
-#include "merge-recursive.h"
+#include "merge-ort.h"
 #include "refs.h"
 #include "argv-array.h"
 
@@ -290,9 +290,21 @@ static int do_recursive_merge(struct commit *base, struct commit *next,
 	for (xopt = opts->xopts; xopt != opts->xopts + opts->xopts_nr; xopt++)
 		parse_merge_opt(&o, *xopt);
 
-	clean = merge_trees(&o,
-			    head_tree,
-			    next_tree, base_tree, &result);
+	if (opts->strategy && !strcmp(opts->strategy, "ort")) {
+		struct merge_result mr = MERGE_RESULT_INIT;
+
+		clean = merge_ort_nonrecursive(&o, head_tree, next_tree,
+					       base_tree, &mr);
+		if (merge_ort_checkout(&o, head_tree, &mr)) {
+			merge_result_release(&mr);
+			rollback_lock_file(&index_lock);
+			return -1;
+		}
+		merge_result_release(&mr);
+	} else
+		clean = merge_trees(&o,
+				    head_tree,
+				    next_tree, base_tree, &result);
 
 	if (active_cache_changed &&
 	    write_locked_index(&the_index, &index_lock, COMMIT_LOCK))
@@ -558,7 +570,8 @@ static int do_pick_commit(struct commit *commit, struct replay_opts *opts)
 		}
 	}
 
-	if (!opts->strategy || !strcmp(opts->strategy, "recursive") || opts->action == REPLAY_REVERT) {
+	if (!opts->strategy || !strcmp(opts->strategy, "recursive") ||
+	    !strcmp(opts->strategy, "ort") || opts->action == REPLAY_REVERT) {
 		res = do_recursive_merge(base, next, base_label, next_label,
 					 head, &msgbuf, opts);
 		write_message(&msgbuf, git_path_merge_msg());
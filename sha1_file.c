@@ -23,6 +23,7 @@
 #include "bulk-checkin.h"
 #include "streaming.h"
 #include "dir.h"
+#include "thread-utils.h"
 
 #ifndef O_NOATIME
 #if defined(__linux__) && (defined(__i386__) || defined(__PPC__))
@@ -67,6 +68,92 @@ static struct cached_object empty_tree = {
  */
 static struct packed_git *last_found_pack;
 
+#ifndef NO_PTHREADS
+/*
+ * The object reading machinery (pack windows, the delta base cache,
+ * the list of packs, ...) is not thread-safe.  Once a caller enables
+ * the lock, the entry points below serialize through it.  The lock is
+ * recursive, so that a thread already holding it (e.g. because it
+ * pokes at pack internals itself) can still read objects.
+ */
+static int obj_read_use_lock;
+static pthread_mutex_t obj_read_mutex;
+static pthread_key_t obj_read_depth;
+
+void enable_obj_read_lock(void)
+{
+	if (obj_read_use_lock++)
+		return;
+	pthread_mutex_init(&obj_read_mutex, NULL);
+	pthread_key_create(&obj_read_depth, NULL);
+}
+
+void disable_obj_read_lock(void)
+{
+	if (!obj_read_use_lock)
+		die("BUG: unbalanced disable_obj_read_lock()");
+	if (--obj_read_use_lock)
+		return;
+	pthread_key_delete(obj_read_depth);
+	pthread_mutex_destroy(&obj_read_mutex);
+}
+
+void obj_read_lock(void)
+{
+	intptr_t depth;
+
+	if (!obj_read_use_lock)
+		return;
+	depth = (intptr_t)pthread_getspecific(obj_read_depth);
+	if (!depth)
+		pthread_mutex_lock(&obj_read_mutex);
+	pthread_setspecific(obj_read_depth, (void *)(depth + 1));
+}
+
+void obj_read_unlock(void)
+{
+	intptr_t depth;
+
+	if (!obj_read_use_lock)
+		return;
+	depth = (intptr_t)pthread_getspecific(obj_read_depth) - 1;
+	pthread_setspecific(obj_read_depth, (void *)depth);
+	if (!depth)
+		pthread_mutex_unlock(&obj_read_mutex);
+}
+
+/*
+ * Inflating an object and applying deltas to it is where most of the
+ * time reading it goes, and it only needs buffers private to the
+ * caller and a pack window the caller holds a reference on.  Let other
+ * threads read objects in the meantime, unless our caller took the
+ * lock itself and may be in the middle of looking at pack internals.
+ */
+static int obj_read_suspend(void)
+{
+	if (!obj_read_use_lock ||
+	    (intptr_t)pthread_getspecific(obj_read_depth) != 1)
+		return 0;
+	obj_read_unlock();
+	return 1;
+}
+
+static void obj_read_resume(int suspended)
+{
+	if (suspended)
+		obj_read_lock();
+}
+#else
+static inline int obj_read_suspend(void)
+{
+	return 0;
+}
+
+static inline void obj_read_resume(int suspended)
+{
+}
+#endif
+
 static struct cached_object *find_cached_object(const unsigned char *sha1)
 {
 	int i;
@@ -1144,7 +1231,9 @@ static struct packed_git *alloc_packed_git(int extra)
 
 static void try_to_free_pack_memory(size_t size)
 {
+	obj_read_lock();
 	release_pack_memory(size);
+	obj_read_unlock();
 }
 
 struct packed_git *add_packed_git(const char *path, size_t path_len, int local)
@@ -2082,9 +2171,13 @@ static void *unpack_compressed_entry(struct packed_git *p,
 
 	git_inflate_init(&stream);
 	do {
+		int suspended;
+
 		in = use_pack(p, w_curs, curpos, &stream.avail_in);
 		stream.next_in = in;
+		suspended = obj_read_suspend();
 		st = git_inflate(&stream, Z_FINISH);
+		obj_read_resume(suspended);
 		if (!stream.avail_out)
 			break; /* the payload is larger than it should be */
 		curpos += stream.next_in - in;
@@ -2355,13 +2448,11 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		void *delta_data;
 		void *base = data;
 		unsigned long delta_size, base_size = size;
-		int i;
+		off_t base_offset = obj_offset;
+		int i, cache_base = !!base;
 
 		data = NULL;
 
-		if (base)
-			add_delta_base_cache(p, obj_offset, base, base_size, type);
-
 		if (!base) {
 			/*
 			 * We're probably in deep shit, but let's try to fetch
@@ -2391,20 +2482,30 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		if (!base)
 			continue;
 
+		/*
+		 * Inflate the delta and apply it before handing the base
+		 * over to the cache: the object read lock is dropped while
+		 * we do, and another thread could evict it meanwhile.
+		 */
 		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
+		if (delta_data) {
+			int suspended = obj_read_suspend();
+			data = patch_delta(base, base_size,
+					   delta_data, delta_size,
+					   &size);
+			obj_read_resume(suspended);
+		}
+
+		if (cache_base)
+			add_delta_base_cache(p, base_offset, base, base_size, type);
 
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
 			      "at offset %"PRIuMAX" from %s",
 			      (uintmax_t)curpos, p->pack_name);
-			data = NULL;
 			continue;
 		}
 
-		data = patch_delta(base, base_size,
-				   delta_data, delta_size,
-				   &size);
-
 		/*
 		 * We could not apply the delta; warn the user, but keep going.
 		 * Our failure will be noticed either in the next iteration of
@@ -2698,7 +2799,7 @@ static int sha1_loose_object_info(const unsigned char *sha1,
 	return 0;
 }
 
-int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi, unsigned flags)
+static int sha1_object_info_extended_1(const unsigned char *sha1, struct object_info *oi, unsigned flags)
 {
 	struct cached_object *co;
 	struct pack_entry e;
@@ -2747,7 +2848,7 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 		mark_bad_packed_object(e.p, real);
 		if (oi->typep == &real_type)
 			oi->typep = NULL;
-		return sha1_object_info_extended(real, oi, 0);
+		return sha1_object_info_extended_1(real, oi, 0);
 	} else if (in_delta_base_cache(e.p, e.offset)) {
 		oi->whence = OI_DBCACHED;
 	} else {
@@ -2765,6 +2866,16 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 	return 0;
 }
 
+int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi, unsigned flags)
+{
+	int ret;
+
+	obj_read_lock();
+	ret = sha1_object_info_extended_1(sha1, oi, flags);
+	obj_read_unlock();
+	return ret;
+}
+
 /* returns enum object_type or negative */
 int sha1_object_info(const unsigned char *sha1, unsigned long *sizep)
 {
@@ -2839,7 +2950,9 @@ static void *read_object(const unsigned char *sha1, enum object_type *type,
 		return buf;
 	map = map_sha1_file(sha1, &mapsize);
 	if (map) {
+		int suspended = obj_read_suspend();
 		buf = unpack_sha1_file(map, mapsize, type, size, sha1);
+		obj_read_resume(suspended);
 		munmap(map, mapsize);
 		return buf;
 	}
@@ -2852,10 +2965,10 @@ static void *read_object(const unsigned char *sha1, enum object_type *type,
  * deal with them should arrange to call read_object() and give error
  * messages themselves.
  */
-void *read_sha1_file_extended(const unsigned char *sha1,
-			      enum object_type *type,
-			      unsigned long *size,
-			      unsigned flag)
+static void *read_sha1_file_extended_1(const unsigned char *sha1,
+				       enum object_type *type,
+				       unsigned long *size,
+				       unsigned flag)
 {
 	void *data;
 	const struct packed_git *p;
@@ -2888,6 +3001,19 @@ void *read_sha1_file_extended(const unsigned char *sha1,
 	return NULL;
 }
 
+void *read_sha1_file_extended(const unsigned char *sha1,
+			      enum object_type *type,
+			      unsigned long *size,
+			      unsigned flag)
+{
+	void *data;
+
+	obj_read_lock();
+	data = read_sha1_file_extended_1(sha1, type, size, flag);
+	obj_read_unlock();
+	return data;
+}
+
 void *read_object_with_reference(const unsigned char *sha1,
 				 const char *required_type_name,
 				 unsigned long *size,
@@ -3222,7 +3348,7 @@ int has_sha1_pack(const unsigned char *sha1)
 	return find_pack_entry(sha1, &e);
 }
 
-int has_sha1_file_with_flags(const unsigned char *sha1, int flags)
+static int has_sha1_file_with_flags_1(const unsigned char *sha1, int flags)
 {
 	struct pack_entry e;
 
@@ -3236,6 +3362,16 @@ int has_sha1_file_with_flags(const unsigned char *sha1, int flags)
 	return find_pack_entry(sha1, &e);
 }
 
+int has_sha1_file_with_flags(const unsigned char *sha1, int flags)
+{
+	int ret;
+
+	obj_read_lock();
+	ret = has_sha1_file_with_flags_1(sha1, flags);
+	obj_read_unlock();
+	return ret;
+}
+
 int has_object_file(const struct object_id *oid)
 {
 	return has_sha1_file(oid->hash);
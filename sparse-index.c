@@ -0,0 +1,249 @@
+#include "cache.h"
+#include "tree.h"
+#include "pathspec.h"
+#include "cache-tree.h"
+#include "sparse-index.h"
+
+int want_sparse_index(struct index_state *istate)
+{
+	int sparse_index = 0;
+
+	if (!core_apply_sparse_checkout || istate->split_index)
+		return 0;
+	if (git_config_get_bool("index.sparse", &sparse_index))
+		return 0;
+	return sparse_index;
+}
+
+static void append_entry(struct index_state *istate, struct cache_entry *ce)
+{
+	ALLOC_GROW(istate->cache, istate->cache_nr + 1, istate->cache_alloc);
+	istate->cache[istate->cache_nr++] = ce;
+}
+
+static struct cache_entry *make_sparse_dir_entry(const char *path, int len,
+						 const unsigned char *sha1)
+{
+	struct cache_entry *ce = xcalloc(1, cache_entry_size(len));
+
+	memcpy(ce->name, path, len);
+	ce->ce_namelen = len;
+	ce->ce_mode = S_IFDIR;
+	ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	hashcpy(ce->sha1, sha1);
+	return ce;
+}
+
+/*
+ * A directory can be collapsed when its cache-tree node is valid
+ * and accounts for every entry in it, and none of those entries
+ * is present in the working tree or needs anything but stage #0.
+ */
+static int can_collapse(struct index_state *istate, struct cache_tree *it,
+			int start, int end)
+{
+	int i;
+
+	if (!it || it->entry_count != end - start)
+		return 0;
+	for (i = start; i < end; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce_stage(ce) || !ce_skip_worktree(ce) ||
+		    (ce->ce_flags & CE_REMOVE))
+			return 0;
+	}
+	return 1;
+}
+
+static void collapse_dir(struct index_state *istate,
+			 struct index_state *sparse,
+			 struct cache_tree *it, struct strbuf *base,
+			 int start, int end)
+{
+	int i = start;
+
+	while (i < end) {
+		struct cache_entry *ce = istate->cache[i];
+		const char *name = ce->name + base->len;
+		const char *slash = strchr(name, '/');
+		struct cache_tree_sub *sub = NULL;
+		int j, len, pos, baselen;
+
+		if (!slash) {
+			append_entry(sparse, ce);
+			i++;
+			continue;
+		}
+
+		len = slash - name;
+		for (j = i + 1; j < end; j++)
+			if (strncmp(istate->cache[j]->name + base->len,
+				    name, len + 1))
+				break;
+
+		pos = it ? cache_tree_subtree_pos(it, name, len) : -1;
+		if (0 <= pos)
+			sub = it->down[pos];
+
+		baselen = base->len;
+		strbuf_add(base, name, len + 1);
+		if (sub && can_collapse(istate, sub->cache_tree, i, j))
+			append_entry(sparse,
+				     make_sparse_dir_entry(base->buf, base->len,
+							   sub->cache_tree->sha1));
+		else
+			collapse_dir(istate, sparse,
+				     sub ? sub->cache_tree : NULL,
+				     base, i, j);
+		strbuf_setlen(base, baselen);
+		i = j;
+	}
+}
+
+int make_sparse_copy(struct index_state *istate, struct index_state *sparse)
+{
+	struct strbuf base = STRBUF_INIT;
+	int i, collapsed = 0;
+
+	if (istate->sparse_index || !want_sparse_index(istate))
+		return 0;
+
+	for (i = 0; i < istate->cache_nr; i++)
+		if (ce_skip_worktree(istate->cache[i]))
+			break;
+	if (i == istate->cache_nr)
+		return 0;
+
+	if (!istate->cache_tree)
+		istate->cache_tree = cache_tree();
+	if (cache_tree_update(istate, WRITE_TREE_SILENT))
+		return 0;
+
+	*sparse = *istate;
+	sparse->cache = NULL;
+	sparse->cache_nr = sparse->cache_alloc = 0;
+	sparse->cache_tree = NULL;
+	sparse->name_hash_initialized = 0;
+
+	collapse_dir(istate, sparse, istate->cache_tree, &base,
+		     0, istate->cache_nr);
+	strbuf_release(&base);
+
+	for (i = 0; i < sparse->cache_nr; i++)
+		if (S_ISSPARSEDIR(sparse->cache[i]->ce_mode))
+			collapsed++;
+	if (!collapsed) {
+		free(sparse->cache);
+		return 0;
+	}
+
+	sparse->sparse_index = 1;
+	sparse->cache_tree = cache_tree();
+	if (cache_tree_update(sparse, WRITE_TREE_SILENT))
+		cache_tree_free(&sparse->cache_tree);
+	return 1;
+}
+
+void discard_sparse_copy(struct index_state *istate, struct index_state *sparse)
+{
+	int i;
+
+	for (i = 0; i < sparse->cache_nr; i++)
+		if (S_ISSPARSEDIR(sparse->cache[i]->ce_mode))
+			free(sparse->cache[i]);
+	free(sparse->cache);
+	cache_tree_free(&sparse->cache_tree);
+
+	istate->version = sparse->version;
+	istate->timestamp = sparse->timestamp;
+	hashcpy(istate->sha1, sparse->sha1);
+}
+
+static int add_path_to_index(const unsigned char *sha1, struct strbuf *base,
+			     const char *path, unsigned int mode, int stage,
+			     void *context)
+{
+	struct index_state *istate = context;
+	struct cache_entry *ce;
+	int len;
+
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+
+	len = base->len + strlen(path);
+	ce = xcalloc(1, cache_entry_size(len));
+	memcpy(ce->name, base->buf, base->len);
+	memcpy(ce->name + base->len, path, len - base->len);
+	ce->ce_namelen = len;
+	ce->ce_mode = create_ce_mode(mode);
+	ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	hashcpy(ce->sha1, sha1);
+	append_entry(istate, ce);
+	add_name_hash(istate, ce);
+	return 0;
+}
+
+void ensure_full_index(struct index_state *istate)
+{
+	struct cache_entry **old = istate->cache;
+	unsigned int i, old_nr = istate->cache_nr;
+	unsigned int cache_changed = istate->cache_changed;
+	struct pathspec pathspec;
+
+	if (!istate->sparse_index)
+		return;
+
+	memset(&pathspec, 0, sizeof(pathspec));
+	istate->cache = NULL;
+	istate->cache_nr = istate->cache_alloc = 0;
+	for (i = 0; i < old_nr; i++) {
+		struct cache_entry *ce = old[i];
+		struct tree *tree;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode)) {
+			append_entry(istate, ce);
+			continue;
+		}
+		tree = parse_tree_indirect(ce->sha1);
+		if (!tree)
+			die("unable to expand sparse directory '%s': bad tree %s",
+			    ce->name, sha1_to_hex(ce->sha1));
+		if (read_tree_recursive(tree, ce->name, ce_namelen(ce), 0,
+					&pathspec, add_path_to_index, istate))
+			die("unable to expand sparse directory '%s'", ce->name);
+		remove_name_hash(istate, ce);
+		free(ce);
+	}
+	free(old);
+	istate->sparse_index = 0;
+
+	/*
+	 * The cache-tree counted each sparse directory as a single
+	 * entry; recompute it for the expanded entries.  This is an
+	 * in-core conversion only and does not by itself make the
+	 * index need writing.
+	 */
+	cache_tree_free(&istate->cache_tree);
+	istate->cache_tree = cache_tree();
+	cache_tree_update(istate, WRITE_TREE_SILENT | WRITE_TREE_DRY_RUN |
+			  WRITE_TREE_MISSING_OK);
+	istate->cache_changed = cache_changed;
+}
+
+void ensure_full_index_for_worktree(struct index_state *istate)
+{
+	struct stat st;
+	int i;
+
+	if (!istate->sparse_index)
+		return;
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (S_ISSPARSEDIR(ce->ce_mode) && !lstat(ce->name, &st)) {
+			ensure_full_index(istate);
+			return;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef SPARSE_INDEX_H
+#define SPARSE_INDEX_H
+
+struct index_state;
+
+/*
+ * Should the index be written with out-of-cone directories
+ * collapsed into sparse directory entries?
+ */
+int want_sparse_index(struct index_state *istate);
+
+/*
+ * Prepare "sparse" as a copy of "istate" in which every directory
+ * whose entries are all skip-worktree is replaced by a single
+ * sparse directory entry.  Returns 1 if such a copy was made, in
+ * which case it must be released with discard_sparse_copy() once
+ * it has been written out, or 0 if "istate" should be written as-is.
+ */
+int make_sparse_copy(struct index_state *istate, struct index_state *sparse);
+void discard_sparse_copy(struct index_state *istate, struct index_state *sparse);
+
+/*
+ * Replace every sparse directory entry in "istate" by the entries
+ * of the tree it records.  Callers that look at individual paths
+ * outside the sparse checkout must call this first.
+ */
+void ensure_full_index(struct index_state *istate);
+
+/*
+ * Expand "istate" only if one of its sparse directories exists in the
+ * working tree after all, so that callers looking for untracked files
+ * can tell them apart from tracked ones.
+ */
+void ensure_full_index_for_worktree(struct index_state *istate);
+
+#endif
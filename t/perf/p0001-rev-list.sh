@@ -14,6 +14,10 @@ test_perf 'rev-list --all --objects' '
 	git rev-list --all --objects >/dev/null
 '
 
+test_perf 'rev-list --all --objects (core.traverseThreads=0)' '
+	git -c core.traverseThreads=0 rev-list --all --objects >/dev/null
+'
+
 test_expect_success 'create new unreferenced commit' '
 	commit=$(git commit-tree HEAD^{tree} -p HEAD)
 '
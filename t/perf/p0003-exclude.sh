@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description="Tests performance of matching paths against many exclude patterns"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup large .gitignore' '
+	for i in $(test_seq 1 2000)
+	do
+		echo "*.gen$i" &&
+		echo "generated_$i.c" &&
+		echo "/out/gen$i/" || return 1
+	done >.git/info/exclude &&
+	echo "*~" >>.git/info/exclude &&
+	echo "!*.keep~" >>.git/info/exclude
+'
+
+test_perf 'status --ignored with many patterns' '
+	git status --porcelain --ignored >/dev/null
+'
+
+test_perf 'ls-files -o -i with many patterns' '
+	git ls-files -o -i --exclude-standard >/dev/null
+'
+
+test_perf 'check-ignore every tracked path' '
+	git ls-files | git check-ignore --stdin --no-index >/dev/null || :
+'
+
+test_done
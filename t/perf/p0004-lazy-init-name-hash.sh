@@ -0,0 +1,18 @@
+#!/bin/sh
+
+test_description="Tests performance of building the name hashes"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+count=20
+test_perf "single-threaded, $count times" "
+	test-lazy-init-name-hash -s -p $count
+"
+
+test_perf "multi-threaded, $count times" "
+	test-lazy-init-name-hash -m -p $count
+"
+
+test_done
@@ -0,0 +1,40 @@
+#!/bin/sh
+
+test_description="Tests diff performance on large generated files"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup history of large generated files' '
+	git checkout -q --orphan generated &&
+	git rm -q -r --cached . &&
+	for i in $(test_seq 1 20)
+	do
+		for f in a b c
+		do
+			test_seq $i 5 200000 |
+			sed -e "s/^/generated line /" >gen-$f.txt || return 1
+		done &&
+		git add gen-a.txt gen-b.txt gen-c.txt &&
+		git commit -q -m "generated $i" || return 1
+	done
+'
+
+test_perf 'log -p on generated files (Myers)' '
+	git log -p -- "gen-*.txt" >/dev/null
+'
+
+test_perf 'log -p on generated files --histogram' '
+	git log -p --histogram -- "gen-*.txt" >/dev/null
+'
+
+test_perf 'log -p on generated files --patience' '
+	git log -p --patience -- "gen-*.txt" >/dev/null
+'
+
+test_perf 'log --stat on generated files' '
+	git log --stat -- "gen-*.txt" >/dev/null
+'
+
+test_done
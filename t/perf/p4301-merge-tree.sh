@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="git merge-tree --write-tree performance"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'select pairs of recent merge parents' '
+	git rev-list --merges --parents -n 50 HEAD |
+	while read merge one two rest
+	do
+		echo "$one $two"
+	done >pairs &&
+	test -s pairs
+'
+
+test_perf 'merge-tree --write-tree, one process per merge' '
+	while read one two
+	do
+		git merge-tree --write-tree $one $two >/dev/null
+	done <pairs
+'
+
+test_perf 'merge-tree --write-tree --stdin' '
+	git merge-tree --write-tree --stdin <pairs >/dev/null
+'
+
+test_done
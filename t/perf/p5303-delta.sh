@@ -0,0 +1,25 @@
+#!/bin/sh
+
+test_description='Tests delta computation performance'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'pick the largest blob and its previous version' '
+	path=$(git ls-tree -r -l HEAD | sort -n -k 4 | tail -n 1 | cut -f 2) &&
+	git cat-file blob HEAD:"$path" >new &&
+	old=$(git rev-list -2 HEAD -- "$path" | tail -n 1) &&
+	git cat-file blob $old:"$path" >old &&
+	test-delta -b old new 1 >delta-size
+'
+
+test_perf 'create delta of largest blob against its previous version' '
+	test-delta -b old new 100 >/dev/null
+'
+
+test_perf 'create delta of largest blob against a reversed copy' '
+	sort -r new >reversed &&
+	test-delta -b reversed new 20 >/dev/null
+'
+
+test_done
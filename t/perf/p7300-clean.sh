@@ -28,6 +28,10 @@ test_perf 'clean many untracked sub dirs, ignore nested git' '
 	git clean -n -q -f -f -d 100000_sub_dirs/
 '
 
+test_perf 'clean many untracked sub dirs, core.untrackedThreads=0' '
+	git -c core.untrackedThreads=0 clean -n -q -f -f -d 100000_sub_dirs/
+'
+
 test_perf 'ls-files -o' '
 	git ls-files -o
 '
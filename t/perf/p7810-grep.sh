@@ -19,5 +19,51 @@ test_perf 'grep --cached, cheap regex' '
 test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
+test_perf 'grep HEAD, cheap regex' '
+	git grep some_nonexistent_string HEAD || :
+'
+
+test_perf 'grep-index build' '
+	git grep-index build
+'
+test_perf 'grep HEAD with trigram index, cheap regex' '
+	git grep some_nonexistent_string HEAD || :
+'
+test_perf 'grep HEAD with trigram index, expensive regex' '
+	git grep "^.* *some_nonexistent_string$" HEAD || :
+'
+test_expect_success 'remove trigram index' '
+	rm -rf "$(git rev-parse --git-path objects/info/grep-index)"
+'
+
+for threads in 1 2 4 8
+do
+	test_perf "grep --threads=$threads --cached" "
+		git grep --threads=$threads --cached some_nonexistent_string || :
+	"
+	test_perf "grep --threads=$threads HEAD" "
+		git grep --threads=$threads some_nonexistent_string HEAD || :
+	"
+done
+
+test_expect_success 'set up lists of fixed strings' '
+	git ls-files | sed -e "s|.*/||" -e "s|\..*||" -e "/^$/d" | sort -u >names &&
+	head -n 10 names >names.10 &&
+	head -n 5000 names >names.5000
+'
+
+for n in 10 5000
+do
+	test_perf "grep -F -f with $n strings" "
+		git grep -F -f names.$n >/dev/null || :
+	"
+	test_perf "grep -F -i -f with $n strings" "
+		git grep -F -i -f names.$n >/dev/null || :
+	"
+	test_perf "grep -F -f with $n strings, Commentz-Walter" "
+		GIT_TEST_KWSET_AC_MIN_WORDS=1000000 \\
+			git grep -F -f names.$n >/dev/null || :
+	"
+done
 
 test_done
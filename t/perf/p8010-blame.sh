@@ -0,0 +1,37 @@
+#!/bin/sh
+
+test_description="git-blame performance"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'select the file changed most often' '
+	git log --format= --name-only -n 2000 HEAD |
+	sort | uniq -c | sort -rn |
+	while read count name
+	do
+		if git cat-file -e "HEAD:$name" 2>/dev/null
+		then
+			echo "$name"
+			break
+		fi
+	done >filelist &&
+	test -s filelist
+'
+
+file=$(cat filelist)
+export file
+
+for threads in 1 2 4 8
+do
+	test_perf "blame --threads=$threads" "
+		git blame --threads=$threads -- \"\$file\" >/dev/null
+	"
+done
+
+test_perf 'blame -M --threads=4' '
+	git blame -M --threads=4 -- "$file" >/dev/null
+'
+
+test_done
@@ -841,4 +841,60 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	test_cmp expect actual
 '
 
+test_expect_success 'last match wins across literal, extension and wildcard patterns' '
+	mkdir -p lastmatch/sub &&
+	cat >lastmatch/.gitignore <<-\EOF &&
+	*.log
+	keep.log
+	!*.log
+	!keep.tar.gz
+	*.gz
+	!important.*
+	sub/deep.log
+	debug.log
+	!sub/*.log
+	/sub/
+	!/sub/
+	literal
+	EOF
+	cat >expect <<-\EOF &&
+	lastmatch/.gitignore:8:debug.log	lastmatch/debug.log
+	lastmatch/.gitignore:3:!*.log	lastmatch/keep.log
+	lastmatch/.gitignore:5:*.gz	lastmatch/keep.tar.gz
+	lastmatch/.gitignore:6:!important.*	lastmatch/important.gz
+	lastmatch/.gitignore:9:!sub/*.log	lastmatch/sub/deep.log
+	lastmatch/.gitignore:11:!/sub/	lastmatch/sub
+	lastmatch/.gitignore:12:literal	lastmatch/sub/literal
+	::	lastmatch/other.txt
+	EOF
+	git check-ignore -v -n --no-index \
+		lastmatch/debug.log lastmatch/keep.log lastmatch/keep.tar.gz \
+		lastmatch/important.gz lastmatch/sub/deep.log lastmatch/sub \
+		lastmatch/sub/literal lastmatch/other.txt >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'directory-only literal and extension patterns' '
+	mkdir -p dironly/build.d dironly/out &&
+	>dironly/build.d/file &&
+	>dironly/out/file &&
+	>dironly/file.d &&
+	>dironly/outfile &&
+	cat >dironly/.gitignore <<-\EOF &&
+	*.d/
+	out/
+	EOF
+	cat >expect <<-\EOF &&
+	dironly/.gitignore:1:*.d/	dironly/build.d
+	dironly/.gitignore:2:out/	dironly/out
+	::	dironly/file.d
+	::	dironly/outfile
+	EOF
+	for path in build.d out file.d outfile
+	do
+		test_might_fail git check-ignore -v -n --no-index dironly/$path || return 1
+	done >actual &&
+	test_cmp expect actual
+'
+
 test_done
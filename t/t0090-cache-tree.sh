@@ -252,4 +252,70 @@ test_expect_success 'switching trees does not invalidate shared index' '
 	test_cmp before after
 '
 
+test_expect_success 'setup for unpacking with the cache-tree' '
+	git init unpack &&
+	(
+		cd unpack &&
+		mkdir -p same/sub changed &&
+		for f in top same/a same/sub/b changed/c
+		do
+			echo $f >$f || return 1
+		done &&
+		git add . &&
+		test_tick &&
+		git commit -m base &&
+		git checkout -b other &&
+		echo other >changed/c &&
+		git commit -a -m other &&
+		git checkout master
+	)
+'
+
+test_expect_success 'read-tree -m skips unchanged directories' '
+	(
+		cd unpack &&
+		git read-tree --debug-unpack -m -u HEAD other >out &&
+		grep "entries from same/a to same/sub/b using the cache-tree" out &&
+		! grep "from changed/c .* using the cache-tree" out &&
+		git read-tree -m -u HEAD other &&
+		git ls-files -s >actual &&
+		git ls-tree -r other | sed -e "s/ blob / /" -e "s/\t/ 0\t/" >expect &&
+		test_cmp expect actual &&
+		echo other >expect &&
+		test_cmp expect changed/c &&
+		git read-tree -m -u other HEAD
+	)
+'
+
+test_expect_success 'local changes survive skipping their directory' '
+	(
+		cd unpack &&
+		echo local >same/sub/b &&
+		git checkout other &&
+		echo local >expect &&
+		test_cmp expect same/sub/b &&
+		git diff --name-only >actual &&
+		echo same/sub/b >expect &&
+		test_cmp expect actual &&
+		git checkout -f master &&
+		echo same/sub/b >expect &&
+		test_cmp expect same/sub/b
+	)
+'
+
+test_expect_success 'three-way read-tree skips unchanged directories' '
+	(
+		cd unpack &&
+		git read-tree --debug-unpack -m master master other >out &&
+		grep "entries from same/a to same/sub/b using the cache-tree" out &&
+		git read-tree -m master master other &&
+		git ls-files -s -u >actual &&
+		test_must_be_empty actual &&
+		git write-tree >actual &&
+		git rev-parse other^{tree} >expect &&
+		test_cmp expect actual &&
+		git reset --hard
+	)
+'
+
 test_done
@@ -0,0 +1,151 @@
+#!/bin/sh
+
+test_description='sparse index with collapsed out-of-cone directories'
+
+. ./test-lib.sh
+
+# a split index is never collapsed, so do not let the test mode add one
+sane_unset GIT_TEST_SPLIT_INDEX
+
+test_expect_success 'setup' '
+	git init src &&
+	(
+		cd src &&
+		mkdir -p in/deep out/sub out-x out0 &&
+		for f in a in/x in/deep/y out/p out/sub/q out-x/z out0/w out.txt
+		do
+			echo $f >$f || return 1
+		done &&
+		git add . &&
+		test_tick &&
+		git commit -m initial &&
+		git checkout -b other &&
+		echo changed >out/sub/q &&
+		echo changed >in/x &&
+		git commit -a -m other &&
+		git checkout master
+	) &&
+	for repo in full sparse
+	do
+		git clone src $repo &&
+		git -C $repo config core.sparsecheckout true &&
+		printf "/a\n/in/\n" >$repo/.git/info/sparse-checkout &&
+		git -C $repo read-tree -m -u HEAD || return 1
+	done &&
+	git -C sparse config index.sparse true &&
+	git -C sparse read-tree -m -u HEAD
+'
+
+test_expect_success 'out-of-cone directories are collapsed' '
+	cat >expect <<-EOF &&
+	100644 $(git -C src rev-parse HEAD:a) 0	a
+	100644 $(git -C src rev-parse HEAD:in/deep/y) 0	in/deep/y
+	100644 $(git -C src rev-parse HEAD:in/x) 0	in/x
+	040000 $(git -C src rev-parse HEAD:out-x) 0	out-x/
+	100644 $(git -C src rev-parse HEAD:out.txt) 0	out.txt
+	040000 $(git -C src rev-parse HEAD:out) 0	out/
+	040000 $(git -C src rev-parse HEAD:out0) 0	out0/
+	EOF
+	test-dump-sparse-index sparse/.git/index >actual &&
+	test_cmp expect actual &&
+	echo "not a sparse index" >expect &&
+	test-dump-sparse-index full/.git/index >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'commands see the full index' '
+	git -C full ls-files -s -t >expect &&
+	git -C sparse ls-files -s -t >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'status matches a full index' '
+	for repo in full sparse
+	do
+		echo more >>$repo/in/x &&
+		echo new >$repo/in/new &&
+		git -C $repo status --porcelain >$repo-status || return 1
+	done &&
+	test_cmp full-status sparse-status
+'
+
+test_expect_success 'status does not read collapsed directories' '
+	test_when_finished "rm -rf sparse-copy" &&
+	cp -R sparse sparse-copy &&
+	tree=$(git -C src rev-parse HEAD:out) &&
+	rm sparse-copy/.git/objects/$(echo $tree | sed "s|^..|&/|") &&
+	git -C sparse-copy status --porcelain >actual &&
+	test_cmp full-status actual
+'
+
+test_expect_success 'status expands collapsed directories that changed' '
+	for repo in full sparse
+	do
+		git -C $repo reset --soft origin/other &&
+		git -C $repo status --porcelain >$repo-status &&
+		git -C $repo reset --soft master || return 1
+	done &&
+	test_cmp full-status sparse-status &&
+	grep "^M  out/sub/q" sparse-status
+'
+
+test_expect_success 'status shows untracked files in collapsed directories' '
+	for repo in full sparse
+	do
+		mkdir $repo/out &&
+		echo p >$repo/out/p &&
+		echo new >$repo/out/new &&
+		git -C $repo status --porcelain >$repo-status &&
+		rm -r $repo/out || return 1
+	done &&
+	test_cmp full-status sparse-status &&
+	grep "^?? out/new" sparse-status
+'
+
+test_expect_success 'commit records the same tree' '
+	for repo in full sparse
+	do
+		git -C $repo add in/new &&
+		test_tick &&
+		git -C $repo commit -a -m update || return 1
+	done &&
+	git -C full rev-parse HEAD^{tree} >expect &&
+	git -C sparse rev-parse HEAD^{tree} >actual &&
+	test_cmp expect actual &&
+	test-dump-sparse-index sparse/.git/index >actual &&
+	grep "^040000 .*	out/$" actual
+'
+
+test_expect_success 'checkout expands and collapses again' '
+	for repo in full sparse
+	do
+		git -C $repo checkout other || return 1
+	done &&
+	git -C full ls-files -s -t >expect &&
+	git -C sparse ls-files -s -t >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing sparse/out &&
+	echo changed >expect &&
+	test_cmp expect sparse/in/x &&
+	test-dump-sparse-index sparse/.git/index >actual &&
+	grep "^040000 $(git -C src rev-parse other:out) 0	out/$" actual
+'
+
+test_expect_success 'write-tree from a sparse index' '
+	git -C sparse write-tree >expect &&
+	git -C sparse rev-parse HEAD^{tree} >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'disabling index.sparse writes a full index' '
+	git -C sparse config index.sparse false &&
+	git -C sparse read-tree -m -u HEAD &&
+	echo "not a sparse index" >expect &&
+	test-dump-sparse-index sparse/.git/index >actual &&
+	test_cmp expect actual &&
+	git -C full ls-files -s -t >expect &&
+	git -C sparse ls-files -s -t >actual &&
+	test_cmp expect actual
+'
+
+test_done
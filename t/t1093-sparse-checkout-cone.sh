@@ -0,0 +1,91 @@
+#!/bin/sh
+
+test_description='sparse checkout with cone-mode patterns'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir -p A/B/C A/D E/G &&
+	for f in a A/f A/B/f A/B/C/f A/D/f E/f E/G/f
+	do
+		echo $f >$f || return 1
+	done &&
+	git add . &&
+	test_commit initial &&
+	git config core.sparsecheckout true &&
+	cat >cone <<-\EOF &&
+	/*
+	!/*/
+	/A/
+	!/A/*/
+	/A/B/
+	EOF
+	cat >expect <<-\EOF
+	H A/B/C/f
+	H A/B/f
+	S A/D/f
+	H A/f
+	S E/G/f
+	S E/f
+	H a
+	H initial.t
+	EOF
+'
+
+test_expect_success 'cone patterns without cone mode' '
+	cp cone .git/info/sparse-checkout &&
+	git read-tree -m -u HEAD &&
+	git ls-files -t >actual &&
+	test_cmp expect actual &&
+	test_path_is_file A/B/C/f &&
+	test_path_is_missing A/D
+'
+
+test_expect_success 'cone mode gives the same result' '
+	git config core.sparsecheckoutcone true &&
+	echo "/*" >.git/info/sparse-checkout &&
+	git read-tree -m -u HEAD &&
+	test_path_is_file E/G/f &&
+	cp cone .git/info/sparse-checkout &&
+	git read-tree -m -u HEAD 2>err &&
+	test_must_be_empty err &&
+	git ls-files -t >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing A/D &&
+	test_path_is_missing E
+'
+
+test_expect_success 'cone mode without parent patterns' '
+	printf "/*\n!/*/\n/E/G/\n" >.git/info/sparse-checkout &&
+	git read-tree -m -u HEAD &&
+	git ls-files -t >actual &&
+	cat >expect.nested <<-\EOF &&
+	S A/B/C/f
+	S A/B/f
+	S A/D/f
+	S A/f
+	H E/G/f
+	S E/f
+	H a
+	H initial.t
+	EOF
+	test_cmp expect.nested actual
+'
+
+test_expect_success 'non-cone pattern falls back to full matching' '
+	cp cone .git/info/sparse-checkout &&
+	echo "*.t" >>.git/info/sparse-checkout &&
+	git read-tree -m -u HEAD 2>err &&
+	test_i18ngrep "unrecognized pattern: .\*\.t." err &&
+	test_i18ngrep "disabling cone pattern matching" err &&
+	git ls-files -t >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'negated directory without its parent is rejected' '
+	printf "/*\n!/*/\n!/A/*/\n" >.git/info/sparse-checkout &&
+	git read-tree -m -u HEAD 2>err &&
+	test_i18ngrep "unrecognized negative pattern" err
+'
+
+test_done
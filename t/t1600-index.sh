@@ -73,4 +73,49 @@ test_expect_success 'GIT_INDEX_VERSION takes precedence over config' '
 	)
 '
 
+test_expect_success 'index.skipHash writes a null trailer' '
+	(
+		sane_unset GIT_INDEX_VERSION &&
+		rm -f .git/index &&
+		git config --unset-all index.version &&
+		git -c index.skipHash=true add a &&
+		printf "%040d\n" 0 >expect &&
+		tail -c 20 .git/index | od -An -tx1 | tr -d " \n" >actual &&
+		echo >>actual &&
+		test_cmp expect actual &&
+		git ls-files >actual &&
+		echo a >expect &&
+		test_cmp expect actual &&
+		git fsck
+	)
+'
+
+test_expect_success 'changes are seen in an index without checksum' '
+	echo 2 >b &&
+	git -c index.skipHash=true add b &&
+	git ls-files >actual &&
+	printf "a\nb\n" >expect &&
+	test_cmp expect actual &&
+	git -c index.skipHash=true status --porcelain -uno >actual &&
+	printf "A  a\nA  b\n" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'index without checksum gets one again' '
+	git add a b &&
+	tail -c 20 .git/index | od -An -tx1 | tr -d " \n" >actual &&
+	! grep "^0*$" actual &&
+	git fsck
+'
+
+test_expect_success 'fsck verifies the index checksum' '
+	cp .git/index index.bak &&
+	test_when_finished "mv index.bak .git/index" &&
+	printf "\377" |
+	dd of=.git/index bs=1 seek=52 count=1 conv=notrunc &&
+	git ls-files -s >/dev/null &&
+	test_must_fail git fsck 2>err &&
+	grep "bad index file sha1 signature" err
+'
+
 test_done
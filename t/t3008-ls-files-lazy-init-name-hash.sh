@@ -0,0 +1,54 @@
+#!/bin/sh
+
+test_description='build the name hashes on several threads'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	blob=$(echo content | git hash-object -w --stdin) &&
+	for a in a B c
+	do
+		for b in one Two three
+		do
+			for c in $(test_seq 1 30)
+			do
+				printf "100644 %s\t%s/%s/f%d\n" $blob $a $b $c &&
+				printf "100644 %s\t%s/%s/deep/er/g%d\n" $blob $a $b $c ||
+				return 1
+			done
+		done &&
+		printf "100644 %s\t%s-file\n" $blob $a &&
+		printf "100644 %s\t%s/file\n" $blob $a || return 1
+	done >index-info &&
+	printf "100644 %s\ttop\n" $blob >>index-info &&
+	git update-index --index-info <index-info &&
+	git ls-files >files &&
+	test_line_count = 547 files
+'
+
+test_expect_success 'single-threaded' '
+	test-lazy-init-name-hash -s >out &&
+	echo ok >expect &&
+	tail -n 1 out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'multi-threaded' '
+	test-lazy-init-name-hash -m >out &&
+	echo ok >expect &&
+	tail -n 1 out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'directory names differing in case only' '
+	printf "100644 %s\tA/one/case\n" $blob |
+	git update-index --index-info &&
+	test-lazy-init-name-hash -s >out &&
+	tail -n 1 out >actual &&
+	test_cmp expect actual &&
+	test-lazy-init-name-hash -m >out &&
+	tail -n 1 out >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -230,4 +230,28 @@ test_expect_success 'rename pretty print common prefix and suffix overlap' '
 	test_i18ngrep " d/f/{ => f}/e " output
 '
 
+test_expect_success 'renames across directories with the same basename' '
+	mkdir -p base/one base/two &&
+	test_seq 1 20 >base/one/file &&
+	test_seq 101 120 >base/two/unrelated &&
+	git add base &&
+	git commit -m "add base" &&
+	mkdir base/three &&
+	git mv base/one/file base/three/file &&
+	echo 21 >>base/three/file &&
+	git rm -q base/two/unrelated &&
+	test_seq 201 220 >base/three/unrelated &&
+	git add base &&
+	git commit -m "move base files" &&
+	git diff -M --name-status HEAD^ HEAD >actual &&
+	cat >expect <<-\EOF &&
+	R094	base/one/file	base/three/file
+	D	base/two/unrelated
+	A	base/three/unrelated
+	EOF
+	sort actual >actual.sorted &&
+	sort expect >expect.sorted &&
+	test_cmp expect.sorted actual.sorted
+'
+
 test_done
@@ -333,4 +333,35 @@ test_expect_success 'merge --stat respects COLUMNS (long filename)' '
 	test_cmp expect actual
 '
 
+test_expect_success 'setup changes for counting lines' '
+	test_seq 1 50 >counted &&
+	git add counted &&
+	git commit -m "counted lines" &&
+	test_seq 1 50 |
+	sed -e "s/^1.$/changed &/" \
+	    -e "s/^3/  3/" \
+	    -e "/^40$/{p;s/.*//;}" >counted &&
+	git commit -a -m "change counted lines"
+'
+
+while read opts
+do
+	test_expect_success "numstat agrees with the patch ($opts)" '
+		git diff $opts HEAD^ HEAD -- counted >patch &&
+		sed -n -e "/^@@/,\$p" patch >lines &&
+		added=$(grep -c "^+" lines) &&
+		deleted=$(grep -c "^-" lines) &&
+		printf "%d\t%d\tcounted\n" $added $deleted >expect &&
+		git diff --numstat $opts HEAD^ HEAD -- counted >actual &&
+		test_cmp expect actual
+	'
+done <<\EOF
+--minimal
+--patience
+--histogram
+-w
+-b --histogram
+--ignore-blank-lines -w
+EOF
+
 test_done
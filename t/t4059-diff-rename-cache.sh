@@ -0,0 +1,77 @@
+#!/bin/sh
+
+test_description='rename detection cache'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 20 >one &&
+	test_seq 101 120 >two &&
+	git add . &&
+	git commit -m one &&
+	git mv one three &&
+	echo 21 >>three &&
+	git add three &&
+	git commit -m two &&
+	cat >expect <<-\EOF
+	R094	one	three
+	EOF
+'
+
+test_expect_success 'no cache without diff.renameCache' '
+	git diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	test_must_fail git rev-parse --verify -q refs/notes/renames
+'
+
+test_expect_success 'first run fills the cache' '
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git ls-tree refs/notes/renames >notes &&
+	test_line_count = 1 notes
+'
+
+test_expect_success 'second run gives the same result' '
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git ls-tree refs/notes/renames >notes &&
+	test_line_count = 1 notes
+'
+
+test_expect_success 'cached result is used' '
+	test_when_finished "git update-ref -d refs/notes/renames" &&
+	key=$(cut -f2 notes) &&
+	empty=$(git hash-object -w --stdin </dev/null) &&
+	tree=$(printf "100644 blob %s\t%s\n" $empty $key | git mktree) &&
+	commit=$(echo rename-cache-v1 | git commit-tree $tree) &&
+	git update-ref refs/notes/renames $commit &&
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	cat >expect.uncached <<-\EOF &&
+	D	one
+	A	three
+	EOF
+	test_cmp expect.uncached actual &&
+	git diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'different options use a different entry' '
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git -c diff.renameCache=true diff -M99% --name-status HEAD^ HEAD >actual &&
+	git ls-tree refs/notes/renames >notes &&
+	test_line_count = 2 notes
+'
+
+test_expect_success 'working tree changes are not cached' '
+	git update-ref -d refs/notes/renames &&
+	git mv three four &&
+	echo 22 >>four &&
+	git -c diff.renameCache=true diff -M --name-status HEAD >actual &&
+	cat >expect <<-\EOF &&
+	R094	three	four
+	EOF
+	test_cmp expect actual &&
+	test_must_fail git rev-parse --verify -q refs/notes/renames
+'
+
+test_done
@@ -0,0 +1,160 @@
+#!/bin/sh
+
+test_description='git merge-tree --write-tree'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 10 >numbers &&
+	test_seq 21 30 >moved &&
+	echo hello >greeting &&
+	git add . &&
+	test_tick &&
+	git commit -m base &&
+	git tag base &&
+
+	git checkout -b side1 &&
+	sed -e "2s/.*/two/" numbers >numbers.new &&
+	mv numbers.new numbers &&
+	git mv moved renamed &&
+	echo hi >greeting &&
+	git commit -a -m side1 &&
+
+	git checkout -b side2 base &&
+	sed -e "9s/.*/nine/" numbers >numbers.new &&
+	mv numbers.new numbers &&
+	sed -e "5s/.*/twenty-five/" moved >moved.new &&
+	mv moved.new moved &&
+	git commit -a -m side2 &&
+
+	git checkout -b side3 base &&
+	echo howdy >greeting &&
+	git commit -a -m side3 &&
+
+	git checkout side1 &&
+	git clone --bare . bare.git
+'
+
+test_expect_success 'clean merge writes the merged tree' '
+	git -C bare.git merge-tree --write-tree side1 side2 >actual &&
+	git merge -s ort side2 &&
+	git rev-parse HEAD^{tree} >expect &&
+	test_cmp expect actual &&
+	git -C bare.git cat-file -e $(cat actual) &&
+	git -C bare.git ls-tree -r $(cat actual) >tree &&
+	grep renamed tree &&
+	! grep moved tree
+'
+
+test_expect_success 'conflicted merge reports the stages' '
+	test_expect_code 1 git -C bare.git merge-tree --write-tree \
+		side1 side3 >actual &&
+	tree=$(head -n 1 actual) &&
+	cat >expect <<-EOF &&
+	$tree
+	100644 $(git rev-parse base:greeting) 1	greeting
+	100644 $(git rev-parse side1:greeting) 2	greeting
+	100644 $(git rev-parse side3:greeting) 3	greeting
+	EOF
+	test_cmp expect actual &&
+	git -C bare.git cat-file blob $tree:greeting >merged &&
+	cat >expect <<-\EOF &&
+	<<<<<<< side1
+	hi
+	=======
+	howdy
+	>>>>>>> side3
+	EOF
+	test_cmp expect merged
+'
+
+test_expect_success '--messages shows what git merge would say' '
+	test_expect_code 1 git -C bare.git merge-tree --write-tree --messages \
+		side1 side3 >actual &&
+	sed -e "1,/^\$/d" actual >messages &&
+	test_i18ngrep "^CONFLICT (content): Merge conflict in greeting" messages
+'
+
+test_expect_success '-z terminates records with NUL' '
+	test_expect_code 1 git -C bare.git merge-tree --write-tree -z \
+		side1 side3 >actual &&
+	tr "\000" Q <actual >actual.q &&
+	tree=$(git -C bare.git merge-tree --write-tree side1 side3 | head -n 1) &&
+	printf "%sQ100644 %s 1\tgreetingQ" $tree $(git rev-parse base:greeting) >expect &&
+	head -c $(wc -c <expect) actual.q >actual.head &&
+	test_cmp expect actual.head
+'
+
+test_expect_success '--stdin merges many pairs' '
+	printf "side1 side2\nside1 side3\nside2 side3\n" |
+	git -C bare.git merge-tree --write-tree --stdin >actual &&
+	{
+		echo 1 &&
+		git -C bare.git merge-tree --write-tree side1 side2 &&
+		echo &&
+		echo 0 &&
+		test_expect_code 1 git -C bare.git merge-tree --write-tree \
+			side1 side3 &&
+		echo &&
+		echo 1 &&
+		git -C bare.git merge-tree --write-tree side2 side3 &&
+		echo
+	} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--stdin reports bad lines and goes on' '
+	printf "side1 side2\nnope side3\nside1\nside2 side3\n" |
+	test_expect_code 1 git -C bare.git merge-tree --write-tree --stdin \
+		>actual &&
+	{
+		echo 1 &&
+		git -C bare.git merge-tree --write-tree side1 side2 &&
+		echo &&
+		echo error &&
+		echo "not a valid commit: nope" &&
+		echo &&
+		echo error &&
+		echo "malformed input line: '"'"'side1'"'"'" &&
+		echo &&
+		echo 1 &&
+		git -C bare.git merge-tree --write-tree side2 side3 &&
+		echo
+	} >expect &&
+	test_i18ncmp expect actual
+'
+
+test_expect_success 'file moved out of the way of a directory' '
+	git checkout -b df-dir base &&
+	git rm greeting &&
+	mkdir greeting &&
+	echo sub >greeting/sub &&
+	git add greeting/sub &&
+	git commit -m df-dir &&
+	git checkout -b df-file base &&
+	echo changed >>greeting &&
+	git commit -a -m df-file &&
+	git push bare.git df-dir df-file &&
+	test_expect_code 1 git -C bare.git merge-tree --write-tree \
+		df-dir df-file >actual &&
+	tree=$(head -n 1 actual) &&
+	cat >expect <<-EOF &&
+	$tree
+	100644 $(git rev-parse base:greeting) 1	greeting
+	100644 $(git rev-parse df-file:greeting) 3	greeting
+	moved	greeting~df-file
+	EOF
+	test_cmp expect actual &&
+	git -C bare.git cat-file blob "$tree:greeting~df-file" >moved &&
+	git cat-file blob df-file:greeting >expect &&
+	test_cmp expect moved
+'
+
+test_expect_success 'bad input' '
+	test_must_fail git -C bare.git merge-tree --write-tree side1 &&
+	test_must_fail git -C bare.git merge-tree --write-tree side1 nosuch &&
+	echo side1 | test_must_fail git -C bare.git merge-tree --write-tree --stdin &&
+	test_must_fail git -C bare.git merge-tree --stdin side1 side2
+'
+
+test_done
@@ -59,6 +59,44 @@ rev_list_tests() {
 		test_cmp expect actual
 	'
 
+	test_expect_success "counting commits with --max-count ($state)" '
+		git rev-list --count --max-count=3 other...master >expect &&
+		git rev-list --use-bitmap-index --count --max-count=3 other...master >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting commits with --no-merges ($state)" '
+		git rev-list --count --no-merges HEAD~2..HEAD >expect &&
+		git rev-list --use-bitmap-index --count --no-merges HEAD~2..HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting objects via bitmap ($state)" '
+		git rev-list --count --objects HEAD~5..HEAD >expect &&
+		git rev-list --use-bitmap-index --count --objects HEAD~5..HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "disk usage of commits via bitmap ($state)" '
+		git rev-list HEAD~5..HEAD |
+		git cat-file --batch-check="%(objectsize:disk)" |
+		perl -lne "\$total += \$_; END { print \$total }" >expect &&
+		git rev-list --disk-usage HEAD~5..HEAD >actual.nobitmap &&
+		test_cmp expect actual.nobitmap &&
+		git rev-list --use-bitmap-index --disk-usage HEAD~5..HEAD >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "disk usage of objects via bitmap ($state)" '
+		git rev-list --objects HEAD tagged-blob | cut -d" " -f1 |
+		git cat-file --batch-check="%(objectsize:disk)" |
+		perl -lne "\$total += \$_; END { print \$total }" >expect &&
+		git rev-list --objects --disk-usage HEAD tagged-blob >actual.nobitmap &&
+		test_cmp expect actual.nobitmap &&
+		git rev-list --use-bitmap-index --objects --disk-usage HEAD tagged-blob >actual &&
+		test_cmp expect actual
+	'
+
 	test_expect_success "enumerate --objects ($state)" '
 		git rev-list --objects --use-bitmap-index HEAD >tmp &&
 		cut -d" " -f1 <tmp >tmp2 &&
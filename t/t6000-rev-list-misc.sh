@@ -100,4 +100,21 @@ test_expect_success '--bisect and --first-parent can not be combined' '
 	test_must_fail git rev-list --bisect --first-parent HEAD
 '
 
+test_expect_success 'reading trees on threads does not change --objects output' '
+	mkdir -p dir/sub &&
+	for i in 1 2 3 4 5
+	do
+		echo $i >dir/file$i &&
+		echo $i >dir/sub/file$i &&
+		git add dir &&
+		git commit -m "threads $i" || return 1
+	done &&
+	git rev-list --objects --all >expect &&
+	git -c core.traverseThreads=4 rev-list --objects --all >actual &&
+	test_cmp expect actual &&
+	git -c core.traverseThreads=4 rev-list --objects HEAD~3..HEAD >actual &&
+	git rev-list --objects HEAD~3..HEAD >expect &&
+	test_cmp expect actual
+'
+
 test_done
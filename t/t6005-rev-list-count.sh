@@ -48,4 +48,20 @@ test_expect_success '--skip --max-count' '
     test $(git rev-list HEAD --skip=10 --max-count=10 | wc -l) = 0
 '
 
+test_expect_success '--count --objects' '
+    test $(git rev-list --count --objects HEAD) = 15 &&
+    test $(git rev-list --count --objects HEAD^..HEAD) = 3
+'
+
+test_expect_success '--count --objects refuses to split by side' '
+    git checkout -b left HEAD^ &&
+    echo left >b &&
+    git add b &&
+    git commit -m left &&
+    git checkout master &&
+    test_must_fail git rev-list --count --objects --left-right left...master &&
+    test_must_fail git rev-list --count --objects --cherry-mark left...master &&
+    test $(git rev-list --count --objects left...master) = 6
+'
+
 test_done
@@ -299,4 +299,58 @@ test_expect_success 'merge-base --octopus --all for complex tree' '
 	test_cmp expected actual
 '
 
+test_expect_success 'merge-base --stdin' '
+	git checkout --orphan disjoint &&
+	test_commit disjoint &&
+	git checkout - &&
+	{
+		git merge-base JAA JDD &&
+		echo &&
+		git merge-base JDD JAA &&
+		git merge-base JAA JDD JE
+	} >expected &&
+	cat >input <<-\EOF &&
+	JAA JDD
+	JAA disjoint
+	JDD JAA
+	JAA  JDD JE
+	EOF
+	git merge-base --stdin <input >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'merge-base --all --stdin' '
+	git merge-base --all JAA JDD | tr "\n" " " | sed "s/ $//" >expected &&
+	echo >>expected &&
+	echo "JAA JDD" | git merge-base --all --stdin >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'merge-base --stdin keeps the order of a pair' '
+	tree=$(git mktree </dev/null) &&
+	(
+		GIT_COMMITTER_DATE="@1500000000 +0000" &&
+		export GIT_COMMITTER_DATE &&
+		base=$(echo base | git commit-tree $tree) &&
+		x=$(echo x | git commit-tree $tree -p $base) &&
+		y=$(echo y | git commit-tree $tree -p $base) &&
+		a=$(echo a | git commit-tree $tree -p $x -p $y) &&
+		b=$(echo b | git commit-tree $tree -p $y -p $x) &&
+		git update-ref refs/tie/a $a &&
+		git update-ref refs/tie/b $b
+	) &&
+	{
+		git merge-base tie/a tie/b &&
+		git merge-base tie/b tie/a &&
+		git merge-base tie/a tie/b
+	} >expected &&
+	printf "tie/a tie/b\ntie/b tie/a\ntie/a tie/b\n" |
+	git merge-base --stdin >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'merge-base --stdin rejects a lone commit' '
+	echo JAA | test_must_fail git merge-base --stdin
+'
+
 test_done
@@ -0,0 +1,218 @@
+#!/bin/sh
+
+test_description='merge with the in-memory ort strategy'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 20 >file &&
+	test_seq 21 40 >moved &&
+	test_seq 41 60 >gone &&
+	mkdir dir &&
+	echo x >dir/x &&
+	git add . &&
+	test_tick &&
+	git commit -m base &&
+	git tag base &&
+
+	git checkout -b ours &&
+	sed -e "2s/.*/two/" file >file.new &&
+	mv file.new file &&
+	git mv moved renamed &&
+	echo y >dir/y &&
+	git commit -a -m ours &&
+
+	git checkout -b theirs base &&
+	sed -e "19s/.*/nineteen/" file >file.new &&
+	mv file.new file &&
+	sed -e "5s/.*/twenty-five/" moved >moved.new &&
+	mv moved.new moved &&
+	git rm dir/x &&
+	echo new >new &&
+	git add new &&
+	git commit -a -m theirs
+'
+
+test_expect_success 'clean merge gives the same result as recursive' '
+	git checkout -b rec ours &&
+	git merge -s recursive theirs &&
+	git checkout -b ort ours &&
+	git merge -s ort theirs &&
+	git diff --exit-code rec ort &&
+	git diff --exit-code HEAD &&
+	git diff --exit-code --cached HEAD &&
+	grep twenty-five renamed &&
+	test_path_is_missing moved &&
+	test_path_is_missing dir/x
+'
+
+test_expect_success 'merge-ort can be run directly' '
+	git checkout -b direct ours &&
+	git merge-ort base -- HEAD theirs &&
+	git diff --exit-code ort
+'
+
+test_expect_success 'refuses to overwrite local changes' '
+	git reset --hard ours &&
+	echo dirty >>file &&
+	test_must_fail git merge -s ort theirs &&
+	test_cmp_rev ours HEAD &&
+	tail -n 1 file >actual &&
+	echo dirty >expect &&
+	test_cmp expect actual &&
+	git checkout file
+'
+
+test_expect_success 'refuses to merge with staged changes' '
+	git reset --hard ours &&
+	echo staged >>dir/y &&
+	git add dir/y &&
+	git diff --cached >expect &&
+	test_must_fail git merge -s ort theirs 2>err &&
+	test_i18ngrep "would be overwritten by merge" err &&
+	test_cmp_rev ours HEAD &&
+	git diff --cached >actual &&
+	test_cmp expect actual &&
+	git reset --hard
+'
+
+test_expect_success 'setup conflicts' '
+	git checkout -b c-ours base &&
+	sed -e "10s/.*/ours/" file >file.new &&
+	mv file.new file &&
+	git rm gone &&
+	echo ours >added &&
+	git add added &&
+	git commit -a -m c-ours &&
+	git checkout -b c-theirs base &&
+	sed -e "10s/.*/theirs/" file >file.new &&
+	mv file.new file &&
+	echo more >>gone &&
+	echo theirs >added &&
+	git add added &&
+	git commit -a -m c-theirs
+'
+
+test_expect_success 'conflicts are recorded in the index and worktree' '
+	git checkout c-ours &&
+	test_must_fail git merge -s ort c-theirs >out &&
+	test_i18ngrep "CONFLICT (content): Merge conflict in file" out &&
+	test_i18ngrep "CONFLICT (add/add): Merge conflict in added" out &&
+	test_i18ngrep "CONFLICT (modify/delete): gone deleted in HEAD" out &&
+	git ls-files -u >actual &&
+	cat >expect <<-EOF &&
+	100644 $(git rev-parse c-ours:added) 2	added
+	100644 $(git rev-parse c-theirs:added) 3	added
+	100644 $(git rev-parse base:file) 1	file
+	100644 $(git rev-parse c-ours:file) 2	file
+	100644 $(git rev-parse c-theirs:file) 3	file
+	100644 $(git rev-parse base:gone) 1	gone
+	100644 $(git rev-parse c-theirs:gone) 3	gone
+	EOF
+	test_cmp expect actual &&
+	grep "^<<<<<<< HEAD" file &&
+	grep "^>>>>>>> c-theirs" file &&
+	git cat-file blob c-theirs:gone >expect &&
+	test_cmp expect gone &&
+	git reset --hard
+'
+
+test_expect_success 'conflicts match those of recursive' '
+	git checkout -b c-rec c-ours &&
+	test_must_fail git merge -s recursive c-theirs &&
+	git ls-files -s >expect &&
+	cp file file.rec &&
+	git reset --hard &&
+	test_must_fail git merge -s ort c-theirs &&
+	git ls-files -s >actual &&
+	test_cmp expect actual &&
+	test_cmp file.rec file &&
+	git reset --hard &&
+	rm file.rec
+'
+
+test_expect_success 'file/directory conflict' '
+	git checkout -b df-ours base &&
+	git rm file &&
+	mkdir file &&
+	echo sub >file/sub &&
+	git add file/sub &&
+	git commit -m df-ours &&
+	git checkout -b df-theirs base &&
+	echo changed >>file &&
+	git commit -a -m df-theirs &&
+	git checkout df-ours &&
+	test_must_fail git merge -s ort df-theirs >out &&
+	test_i18ngrep "CONFLICT (directory/file)" out &&
+	test_path_is_file file/sub &&
+	test_path_is_file file~df-theirs &&
+	git cat-file blob df-theirs:file >expect &&
+	test_cmp expect file~df-theirs &&
+	git ls-files -u >actual &&
+	cat >expect <<-EOF &&
+	100644 $(git rev-parse base:file) 1	file
+	100644 $(git rev-parse df-theirs:file) 3	file
+	EOF
+	test_cmp expect actual &&
+	git reset --hard &&
+	rm -f file~df-theirs
+'
+
+test_expect_success 'path deleted on both sides is not taken as a rename source' '
+	git checkout -b both-base base &&
+	test_seq 1 10 >a &&
+	{ test_seq 1 9 && echo x; } >b &&
+	git add a b &&
+	git commit -m both-base &&
+	git checkout -b both-theirs &&
+	git rm a &&
+	git commit -m both-theirs &&
+	git checkout -b both-ours both-base &&
+	git rm a &&
+	git mv b c &&
+	git commit -m both-ours &&
+	git merge -s ort both-theirs &&
+	git ls-files -s a b c >actual &&
+	echo "100644 $(git rev-parse both-base:b) 0	c" >expect &&
+	test_cmp expect actual &&
+	git merge-tree --write-tree both-ours both-theirs >actual &&
+	git rev-parse HEAD^{tree} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cherry-pick with -s ort follows renames' '
+	git checkout -b pick ours &&
+	git cherry-pick -s --strategy=ort theirs &&
+	grep twenty-five renamed &&
+	grep nineteen file &&
+	git diff --exit-code ort -- file renamed
+'
+
+test_expect_success 'criss-cross merge' '
+	git checkout -b cc1 base &&
+	sed -e "3s/.*/cc1/" file >file.new &&
+	mv file.new file &&
+	git commit -a -m cc1 &&
+	git checkout -b cc2 base &&
+	sed -e "17s/.*/cc2/" file >file.new &&
+	mv file.new file &&
+	git commit -a -m cc2 &&
+	git checkout -b cc1-merge cc1 &&
+	git merge -m "merge cc2" cc2 &&
+	sed -e "8s/.*/left/" file >file.new &&
+	mv file.new file &&
+	git commit -a -m left &&
+	git checkout -b cc2-merge cc2 &&
+	git merge -m "merge cc1" cc1 &&
+	sed -e "12s/.*/right/" file >file.new &&
+	mv file.new file &&
+	git commit -a -m right &&
+	test $(git merge-base --all cc1-merge cc2-merge | wc -l) = 2 &&
+	git checkout -b cc-rec cc1-merge &&
+	git merge -s recursive cc2-merge &&
+	git checkout -b cc-ort cc1-merge &&
+	git merge -s ort cc2-merge &&
+	git diff --exit-code cc-rec cc-ort
+'
+
+test_done
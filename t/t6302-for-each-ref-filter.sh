@@ -94,6 +94,62 @@ test_expect_success 'filtering with --contains' '
 	test_cmp expect actual
 '
 
+test_expect_success 'filtering with --contains and --merged' '
+	cat >expect <<-\EOF &&
+	refs/heads/master
+	refs/odd/spot
+	refs/tags/three
+	refs/tags/two
+	EOF
+	git for-each-ref --format="%(refname)" --contains=two --merged=master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'filtering with multiple --contains' '
+	test_prepare_expect >expect <<-\EOF &&
+	refs/heads/master
+	refs/heads/side
+	refs/odd/spot
+	refs/tags/annotated-tag
+	refs/tags/doubly-annotated-tag
+	refs/tags/doubly-signed-tag
+	refs/tags/four
+	refs/tags/signed-tag
+	refs/tags/three
+	EOF
+	git for-each-ref --format="%(refname)" --contains=three --contains=four >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--contains is not fooled by clock skew' '
+	test_when_finished "rm -rf skew" &&
+	git init skew &&
+	(
+		cd skew &&
+		test_commit old &&
+		GIT_COMMITTER_DATE="@1500000000 +0000" &&
+		export GIT_COMMITTER_DATE &&
+		test_commit wanted &&
+		GIT_COMMITTER_DATE="@1400000000 +0000" &&
+		test_commit skewed &&
+		git branch skewed &&
+		git for-each-ref --format="%(refname)" --contains=wanted >actual &&
+		cat >expect <<-\EOF &&
+		refs/heads/master
+		refs/heads/skewed
+		refs/tags/skewed
+		refs/tags/wanted
+		EOF
+		test_cmp expect actual &&
+		git branch --contains wanted >actual &&
+		cat >expect <<-\EOF &&
+		* master
+		  skewed
+		EOF
+		test_cmp expect actual
+	)
+'
+
 test_expect_success '%(color) must fail' '
 	test_must_fail git for-each-ref --format="%(color)%(refname)"
 '
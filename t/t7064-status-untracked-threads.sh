@@ -0,0 +1,80 @@
+#!/bin/sh
+
+test_description='look for untracked files on several threads'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git init repo &&
+	(
+		cd repo &&
+		mkdir -p a/b/c a/d e/f/g tracked/sub ignored/deep &&
+		for f in one a/two a/b/three a/b/c/four a/d/five e/f/g/six \
+			 tracked/t tracked/sub/u ignored/deep/x
+		do
+			echo $f >$f || exit 1
+		done &&
+		git add tracked &&
+		test_tick &&
+		git commit -m tracked &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p many/dir$i/sub &&
+			echo $i >many/dir$i/file &&
+			echo $i >many/dir$i/sub/file.o || exit 1
+		done &&
+		echo new >tracked/sub/new &&
+		echo "*.o" >.gitignore &&
+		echo "three" >a/b/.gitignore &&
+		echo "!file.o" >many/dir7/.gitignore &&
+		echo "ignored/" >>.gitignore
+	)
+'
+
+for cmd in 'status --porcelain -uall' \
+	   'status --porcelain -unormal' \
+	   'status --porcelain --ignored -uall' \
+	   'clean -n -d' \
+	   'clean -n -d -x' \
+	   'ls-files -o --exclude-standard' \
+	   'ls-files -o --directory --exclude-standard' \
+	   'ls-files -o -i --exclude-standard'
+do
+	test_expect_success "$cmd with threads" "
+		git -C repo -c core.untrackedThreads=1 $cmd >expect &&
+		git -C repo -c core.untrackedThreads=4 $cmd >actual &&
+		test_cmp expect actual &&
+		git -C repo -c core.untrackedThreads=0 $cmd >actual &&
+		test_cmp expect actual
+	"
+done
+
+test_expect_success 'pathspec limits the threaded walk' '
+	git -C repo -c core.untrackedThreads=1 status --porcelain -uall a many >expect &&
+	git -C repo -c core.untrackedThreads=4 status --porcelain -uall a many >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'untracked cache is filled by the threaded walk' '
+	git -C repo -c core.untrackedThreads=1 status --porcelain -uall >expect &&
+	git -C repo update-index --untracked-cache &&
+	git -C repo -c core.untrackedThreads=4 status --porcelain -uall >actual &&
+	test_cmp expect actual &&
+	git -C repo -c core.untrackedThreads=4 status --porcelain -uall >actual &&
+	test_cmp expect actual &&
+	echo more >repo/many/dir3/more &&
+	echo "five" >repo/a/d/.gitignore &&
+	git -C repo -c core.untrackedThreads=1 status --porcelain -uall >expect &&
+	git -C repo -c core.untrackedThreads=4 status --porcelain -uall >actual &&
+	test_cmp expect actual &&
+	git -C repo update-index --no-untracked-cache &&
+	git -C repo status --porcelain -uall >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'negative thread count is rejected' '
+	test_must_fail git -C repo -c core.untrackedThreads=-1 status 2>err &&
+	test_i18ngrep "invalid number of threads" err
+'
+
+test_done
@@ -0,0 +1,47 @@
+#!/bin/sh
+
+test_description='refresh the index with core.preloadIndex'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir -p dir/sub &&
+	for i in $(test_seq 1 1200)
+	do
+		echo $i >file$i &&
+		echo $i >dir/sub/file$i || return 1
+	done &&
+	git add . &&
+	printf "expect\nactual\n" >>.git/info/exclude &&
+	test_tick &&
+	git commit -q -m initial
+'
+
+test_expect_success 'change the working tree in many ways' '
+	echo changed >file1 &&
+	echo 1 >dir/sub/file1 &&
+	test-chmtime =+60 file2 dir/sub/file2 &&
+	echo 333 >file3 &&
+	test-chmtime =+60 file3 &&
+	rm file4 &&
+	rm -r dir/sub/file5 &&
+	mkdir dir/sub/file5 &&
+	git rm -q --cached file6 &&
+	echo untracked >new
+'
+
+test_expect_success SYMLINKS 'a symlink in place of a directory' '
+	mv dir/sub real-sub &&
+	ln -s ../real-sub dir/sub
+'
+
+for cmd in 'status --porcelain' 'diff --name-status' 'diff --stat'
+do
+	test_expect_success "$cmd with and without core.preloadIndex" "
+		git -c core.preloadIndex=false $cmd >expect &&
+		git -c core.preloadIndex=true $cmd >actual &&
+		test_cmp expect actual
+	"
+done
+
+test_done
@@ -558,6 +558,17 @@ test_expect_success 'log grep (6)' '
 	test_cmp expect actual
 '
 
+test_expect_success LIBPCRE 'log grep with --perl-regexp' '
+	git log --perl-regexp --grep="^(?:sec|thi)\w+$" --pretty=tformat:%s >actual &&
+	{
+		echo third && echo second
+	} >expect &&
+	test_cmp expect actual &&
+	git -c grep.patternType=perl log --grep="^(?:sec|thi)\w+$" \
+		--pretty=tformat:%s >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'log grep (7)' '
 	git log -g --grep-reflog="commit: third" --pretty=tformat:%s >actual &&
 	echo third >expect &&
@@ -780,6 +791,57 @@ test_expect_success 'grep -Fi' '
 	test_cmp expected actual
 '
 
+test_expect_success 'grep -F -f with many strings' '
+	test_seq 1 20 | sed "s/^/nomatch/" >patterns &&
+	echo "o world" >>patterns &&
+	echo "Hello w" >>patterns &&
+	echo "llo_wor" >>patterns &&
+	{
+		echo "hello_world:Hello world"
+		echo "hello_world:HeLLo world"
+		echo "hello_world:Hello_world"
+	} >expected &&
+	git grep -F -f patterns hello_world >actual &&
+	test_cmp expected actual &&
+	git grep -c -F -f patterns hello_world >actual &&
+	echo "hello_world:3" >expected &&
+	test_cmp expected actual
+'
+
+test_expect_success 'grep -F -f with many strings matches leftmost longest' '
+	git grep --color=always -E "$(paste -s -d"|" patterns)" \
+		hello_world >expected &&
+	git grep --color=always -F -f patterns hello_world >actual &&
+	test_cmp expected actual &&
+	git grep --color=always -i -E "$(paste -s -d"|" patterns)" \
+		hello_world >expected &&
+	git grep --color=always -i -F -f patterns hello_world >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'grep -F -f gives the same answer with either matcher' '
+	for opts in "" "-i" "-c" "-n" "-l"
+	do
+		GIT_TEST_KWSET_AC_MIN_WORDS=1000000 \
+			git grep --color=always $opts -F -f patterns >expected &&
+		GIT_TEST_KWSET_AC_MIN_WORDS=2 \
+			git grep --color=always $opts -F -f patterns >actual &&
+		test_cmp expected actual || return 1
+	done
+'
+
+test_expect_success 'grep -F -f with many strings and a regex' '
+	{
+		echo "file:foo mmap bar"
+		echo "file:foo mmap bar_mmap"
+		echo "hello_world:Hello world"
+		echo "hello_world:HeLLo world"
+		echo "hello_world:Hello_world"
+	} >expected &&
+	git grep -f patterns -e "foo m.ap" file hello_world >actual &&
+	test_cmp expected actual
+'
+
 test_expect_success 'outside of git repository' '
 	rm -fr non &&
 	mkdir -p non/git/sub &&
@@ -1019,6 +1081,15 @@ test_expect_success LIBPCRE 'grep -P -w pattern' '
 	test_cmp expected actual
 '
 
+test_expect_success LIBPCRE 'grep -P with multiple threads' '
+	git grep --threads=1 -P -n "^\s+(?:return|printf)\b" >expected &&
+	git grep --threads=4 -P -n "^\s+(?:return|printf)\b" >actual &&
+	test_cmp expected actual &&
+	git grep --threads=4 -P -n "^\s+(?:return|printf)\b" HEAD >actual &&
+	sed "s/^/HEAD:/" expected >expected.head &&
+	test_cmp expected.head actual
+'
+
 test_expect_success 'grep -G invalidpattern properly dies ' '
 	test_must_fail git grep -G "a["
 '
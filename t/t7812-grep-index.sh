@@ -0,0 +1,115 @@
+#!/bin/sh
+
+test_description='git grep with a trigram index'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	printf "int needle_count;\nstatic int hay;\n" >file &&
+	printf "Hello world\nsome more hay\n" >dir/hello &&
+	printf "x\n" >short &&
+	printf "grep_opt and grep_pat\n" >dir/other &&
+	git add . &&
+	test_tick &&
+	git commit -m initial &&
+	git tag initial
+'
+
+test_expect_success 'build writes an index for HEAD' '
+	git grep-index build -v 2>err &&
+	test_i18ngrep "computed 4 filters" err &&
+	tree=$(git rev-parse HEAD^{tree}) &&
+	test_path_is_file .git/objects/info/grep-index/$tree &&
+	git grep-index verify &&
+	git grep-index verify HEAD
+'
+
+test_expect_success 'grep output does not change with the index' '
+	for pattern in "-e needle" "-e NEEDLE -i" "-e hay" "-e needle -e world" \
+		"-F -e hay" "-E -e ne+dle" "-e n.edle" "-E -e needle|nothing" \
+		"-v -e hay" "-e x" "-e grep_[op]" "-e nothing_like_this" \
+		"-E -e (grep|hello)_opt" "-e needle --and -e count" \
+		"-P -e \\bneedle"
+	do
+		if test "$pattern" = "-P -e \\bneedle" &&
+		   ! test_have_prereq LIBPCRE
+		then
+			continue
+		fi
+		test_might_fail git -c grep.trigramIndex=false \
+			grep $pattern HEAD >expect &&
+		test_might_fail git grep $pattern HEAD >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'verify notices a corrupt index' '
+	tree=$(git rev-parse HEAD^{tree}) &&
+	index=.git/objects/info/grep-index/$tree &&
+	cp $index saved &&
+	test_when_finished "mv -f saved $index" &&
+	chmod +w $index &&
+	printf "\377" | dd of=$index bs=1 seek=40 conv=notrunc &&
+	test_must_fail git grep-index verify
+'
+
+test_expect_success 'build reuses the filters of the parent' '
+	echo "a needle in a haystack" >>dir/hello &&
+	git commit -a -m second &&
+	git grep-index build -v 2>err &&
+	test_i18ngrep "computed 1 filters" err &&
+	git grep-index verify HEAD &&
+	git grep needle HEAD >actual &&
+	cat >expect <<-\EOF &&
+	HEAD:dir/hello:a needle in a haystack
+	HEAD:file:int needle_count;
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'grep skips blobs that cannot match' '
+	test_create_repo skip &&
+	(
+		cd skip &&
+		echo "the needle" >needle &&
+		echo "only hay" >hay &&
+		git add . &&
+		test_tick &&
+		git commit -m hay &&
+		git grep-index build &&
+		hay=$(git rev-parse HEAD:hay) &&
+		rm -f .git/objects/$(echo $hay | sed -e "s|^..|&/|") &&
+		git grep needle HEAD >actual 2>err &&
+		test_must_be_empty err &&
+		echo "HEAD:needle:the needle" >expect &&
+		test_cmp expect actual &&
+		git -c grep.trigramIndex=false grep needle HEAD 2>err &&
+		test_i18ngrep "unable to read $hay" err &&
+		test_expect_code 1 git grep -v needle HEAD 2>err &&
+		test_i18ngrep "unable to read $hay" err
+	)
+'
+
+test_expect_success 'expire keeps the indexes of the given trees' '
+	git grep-index build initial &&
+	initial=$(git rev-parse initial^{tree}) &&
+	head=$(git rev-parse HEAD^{tree}) &&
+	git grep-index expire -n initial >actual &&
+	echo "Removing .git/objects/info/grep-index/$head" >expect &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/grep-index/$head &&
+	git grep-index expire initial &&
+	test_path_is_missing .git/objects/info/grep-index/$head &&
+	test_path_is_file .git/objects/info/grep-index/$initial
+'
+
+test_expect_success 'expire keeps the indexes of the trees at ref tips' '
+	git grep-index build HEAD &&
+	git tag -d initial &&
+	git grep-index expire &&
+	test_path_is_missing .git/objects/info/grep-index/$initial &&
+	test_path_is_file .git/objects/info/grep-index/$head
+'
+
+test_done
@@ -0,0 +1,133 @@
+#!/bin/sh
+
+test_description='git blame with blame.cache'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 10 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m one &&
+	for i in 2 3 4 5 6
+	do
+		sed -e "${i}s/\$/ changed in $i/" file >file.new &&
+		mv file.new file &&
+		test_tick &&
+		git commit -a -m "commit $i" || return 1
+	done &&
+	git mv file renamed &&
+	test_tick &&
+	git commit -m rename &&
+	git checkout -b side HEAD~3 &&
+	sed -e "9s/\$/ on side/" file >file.new &&
+	mv file.new file &&
+	test_tick &&
+	git commit -a -m side &&
+	git checkout master &&
+	test_tick &&
+	git merge -m merge side &&
+	echo 11 >>renamed &&
+	test_tick &&
+	git commit -a -m eleven
+'
+
+test_expect_success 'no cache without blame.cache' '
+	git blame -p renamed >expect &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame
+'
+
+test_expect_success 'blaming an older commit fills the cache' '
+	git blame -p HEAD~2 -- renamed >expect.old &&
+	git -c blame.cache=true blame -p HEAD~2 -- renamed >actual &&
+	test_cmp expect.old actual &&
+	git ls-tree refs/notes/blame >notes &&
+	test_line_count = 1 notes
+'
+
+test_expect_success 'descendant starts from the cached result' '
+	git -c blame.cache=true blame --show-stats -p renamed >actual &&
+	grep -v "^num " actual >actual.blame &&
+	test_cmp expect actual.blame &&
+	grep "^num commits: 3\$" actual &&
+	git ls-tree refs/notes/blame >notes &&
+	test_line_count = 2 notes
+'
+
+test_expect_success 'cached result gives the same output' '
+	git -c blame.cache=true blame --show-stats -p renamed >actual &&
+	grep -v "^num " actual >actual.blame &&
+	test_cmp expect actual.blame &&
+	grep "^num commits: 0\$" actual
+'
+
+test_expect_success 'working tree blame uses the cache' '
+	test_when_finished "git checkout renamed" &&
+	echo 12 >>renamed &&
+	git blame -c renamed >expect.wt &&
+	git -c blame.cache=true blame --show-stats -c renamed >actual &&
+	grep -v "^num " actual >actual.blame &&
+	test_cmp expect.wt actual.blame &&
+	grep "^num commits: 1\$" actual
+'
+
+test_expect_success 'options that change the result are part of the key' '
+	git blame --root -w renamed >expect.root &&
+	git -c blame.cache=true blame --root -w renamed >actual &&
+	test_cmp expect.root actual &&
+	git -c blame.cache=true blame --show-stats --first-parent renamed >actual &&
+	! grep "^num commits: 0\$" actual
+'
+
+test_expect_success 'partial and limited blames are not cached' '
+	git update-ref -d refs/notes/blame &&
+	git -c blame.cache=true blame -L 2,4 renamed >/dev/null &&
+	git -c blame.cache=true blame HEAD~3.. -- renamed >/dev/null &&
+	git -c blame.cache=true blame -M renamed >/dev/null &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame
+'
+
+test_expect_success 'corrupt cache entry is ignored' '
+	test_when_finished "git update-ref -d refs/notes/blame" &&
+	git -c blame.cache=true blame renamed >/dev/null &&
+	git ls-tree refs/notes/blame >notes &&
+	key=$(cut -f2 notes) &&
+	bogus=$(echo "0 0 3 not-a-commit" | git hash-object -w --stdin) &&
+	tree=$(printf "100644 blob %s\t%s\n" $bogus $key | git mktree) &&
+	commit=$(echo blame-cache-v1 | git commit-tree $tree) &&
+	git update-ref refs/notes/blame $commit &&
+	git -c blame.cache=true blame -p renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'no cache in a shallow repository' '
+	test_when_finished "rm -rf shallow" &&
+	git clone --no-local --depth 2 . shallow &&
+	git -C shallow -c blame.cache=true blame renamed >/dev/null &&
+	test_must_fail git -C shallow rev-parse --verify -q refs/notes/blame &&
+	git -C shallow fetch --unshallow &&
+	git -C shallow -c blame.cache=true blame -p renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'no cache with grafts or replace refs' '
+	test_when_finished "rm -f .git/info/grafts" &&
+	echo $(git rev-parse HEAD~2) >.git/info/grafts &&
+	git -c blame.cache=true blame renamed >/dev/null &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame &&
+	rm .git/info/grafts &&
+	test_when_finished "git replace -d HEAD~2" &&
+	git replace HEAD~2 HEAD~3 &&
+	git -c blame.cache=true blame renamed >/dev/null &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame
+'
+
+test_expect_success 'no cache is written without an identity' '
+	(
+		sane_unset GIT_AUTHOR_EMAIL GIT_COMMITTER_EMAIL EMAIL &&
+		git -c blame.cache=true blame -p renamed >actual
+	) &&
+	test_cmp expect actual &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame
+'
+
+test_done
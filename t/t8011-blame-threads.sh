@@ -0,0 +1,62 @@
+#!/bin/sh
+
+test_description='git blame with worker threads'
+. ./test-lib.sh
+
+PROG='git blame -c --threads=4'
+. "$TEST_DIRECTORY"/annotate-tests.sh
+
+test_expect_success 'setup history with merges and a rename' '
+	test_seq 1 20 >seq &&
+	git add seq &&
+	test_tick &&
+	git commit -m seq &&
+	for i in 2 4 6 8 10 12
+	do
+		sed -e "${i}s/\$/ changed in $i/" seq >seq.new &&
+		mv seq.new seq &&
+		test_tick &&
+		git commit -a -m "seq $i" || return 1
+	done &&
+	git checkout -b seq-side HEAD~3 &&
+	sed -e "15s/\$/ on side/" -e "3d" seq >seq.new &&
+	mv seq.new seq &&
+	test_tick &&
+	git commit -a -m "seq side" &&
+	git checkout - &&
+	test_tick &&
+	git merge -m "merge seq-side" seq-side &&
+	git mv seq seq.renamed &&
+	test_tick &&
+	git commit -m rename &&
+	echo 21 >>seq.renamed &&
+	test_tick &&
+	git commit -a -m 21
+'
+
+for args in "seq.renamed" "-M seq.renamed" "-C -C seq.renamed" \
+	"--first-parent seq.renamed" "--incremental seq.renamed" \
+	"--root -w seq.renamed" "HEAD~4.. -- seq.renamed" \
+	"--reverse HEAD~6..HEAD~2 -- seq"
+do
+	test_expect_success "threads give the same blame: $args" "
+		git blame -p $args >expect &&
+		git blame -p --threads=4 $args >actual &&
+		test_cmp expect actual
+	"
+done
+
+test_expect_success 'blame.threads' '
+	git blame -p seq.renamed >expect &&
+	git -c blame.threads=0 blame -p seq.renamed >actual &&
+	test_cmp expect actual &&
+	git -c blame.threads=3 -c blame.cache=true blame -p seq.renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'invalid number of threads' '
+	test_must_fail git blame --threads=-1 seq.renamed &&
+	test_must_fail git -c blame.threads=-1 blame seq.renamed
+'
+
+test_done
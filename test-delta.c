@@ -13,7 +13,40 @@
 #include "cache.h"
 
 static const char usage_str[] =
-	"test-delta (-d|-p) <from_file> <data_file> <out_file>";
+	"test-delta (-d|-p) <from_file> <data_file> <out_file>\n"
+	"   or: test-delta -b <from_file> <data_file> <count>";
+
+/*
+ * Delta <data> against <from> "count" times, the way pack-objects
+ * does, to measure diff-delta.c without the rest of a repack.
+ */
+static int bench_delta(void *from_buf, unsigned long from_size,
+		       void *data_buf, unsigned long data_size, int count)
+{
+	unsigned long out_size = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct delta_index *index;
+		void *out_buf;
+
+		index = create_delta_index(from_buf, from_size);
+		if (!index) {
+			fprintf(stderr, "unable to create delta index\n");
+			return 1;
+		}
+		out_buf = create_delta(index, data_buf, data_size,
+				       &out_size, 0);
+		free_delta_index(index);
+		if (!out_buf) {
+			fprintf(stderr, "delta operation failed (returned NULL)\n");
+			return 1;
+		}
+		free(out_buf);
+	}
+	printf("%lu\n", out_size);
+	return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -22,7 +55,8 @@ int main(int argc, char *argv[])
 	void *from_buf, *data_buf, *out_buf;
 	unsigned long from_size, data_size, out_size;
 
-	if (argc != 5 || (strcmp(argv[1], "-d") && strcmp(argv[1], "-p"))) {
+	if (argc != 5 || (strcmp(argv[1], "-d") && strcmp(argv[1], "-p") &&
+			  strcmp(argv[1], "-b"))) {
 		fprintf(stderr, "usage: %s\n", usage_str);
 		return 1;
 	}
@@ -55,6 +89,10 @@ int main(int argc, char *argv[])
 	}
 	close(fd);
 
+	if (argv[1][1] == 'b')
+		return bench_delta(from_buf, from_size, data_buf, data_size,
+				   atoi(argv[4]));
+
 	if (argv[1][1] == 'd')
 		out_buf = diff_delta(from_buf, from_size,
 				     data_buf, data_size,
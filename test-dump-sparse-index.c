@@ -0,0 +1,18 @@
+#include "cache.h"
+
+int main(int ac, char **av)
+{
+	int i;
+
+	do_read_index(&the_index, av[1], 1);
+	if (!the_index.sparse_index) {
+		printf("not a sparse index\n");
+		return 0;
+	}
+	for (i = 0; i < the_index.cache_nr; i++) {
+		struct cache_entry *ce = the_index.cache[i];
+		printf("%06o %s %d\t%s\n", ce->ce_mode,
+		       sha1_to_hex(ce->sha1), ce_stage(ce), ce->name);
+	}
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "cache.h"
+#include "string-list.h"
+#include "thread-utils.h"
+
+static int dir_prefix_len(const char *name, int len)
+{
+	while (len > 0 && name[len - 1] != '/')
+		len--;
+	return len ? len - 1 : 0;
+}
+
+static char *upcase(const char *name, int len)
+{
+	char *up = xmemdupz(name, len);
+	int i;
+
+	for (i = 0; i < len; i++)
+		up[i] = toupper(up[i]);
+	return up;
+}
+
+static void check_entry(struct cache_entry *ce)
+{
+	int len = ce_namelen(ce);
+	char *up = upcase(ce->name, len);
+
+	if (index_file_exists(&the_index, up, len, 1) != ce)
+		die("%s: not found as %s", ce->name, up);
+	while ((len = dir_prefix_len(up, len)))
+		if (!index_dir_exists(&the_index, up, len))
+			die("%s: directory %.*s not found", ce->name, len, up);
+	free(up);
+}
+
+/*
+ * Remove the first half of the entries from the hashes; a directory
+ * must then only be found if it is still used by the second half.
+ */
+static void check_removal(void)
+{
+	struct string_list dirs = STRING_LIST_INIT_DUP;
+	int i, half = the_index.cache_nr / 2;
+
+	dirs.cmp = strcasecmp;
+	for (i = half; i < the_index.cache_nr; i++) {
+		struct cache_entry *ce = the_index.cache[i];
+		int len = ce_namelen(ce);
+
+		while ((len = dir_prefix_len(ce->name, len)))
+			string_list_append(&dirs, xstrfmt("%.*s", len, ce->name));
+	}
+	string_list_sort(&dirs);
+
+	for (i = 0; i < half; i++)
+		remove_name_hash(&the_index, the_index.cache[i]);
+	for (i = 0; i < half; i++) {
+		struct cache_entry *ce = the_index.cache[i];
+		int len = ce_namelen(ce);
+
+		while ((len = dir_prefix_len(ce->name, len))) {
+			char *dir = xstrfmt("%.*s", len, ce->name);
+
+			if (index_dir_exists(&the_index, dir, len) !=
+			    !!string_list_has_string(&dirs, dir))
+				die("directory %s is %sfound", dir,
+				    string_list_has_string(&dirs, dir) ?
+				    "not " : "");
+			free(dir);
+		}
+		if (index_file_exists(&the_index, ce->name, ce_namelen(ce), 0))
+			die("%s: found after removal", ce->name);
+	}
+	for (i = half; i < the_index.cache_nr; i++)
+		check_entry(the_index.cache[i]);
+	string_list_clear(&dirs, 0);
+}
+
+static const char usage_str[] =
+	"test-lazy-init-name-hash (-s | -m) [-p <count>]";
+
+int main(int argc, char **argv)
+{
+	int i, nr_threads = 0, count = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s"))
+			nr_threads = 1;
+		else if (!strcmp(argv[i], "-m"))
+			nr_threads = online_cpus() < 2 ? 2 : online_cpus();
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			count = atoi(argv[++i]);
+		else
+			usage(usage_str);
+	}
+	if (!nr_threads)
+		usage(usage_str);
+
+	setup_git_directory();
+	git_config(git_default_config, NULL);
+	/* the directory hash is only built with core.ignorecase */
+	ignore_case = 1;
+	if (read_cache() < 0)
+		die("unable to read index file");
+
+	if (count) {
+		for (i = 0; i < count; i++)
+			test_lazy_init_name_hash(&the_index, nr_threads);
+		return 0;
+	}
+
+	printf("threads %d\n", test_lazy_init_name_hash(&the_index, nr_threads));
+	for (i = 0; i < the_index.cache_nr; i++)
+		check_entry(the_index.cache[i]);
+	check_removal();
+	printf("ok\n");
+	return 0;
+}
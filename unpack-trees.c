@@ -1,6 +1,7 @@
 #define NO_THE_INDEX_COMPATIBILITY_MACROS
 #include "cache.h"
 #include "dir.h"
+#include "pathspec.h"
 #include "tree.h"
 #include "tree-walk.h"
 #include "cache-tree.h"
@@ -9,6 +10,7 @@
 #include "refs.h"
 #include "attr.h"
 #include "split-index.h"
+#include "sparse-index.h"
 #include "dir.h"
 
 /*
@@ -450,6 +452,157 @@ static int switch_cache_bottom(struct traverse_info *info)
 	return ret;
 }
 
+/*
+ * If every tree has the directory "names" with the same contents, and
+ * the cache-tree of the index says that the index has them too, return
+ * the position of the first index entry in the directory and store
+ * their number in "nr".  Otherwise return -1.
+ */
+static int same_as_cache_tree(int n, unsigned long dirmask,
+			      unsigned long df_conflicts,
+			      struct name_entry *names,
+			      struct traverse_info *info, int *nr)
+{
+	struct unpack_trees_options *o = info->data;
+	struct index_state *index = o->src_index;
+	struct strbuf path = STRBUF_INIT;
+	int i, pos, len;
+
+	if (!o->merge || o->prefix || o->diff_index_cached ||
+	    !index->cache_tree || df_conflicts ||
+	    (info->pathspec && info->pathspec->nr) ||
+	    dirmask != (1ul << n) - 1)
+		return -1;
+	for (i = 1; i < n; i++)
+		if (hashcmp(names[0].sha1, names[i].sha1))
+			return -1;
+	*nr = cache_tree_matches_traversal(index->cache_tree, names, info);
+	if (!*nr)
+		return -1;
+
+	len = traverse_path_len(info, names);
+	strbuf_grow(&path, len + 1);
+	make_traverse_path(path.buf, info, names);
+	strbuf_setlen(&path, len);
+	strbuf_addch(&path, '/');
+	pos = index_name_pos(index, path.buf, path.len);
+	pos = pos < 0 ? -pos - 1 : -1;
+
+	/*
+	 * The cache-tree is only valid when there are no unmerged
+	 * entries, but be careful about entries on their way out.
+	 */
+	for (i = 0; 0 <= pos && i < *nr; i++) {
+		struct cache_entry *ce;
+
+		if (index->cache_nr <= pos + i) {
+			pos = -1;
+			break;
+		}
+		ce = index->cache[pos + i];
+		if (ce_stage(ce) || (ce->ce_flags & (CE_UNPACKED | CE_REMOVE |
+						     CE_INTENT_TO_ADD)) ||
+		    ce_namelen(ce) <= path.len ||
+		    memcmp(ce->name, path.buf, path.len))
+			pos = -1;
+	}
+	strbuf_release(&path);
+	return pos;
+}
+
+/*
+ * Feed the index entries from "pos" on, together with the same entry
+ * from each tree, to the merge function.  This is what traversing the
+ * trees would do, without reading them: the cache-tree already told
+ * us what they contain.
+ */
+static int unpack_by_cache_tree(int n, int pos, int nr,
+				struct traverse_info *info)
+{
+	struct unpack_trees_options *o = info->data;
+	struct cache_entry *src[MAX_UNPACK_TREES + 1] = { NULL, };
+	int i, j, alloc = 0, ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct cache_entry *ce = o->src_index->cache[pos + i];
+		int len = ce_namelen(ce);
+
+		if (alloc < cache_entry_size(len)) {
+			alloc = cache_entry_size(len) * 2;
+			for (j = 1; j <= n; j++) {
+				free(src[j]);
+				src[j] = xcalloc(1, alloc);
+			}
+		}
+		for (j = 1; j <= n; j++) {
+			struct cache_entry *tree_ce = src[j];
+			int stage;
+
+			if (j < o->head_idx)
+				stage = 1;
+			else if (j > o->head_idx)
+				stage = 3;
+			else
+				stage = 2;
+			tree_ce->ce_mode = ce->ce_mode;
+			tree_ce->ce_flags = create_ce_flags(stage);
+			tree_ce->ce_namelen = len;
+			hashcpy(tree_ce->sha1, ce->sha1);
+			memcpy(tree_ce->name, ce->name, len + 1);
+		}
+		src[0] = ce;
+		if (call_unpack_fn((const struct cache_entry * const *)src, o) < 0) {
+			ret = -1;
+			break;
+		}
+		mark_ce_used(ce, o);
+	}
+	for (j = 1; j <= n; j++)
+		free(src[j]);
+	if (o->debug_unpack && !ret)
+		printf("unpacked %d entries from %s to %s using the cache-tree\n",
+		       nr, o->src_index->cache[pos]->name,
+		       o->src_index->cache[pos + nr - 1]->name);
+	return ret;
+}
+
+/*
+ * If the index records the directory "names" as a sparse directory
+ * entry, and every tree has the same object for it, return the
+ * position of that entry.  Otherwise return -1.
+ */
+static int same_as_sparse_dir(int n, unsigned long dirmask,
+			      struct name_entry *names,
+			      struct traverse_info *info)
+{
+	struct unpack_trees_options *o = info->data;
+	struct index_state *index = o->src_index;
+	struct strbuf path = STRBUF_INIT;
+	struct cache_entry *ce;
+	int i, pos, len;
+
+	if (!index->sparse_index || dirmask != (1ul << n) - 1)
+		return -1;
+
+	len = traverse_path_len(info, names);
+	strbuf_grow(&path, len + 1);
+	make_traverse_path(path.buf, info, names);
+	strbuf_setlen(&path, len);
+	strbuf_addch(&path, '/');
+	pos = index_name_pos(index, path.buf, path.len);
+	strbuf_release(&path);
+	if (pos < 0)
+		return -1;
+
+	ce = index->cache[pos];
+	if (!S_ISSPARSEDIR(ce->ce_mode) || (ce->ce_flags & CE_UNPACKED))
+		return -1;
+	for (i = 0; i < n; i++)
+		if (hashcmp(names[i].sha1, ce->sha1))
+			return -1;
+	return pos;
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
@@ -460,6 +613,25 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 	void *buf[MAX_UNPACK_TREES];
 	struct traverse_info newinfo;
 	struct name_entry *p;
+	struct unpack_trees_options *o = info->data;
+	int pos, nr;
+
+	pos = same_as_sparse_dir(n, dirmask, names, info);
+	if (0 <= pos)
+		nr = 1;
+	else
+		pos = same_as_cache_tree(n, dirmask, df_conflicts, names,
+					 info, &nr);
+	if (0 <= pos) {
+		/*
+		 * Keep cache_bottom where it was, like the traversal
+		 * does, so that nothing before "pos" is missed.
+		 */
+		bottom = o->cache_bottom;
+		ret = unpack_by_cache_tree(n, pos, nr, info);
+		o->cache_bottom = bottom;
+		return ret;
+	}
 
 	p = names;
 	while (!p->mode)
@@ -902,16 +1074,22 @@ static int clear_ce_flags_dir(struct cache_entry **cache, int nr,
 	}
 
 	/*
-	 * TODO: check el, if there are no patterns that may conflict
-	 * with ret (iow, we know in advance the incl/excl
-	 * decision for the entire directory), clear flag here without
-	 * calling clear_ce_flags_1(). That function will call
-	 * the expensive is_excluded_from_list() on every entry.
+	 * Cone-mode patterns decide for the entire directory unless
+	 * it is a parent of an included one, so there is no need to
+	 * call is_excluded_from_list() on every entry below it.
 	 */
-	rc = clear_ce_flags_1(cache, cache_end - cache,
-			      prefix,
-			      select_mask, clear_mask,
-			      el, ret);
+	if (el->use_cone_patterns && ret != 1) {
+		struct cache_entry **ce;
+
+		for (ce = cache; ret && ce != cache_end; ce++)
+			if (!select_mask || ((*ce)->ce_flags & select_mask))
+				(*ce)->ce_flags &= ~clear_mask;
+		rc = cache_end - cache;
+	} else
+		rc = clear_ce_flags_1(cache, cache_end - cache,
+				      prefix,
+				      select_mask, clear_mask,
+				      el, ret);
 	strbuf_setlen(prefix, prefix->len - 1);
 	return rc;
 }
@@ -1055,6 +1233,69 @@ static int verify_absent(const struct cache_entry *,
  *
  * CE_ADDED, CE_UNPACKED and CE_NEW_SKIP_WORKTREE are used internally
  */
+/*
+ * Does tree "t" have the directory recorded by the sparse directory
+ * entry "ce", with the same contents?
+ */
+static int tree_has_sparse_dir(const struct tree_desc *t,
+			       const struct cache_entry *ce)
+{
+	struct tree_desc desc = *t;
+	struct name_entry entry;
+	const char *slash = strchr(ce->name, '/');
+	int len = slash - ce->name;
+
+	while (tree_entry(&desc, &entry)) {
+		unsigned char sha1[20];
+		unsigned mode;
+		char *rest;
+		int ret;
+
+		if (tree_entry_len(&entry) != len ||
+		    memcmp(entry.path, ce->name, len))
+			continue;
+		if (!S_ISDIR(entry.mode))
+			return 0;
+		if (!slash[1])
+			return !hashcmp(entry.sha1, ce->sha1);
+		rest = xmemdupz(slash + 1, ce_namelen(ce) - len - 2);
+		ret = !get_tree_entry(entry.sha1, rest, sha1, &mode) &&
+			S_ISDIR(mode) && !hashcmp(sha1, ce->sha1);
+		free(rest);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * A sparse directory entry can stay collapsed when every tree has
+ * exactly that directory: the merge function would only ever see
+ * identical entries for everything in it, and same_as_sparse_dir()
+ * hands it over as a single entry instead.  As soon as one of them
+ * differs, the index has to be expanded before the merge.
+ */
+static int sparse_dirs_match_trees(unsigned len, struct tree_desc *t,
+				   struct unpack_trees_options *o)
+{
+	struct index_state *index = o->src_index;
+	int i;
+	unsigned j;
+
+	if (!len || o->prefix || !o->skip_sparse_checkout ||
+	    (o->pathspec && o->pathspec->nr))
+		return 0;
+	for (i = 0; i < index->cache_nr; i++) {
+		const struct cache_entry *ce = index->cache[i];
+
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		for (j = 0; j < len; j++)
+			if (!tree_has_sparse_dir(t + j, ce))
+				return 0;
+	}
+	return 1;
+}
+
 int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options *o)
 {
 	int i, ret;
@@ -1075,6 +1316,7 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		o->skip_sparse_checkout = 1;
 	if (!o->skip_sparse_checkout) {
 		char *sparse = git_pathdup("info/sparse-checkout");
+		el.use_cone_patterns = core_sparse_checkout_cone;
 		if (add_excludes_from_file_to_list(sparse, "", 0, &el, 0) < 0)
 			o->skip_sparse_checkout = 1;
 		else
@@ -1082,11 +1324,16 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		free(sparse);
 	}
 
+	if (o->merge && o->src_index->sparse_index &&
+	    !sparse_dirs_match_trees(len, t, o))
+		ensure_full_index(o->src_index);
+
 	memset(&o->result, 0, sizeof(o->result));
 	o->result.initialized = 1;
 	o->result.timestamp.sec = o->src_index->timestamp.sec;
 	o->result.timestamp.nsec = o->src_index->timestamp.nsec;
 	o->result.version = o->src_index->version;
+	o->result.sparse_index = o->merge && o->src_index->sparse_index;
 	o->result.split_index = o->src_index->split_index;
 	if (o->result.split_index)
 		o->result.split_index->refcount++;
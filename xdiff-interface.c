@@ -139,6 +139,21 @@ int xdi_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, xdemitconf_t co
 	return xdl_diff(&a, &b, xpp, xecfg, xecb);
 }
 
+int xdi_diff_count(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+		   long *removed, long *added)
+{
+	mmfile_t a = *mf1;
+	mmfile_t b = *mf2;
+
+	if (mf1->size > MAX_XDIFF_SIZE || mf2->size > MAX_XDIFF_SIZE)
+		return -1;
+
+	/* there is no context to keep */
+	trim_common_tail(&a, &b, 0);
+
+	return xdl_diff_count(&a, &b, xpp, removed, added);
+}
+
 int xdi_diff_outf(mmfile_t *mf1, mmfile_t *mf2,
 		  xdiff_emit_consume_fn fn, void *consume_callback_data,
 		  xpparam_t const *xpp, xdemitconf_t const *xecfg)
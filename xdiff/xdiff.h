@@ -111,9 +111,12 @@ typedef struct s_bdiffparam {
 
 void *xdl_mmfile_first(mmfile_t *mmf, long *size);
 long xdl_mmfile_size(mmfile_t *mmf);
+void xdl_free_pool(void);
 
 int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	     xdemitconf_t const *xecfg, xdemitcb_t *ecb);
+int xdl_diff_count(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+		   long *removed, long *added);
 
 typedef struct s_xmparam {
 	xpparam_t xpp;
@@ -610,3 +610,35 @@ int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 
 	return 0;
 }
+
+
+/*
+ * Count the lines that a diff would remove and add, without building
+ * the edit script or generating hunks.  Sliding groups of changes
+ * around in xdl_change_compact() does not change how many lines are
+ * marked, so we can skip it, too.  This does not know about
+ * XDF_IGNORE_BLANK_LINES, which depends on how changes are grouped
+ * into hunks.
+ */
+int xdl_diff_count(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+		   long *removed, long *added) {
+	xdfenv_t xe;
+	long i;
+
+	if (xdl_do_diff(mf1, mf2, xpp, &xe) < 0) {
+
+		return -1;
+	}
+
+	*removed = *added = 0;
+	for (i = 0; i < xe.xdf1.nrec; i++)
+		if (xe.xdf1.rchg[i])
+			(*removed)++;
+	for (i = 0; i < xe.xdf2.nrec; i++)
+		if (xe.xdf2.rchg[i])
+			(*added)++;
+
+	xdl_free_env(&xe);
+
+	return 0;
+}
@@ -28,6 +28,7 @@
 typedef struct s_chanode {
 	struct s_chanode *next;
 	long icurr;
+	long size;
 } chanode_t;
 
 typedef struct s_chastore {
@@ -24,6 +24,11 @@
 #include <assert.h>
 #include "xinclude.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define XDL_SSE2_HASH
+#endif
+
 
 
 
@@ -75,6 +80,74 @@ long xdl_mmfile_size(mmfile_t *mmf)
 }
 
 
+/*
+ * Preparing a diff allocates its records in chunks that are all freed
+ * again once the diff is done, and big chunks go straight back to the
+ * system.  Keep a few of them around so that the next diff in the
+ * same process (think "log -p") can reuse them.  The pool is per
+ * thread; a thread that is about to exit calls xdl_free_pool().
+ */
+#define XDL_CHA_POOL_MAX (8 * 1024 * 1024)
+
+#if defined(NO_PTHREADS)
+#define XDL_CHA_POOL static
+#elif defined(__GNUC__)
+#define XDL_CHA_POOL static __thread
+#endif
+
+#ifdef XDL_CHA_POOL
+
+XDL_CHA_POOL chanode_t *cha_pool;
+XDL_CHA_POOL long cha_pool_size;
+
+static chanode_t *xdl_cha_pool_get(long size) {
+	chanode_t **pp, *node;
+
+	for (pp = &cha_pool; (node = *pp) != NULL; pp = &node->next)
+		if (node->size >= size) {
+			*pp = node->next;
+			cha_pool_size -= node->size;
+			return node;
+		}
+
+	return NULL;
+}
+
+
+static void xdl_cha_pool_put(chanode_t *node) {
+
+	if (cha_pool_size + node->size > XDL_CHA_POOL_MAX) {
+		xdl_free(node);
+		return;
+	}
+	node->next = cha_pool;
+	cha_pool = node;
+	cha_pool_size += node->size;
+}
+
+
+void xdl_free_pool(void) {
+	chanode_t *cur, *tmp;
+
+	for (cur = cha_pool; (tmp = cur) != NULL;) {
+		cur = cur->next;
+		xdl_free(tmp);
+	}
+	cha_pool = NULL;
+	cha_pool_size = 0;
+}
+
+#else
+
+#define xdl_cha_pool_get(size) NULL
+#define xdl_cha_pool_put(node) xdl_free(node)
+
+void xdl_free_pool(void) {
+}
+
+#endif
+
+
 int xdl_cha_init(chastore_t *cha, long isize, long icount) {
 
 	cha->head = cha->tail = NULL;
@@ -92,7 +165,7 @@ void xdl_cha_free(chastore_t *cha) {
 
 	for (cur = cha->head; (tmp = cur) != NULL;) {
 		cur = cur->next;
-		xdl_free(tmp);
+		xdl_cha_pool_put(tmp);
 	}
 }
 
@@ -102,9 +175,12 @@ void *xdl_cha_alloc(chastore_t *cha) {
 	void *data;
 
 	if (!(ancur = cha->ancur) || ancur->icurr == cha->nsize) {
-		if (!(ancur = (chanode_t *) xdl_malloc(sizeof(chanode_t) + cha->nsize))) {
+		if (!(ancur = xdl_cha_pool_get(cha->nsize))) {
+			if (!(ancur = (chanode_t *) xdl_malloc(sizeof(chanode_t) + cha->nsize))) {
 
-			return NULL;
+				return NULL;
+			}
+			ancur->size = cha->nsize;
 		}
 		ancur->icurr = 0;
 		ancur->next = NULL;
@@ -262,7 +338,54 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 	return ha;
 }
 
-#ifdef XDL_FAST_HASH
+#if defined(XDL_SSE2_HASH)
+
+/*
+ * Find the end of the line 16 bytes at a time.  We never load past
+ * "top", as the buffer may be a memory mapping; the remaining bytes
+ * are left to memchr().
+ */
+static inline char const *xdl_find_eol(char const *ptr, char const *top) {
+	const __m128i nl = _mm_set1_epi8('\n');
+	char const *eol;
+
+	for (; top - ptr >= 16; ptr += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) ptr);
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+		if (mask)
+			return ptr + __builtin_ctz(mask);
+	}
+	eol = memchr(ptr, '\n', top - ptr);
+	return eol ? eol : top;
+}
+
+/*
+ * Once we know where the line ends, hash it a word at a time; the
+ * partial word at the end is zero-padded.
+ */
+unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
+	unsigned long ha = 5381, a;
+	char const *ptr = *data, *eol;
+
+	if (flags & XDF_WHITESPACE_FLAGS)
+		return xdl_hash_record_with_whitespace(data, top, flags);
+
+	eol = xdl_find_eol(ptr, top);
+	for (; eol - ptr >= (long) sizeof(a); ptr += sizeof(a)) {
+		memcpy(&a, ptr, sizeof(a));
+		ha += (ha << 5);
+		ha ^= a;
+	}
+	a = 0;
+	memcpy(&a, ptr, eol - ptr);
+	ha += (ha << 5);
+	ha ^= a;
+	*data = eol < top ? eol + 1: eol;
+
+	return ha;
+}
+
+#elif defined(XDL_FAST_HASH)
 
 #define REPEAT_BYTE(x)  ((~0ul / 0xff) * (x))
 
@@ -364,7 +487,7 @@ unsigned long xdl_hash_record(char const **data, char const *top, long flags)
 	return hash;
 }
 
-#else /* XDL_FAST_HASH */
+#else /* XDL_SSE2_HASH, XDL_FAST_HASH */
 
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
 	unsigned long ha = 5381;
@@ -382,7 +505,7 @@ unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
 	return ha;
 }
 
-#endif /* XDL_FAST_HASH */
+#endif /* XDL_SSE2_HASH, XDL_FAST_HASH */
 
 unsigned int xdl_hashbits(unsigned int size) {
 	unsigned int val = 1, bits = 0;